@@ -0,0 +1,89 @@
+/**
+ * @file allele_counts.cpp
+ * @brief Benchmark of the allele counting of high-dimensional populations.
+ * @author Richard Neher, Fabio Zanini
+ * @version
+ * @date 2013-02-14
+ *
+ * Compares the bit by bit loop over the genotypes, the loop over the set bits of each clone and the
+ * bit-sliced bulk kernel of the clone store.
+ */
+/* Include directives */
+#include "ffpopsim_highd.h"
+
+/* Be verbose? */
+#define PROFILE_VERBOSE 1
+
+/* Declarations */
+int allele_counts_profile(int L, int n_clones, double density, int repeats);
+
+/* MAIN */
+int main(int argc, char **argv){
+	int status= 0;
+	if (argc > 1) {
+		cout<<"Usage: "<<argv[0]<<endl;
+		status = 1;
+	} else {
+		status += allele_counts_profile(100000, 1000, 0.1, 5);
+		status += allele_counts_profile(100000, 1000, 0.5, 5);
+		status += allele_counts_profile(1000, 20000, 0.1, 20);
+	}
+	cout<<"Number of errors: "<<status<<endl;
+	return status;
+}
+
+double seconds_since(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int allele_counts_profile(int L, int n_clones, double density, int repeats) {
+	int err = 0;
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 1);
+
+	clone_store store;
+	store.set_up(L, 1);
+	store.resize(n_clones);
+	vector <boost::dynamic_bitset<> > genotypes(n_clones, boost::dynamic_bitset<>(L));
+	for(int i=0; i < n_clones; i++) {
+		for(int locus=0; locus < L; locus++)
+			genotypes[i][locus] = gsl_rng_uniform(rng) < density;
+		store.set_genotype(i, genotypes[i]);
+		store.clone_size[i] = 1 + gsl_rng_uniform_int(rng, 20);
+	}
+	if(PROFILE_VERBOSE) cerr<<"L = "<<L<<", clones = "<<n_clones<<", density = "<<density<<endl;
+
+	// bit by bit
+	vector <int> bit_counts(L);
+	clock_t start = clock();
+	for(int r=0; r < repeats; r++) {
+		bit_counts.assign(L, 0);
+		for(int i=0; i < n_clones; i++)
+			for(int locus=0; locus < L; locus++)
+				if(genotypes[i][locus]) bit_counts[locus] += store.clone_size[i];
+	}
+	double t_bits = seconds_since(start) / repeats;
+
+	// set bits of each clone
+	vector <int> clone_counts(L);
+	start = clock();
+	for(int r=0; r < repeats; r++) {
+		clone_counts.assign(L, 0);
+		for(int i=0; i < n_clones; i++)
+			store.add_allele_counts(i, store.clone_size[i], &clone_counts[0]);
+	}
+	double t_clones = seconds_since(start) / repeats;
+
+	// bit-sliced
+	vector <int> bulk_counts(L);
+	start = clock();
+	for(int r=0; r < repeats; r++)
+		store.count_alleles(n_clones, &bulk_counts[0]);
+	double t_bulk = seconds_since(start) / repeats;
+
+	if((bit_counts != clone_counts) or (bit_counts != bulk_counts)) err++;
+	cout<<"bit by bit: "<<t_bits<<" s, set bits: "<<t_clones<<" s, bit-sliced: "<<t_bulk<<" s"<<endl;
+
+	gsl_rng_free(rng);
+	return err;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file recombination.cpp
+ * @brief Benchmark of free recombination in high-dimensional populations.
+ * @author Richard Neher, Fabio Zanini
+ * @version
+ * @date 2013-02-14
+ *
+ * Compares the cost per mating pair of the reassortment pattern drawn bit block by bit block
+ * from the GSL generator with the pattern drawn a 64-bit word at a time, and of the whole mating.
+ * For crossovers, compares the pattern built by resizing a bitset with the mask written word by word.
+ */
+/* Include directives */
+#include "ffpopsim_highd.h"
+
+/* Be verbose? */
+#define PROFILE_VERBOSE 1
+
+/* Expose the reassortment pattern of the population */
+class recombination_profile : public haploid_highd {
+public:
+	recombination_profile(int L, int seed) : haploid_highd(L, seed) {}
+	void pattern(xoshiro256pp_t &gen, uint64_t *words) const {reassortment_pattern(gen, words);}
+};
+
+/* Declarations */
+int recombination_profile_run(int L, int repeats);
+int crossover_profile_run(int L, int n_crossovers, int repeats);
+
+/* MAIN */
+int main(int argc, char **argv){
+	int status= 0;
+	if (argc > 1) {
+		cout<<"Usage: "<<argv[0]<<endl;
+		status = 1;
+	} else {
+		status += recombination_profile_run(10000, 2000);
+		status += recombination_profile_run(100000, 200);
+		status += recombination_profile_run(1000000, 20);
+		status += crossover_profile_run(10000, 10, 20000);
+		status += crossover_profile_run(1000000, 10, 2000);
+		status += crossover_profile_run(1000000, 1000, 200);
+	}
+	cout<<"Number of errors: "<<status<<endl;
+	return status;
+}
+
+double seconds_since(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* The previous pattern generator: seven bits per call of the GSL generator, appended to the bitset */
+void legacy_pattern(gsl_rng *rng, int L, boost::dynamic_bitset<> &rec_pattern) {
+	int bpblock = rec_pattern.bits_per_block / 4;
+	unsigned long temp = 0;
+	int bits_left = L;
+	rec_pattern.clear();
+	while(bits_left >= 4 * bpblock) {
+		temp = gsl_rng_uniform_int(rng, 1<<bpblock);
+		temp += gsl_rng_uniform_int(rng, 1<<bpblock)<<bpblock;
+		temp += gsl_rng_uniform_int(rng, 1<<bpblock)<<(2*bpblock);
+		temp += gsl_rng_uniform_int(rng, 1<<bpblock)<<(3*bpblock);
+		rec_pattern.append(temp);
+		bits_left -= 4 * bpblock;
+	}
+	for(; bits_left > 0; bits_left--)
+		rec_pattern.push_back(gsl_rng_uniform_int(rng, 2));
+}
+
+int recombination_profile_run(int L, int repeats) {
+	int err = 0;
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 1);
+	if(PROFILE_VERBOSE) cerr<<"L = "<<L<<", pairs = "<<repeats<<endl;
+
+	// GSL bit blocks, converted to words for the clone store
+	boost::dynamic_bitset<> rec_pattern(L);
+	vector <uint64_t> words(rec_pattern.num_blocks());
+	clock_t start = clock();
+	for(int r=0; r < repeats; r++) {
+		legacy_pattern(rng, L, rec_pattern);
+		boost::to_block_range(rec_pattern, words.begin());
+	}
+	double t_legacy = seconds_since(start) / repeats;
+
+	// 64-bit words
+	recombination_profile pop(L, 1);
+	xoshiro256pp_t generator(1);
+	start = clock();
+	for(int r=0; r < repeats; r++)
+		pop.pattern(generator, &words[0]);
+	double t_words = seconds_since(start) / repeats;
+
+	// whole mating: pattern from reassortment_pattern() and offspring genotypes
+	clone_store store;
+	store.set_up(L, 1);
+	store.resize(4);
+	boost::dynamic_bitset<> parent(L);
+	for(int locus=0; locus < L; locus++)
+		parent[locus] = gsl_rng_uniform(rng) < 0.5;
+	store.set_genotype(0, parent);
+	store.set_genotype(1, ~parent);
+	start = clock();
+	for(int r=0; r < repeats; r++) {
+		pop.pattern(generator, &words[0]);
+		store.recombine(2, 3, 0, 1, &words[0]);
+	}
+	double t_mating = seconds_since(start) / repeats;
+
+	// the offspring of complementary parents are complementary
+	if(store.get_genotype(2) != ~store.get_genotype(3)) err++;
+	cout<<"per pair: GSL bit blocks: "<<t_legacy * 1e6<<" us, 64-bit words: "<<t_words * 1e6<<" us, mating: "<<t_mating * 1e6<<" us"<<endl;
+
+	gsl_rng_free(rng);
+	return err;
+}
+
+int crossover_profile_run(int L, int n_crossovers, int repeats) {
+	int err = 0;
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 1);
+	if(PROFILE_VERBOSE) cerr<<"L = "<<L<<", crossovers = "<<n_crossovers<<", pairs = "<<repeats<<endl;
+	vector <int> points(n_crossovers);
+	for(int c=0; c < n_crossovers; c++)
+		points[c] = 1 + gsl_rng_uniform_int(rng, L - 1);
+	sort(points.begin(), points.end());
+
+	// resized bitset, converted to words for the clone store
+	boost::dynamic_bitset<> rec_pattern;
+	vector <uint64_t> words((L + 63) / 64), mask((L + 63) / 64);
+	clock_t start = clock();
+	for(int r=0; r < repeats; r++) {
+		bool origin = true;
+		rec_pattern.clear();
+		for(int c=0; c < n_crossovers; c++) {
+			rec_pattern.resize(points[c], origin);
+			origin = !origin;
+		}
+		rec_pattern.resize(L, origin);
+		boost::to_block_range(rec_pattern, words.begin());
+	}
+	double t_resize = seconds_since(start) / repeats;
+
+	// whole-word fills
+	clone_store store;
+	store.set_up(L, 1);
+	start = clock();
+	for(int r=0; r < repeats; r++)
+		store.crossover_mask(points, &mask[0]);
+	double t_mask = seconds_since(start) / repeats;
+
+	if(mask != words) err++;
+	cout<<"per pair: resized bitset: "<<t_resize * 1e6<<" us, word fills: "<<t_mask * 1e6<<" us"<<endl;
+
+	gsl_rng_free(rng);
+	return err;
+}
@@ -37,6 +37,10 @@ includes = ['/usr/include', '/usr/local/include', '/opt/local/include']
 # can find GSL and Python 2.X
 library_dirs = []
 
+# Set the following to True to run the loops over clones of the high-dimensional
+# simulations on several threads via OpenMP (requires compiler support)
+openmp = False
+
 ############################################################################
 #                !!  DO NOT EDIT BELOW THIS LINE  !!                       #
 ############################################################################
@@ -46,6 +50,7 @@ PYBDIR = SRCDIR+'/python'
 
 includes = includes + npdis.misc_util.get_numpy_include_dirs()
 libs = ['gsl', 'gslcblas']
+openmp_flags = ['-fopenmp'] if openmp else []
 
 # Auxiliary functions
 def read(fname):
@@ -72,6 +77,10 @@ setup(name='FFPopSim',
       ext_modules=[Extension('_FFPopSim',
                              sources=[PYBDIR+'/FFPopSim_wrap.cpp',
                                       SRCDIR+'/haploid_highd.cpp', 
+                                      SRCDIR+'/clone_store.cpp',
+                                      SRCDIR+'/checkpoint.cpp',
+                                      SRCDIR+'/population_view.cpp',
+                                      SRCDIR+'/rng.cpp',
                                       SRCDIR+'/haploid_lowd.cpp', 
                                       SRCDIR+'/hivpopulation.cpp',
                                       SRCDIR+'/hivgene.cpp',
@@ -82,6 +91,8 @@ setup(name='FFPopSim',
                              include_dirs=includes, 
                              library_dirs=library_dirs,
                              libraries=libs,
+                             extra_compile_args=openmp_flags,
+                             extra_link_args=openmp_flags,
                             ),
                   ]
       )
@@ -0,0 +1,655 @@
+/*
+ * checkpoint.cpp
+ *
+ * Binary checkpoints of high-dimensional populations.
+ *
+ * Copyright (c) 2012-2013, Richard Neher, Fabio Zanini
+ * All rights reserved.
+ *
+ * This file is part of FFPopSim.
+ *
+ * FFPopSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FFPopSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FFPopSim. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ffpopsim_highd.h"
+
+/*
+ * Sections to be written. The data are not copied: they must stay in place until the file is written.
+ */
+struct checkpoint_writer_t {
+	vector <checkpoint_section_t> sections;
+	vector <const void *> data;
+
+	void add(uint32_t id, const void *values, size_t element_size, size_t count) {
+		checkpoint_section_t section;
+		section.id = id;
+		section.element_size = element_size;
+		section.offset = 0;
+		section.count = count;
+		sections.push_back(section);
+		data.push_back(values);
+	}
+	template <class T> void add(uint32_t id, const T *values, size_t count) {add(id, values, sizeof(T), count);}
+	template <class T> void add(uint32_t id, const vector <T> &values) {add(id, values.size() ? &values[0] : NULL, sizeof(T), values.size());}
+	int write(const char *filename);
+};
+
+/**
+ * @brief Write the header, the table of sections and the sections
+ *
+ * @returns zero if successful, HP_IOERR otherwise
+ */
+int checkpoint_writer_t::write(const char *filename) {
+	checkpoint_header_t header;
+	memcpy(header.magic, HP_CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = HP_CHECKPOINT_VERSION;
+	header.byte_order = HP_CHECKPOINT_BYTE_ORDER;
+	header.number_of_sections = sections.size();
+
+	uint64_t position = sizeof(header) + sections.size() * sizeof(checkpoint_section_t);
+	for (size_t s = 0; s < sections.size(); s++) {
+		position = (position + HP_CHECKPOINT_ALIGNMENT - 1) / HP_CHECKPOINT_ALIGNMENT * HP_CHECKPOINT_ALIGNMENT;
+		sections[s].offset = position;
+		position += sections[s].element_size * sections[s].count;
+	}
+
+	ofstream out(filename, ios::binary | ios::trunc);
+	if (!out.is_open()) {
+		cerr <<"checkpoint_writer_t::write(): cannot open "<<filename<<endl;
+		return HP_IOERR;
+	}
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)&sections[0], sections.size() * sizeof(checkpoint_section_t));
+	const char padding[HP_CHECKPOINT_ALIGNMENT] = {0};
+	for (size_t s = 0; s < sections.size(); s++) {
+		out.write(padding, sections[s].offset - out.tellp());
+		if (sections[s].count) out.write((const char *)data[s], sections[s].element_size * sections[s].count);
+	}
+	out.close();
+	if (out.fail()) {
+		cerr <<"checkpoint_writer_t::write(): error writing "<<filename<<endl;
+		return HP_IOERR;
+	}
+	return 0;
+}
+
+/**
+ * @brief Default constructor
+ */
+mapped_checkpoint::mapped_checkpoint() : data(NULL), length(0), sections(NULL), number_of_sections(0) {
+}
+
+/**
+ * @brief Destructor, unmaps the file
+ */
+mapped_checkpoint::~mapped_checkpoint() {
+	close();
+}
+
+/**
+ * @brief Map a checkpoint into memory and check its header and table of sections
+ *
+ * @param filename path of the checkpoint
+ *
+ * @returns zero if successful, HP_IOERR if the file cannot be mapped, HP_BADARG if it is not a valid checkpoint
+ */
+int mapped_checkpoint::open(const char *filename) {
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
+		cerr <<"mapped_checkpoint::open(): cannot open "<<filename<<endl;
+		return HP_IOERR;
+	}
+	struct stat status;
+	if (fstat(fd, &status) or (status.st_size < (off_t)sizeof(checkpoint_header_t))) {
+		cerr <<"mapped_checkpoint::open(): "<<filename<<" is not a checkpoint"<<endl;
+		::close(fd);
+		return HP_BADARG;
+	}
+	void *map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		cerr <<"mapped_checkpoint::open(): cannot map "<<filename<<endl;
+		return HP_IOERR;
+	}
+	data = (char *)map;
+	length = status.st_size;
+
+	// check the header and that all sections lie within the file
+	const checkpoint_header_t *header = (const checkpoint_header_t *)data;
+	int err = 0;
+	if (memcmp(header->magic, HP_CHECKPOINT_MAGIC, sizeof(header->magic)))
+		err = HP_BADARG;
+	else if ((header->byte_order != HP_CHECKPOINT_BYTE_ORDER) or (header->version != HP_CHECKPOINT_VERSION)) {
+		cerr <<"mapped_checkpoint::open(): "<<filename<<" has version "<<header->version<<" or the wrong byte order"<<endl;
+		err = HP_BADARG;
+	} else if (header->number_of_sections > (length - sizeof(checkpoint_header_t)) / sizeof(checkpoint_section_t))
+		err = HP_BADARG;
+	else {
+		sections = (const checkpoint_section_t *)(data + sizeof(checkpoint_header_t));
+		number_of_sections = header->number_of_sections;
+		for (size_t s = 0; s < number_of_sections; s++)
+			if ((sections[s].offset > length) or (sections[s].element_size == 0) or
+			    (sections[s].count > (length - sections[s].offset) / sections[s].element_size))
+				err = HP_BADARG;
+	}
+	if (err) {
+		cerr <<"mapped_checkpoint::open(): "<<filename<<" is not a valid checkpoint"<<endl;
+		close();
+	}
+	return err;
+}
+
+/**
+ * @brief Unmap the file
+ */
+void mapped_checkpoint::close() {
+	if (data) munmap(data, length);
+	data = NULL;
+	length = 0;
+	sections = NULL;
+	number_of_sections = 0;
+}
+
+/**
+ * @brief Find a section
+ *
+ * @param id identifier of the section (CKPT_*)
+ * @param element_size expected size of the elements
+ * @param count number of elements, set to zero if the section is missing
+ *
+ * @returns pointer to the first element, NULL if the section is missing or its elements have another size
+ */
+const void *mapped_checkpoint::find_section(uint32_t id, size_t element_size, size_t &count) const {
+	count = 0;
+	for (size_t s = 0; s < number_of_sections; s++)
+		if (sections[s].id == id) {
+			if (sections[s].element_size != element_size) return NULL;
+			count = sections[s].count;
+			return data + sections[s].offset;
+		}
+	return NULL;
+}
+
+/**
+ * @brief Get the parameters of the population
+ *
+ * @returns pointer to the parameters, NULL if they are missing
+ */
+const checkpoint_parameters_t *mapped_checkpoint::get_parameters() const {
+	size_t count;
+	const checkpoint_parameters_t *parameters = section<checkpoint_parameters_t>(CKPT_PARAMETERS, count);
+	return (count == 1) ? parameters : NULL;
+}
+
+/* Conversions of the records of the infinite sites model and of genealogies */
+static checkpoint_poly_t poly_record(const poly_t &poly) {
+	checkpoint_poly_t record;
+	record.birth = poly.birth;
+	record.sweep_time = poly.sweep_time;
+	record.effect = poly.effect;
+	record.fitness = poly.fitness;
+	record.fitness_variance = poly.fitness_variance;
+	return record;
+}
+
+static poly_t poly_from_record(const checkpoint_poly_t &record) {
+	return poly_t(record.birth, record.sweep_time, record.effect, record.fitness, record.fitness_variance);
+}
+
+static void add_node_record(const node_t &node, vector <checkpoint_node_t> &nodes, vector <tree_key_t> &children, vector <step_t> &steps) {
+	checkpoint_node_t record;
+	record.own_key = node.own_key;
+	record.parent_node = node.parent_node;
+	record.number_of_offspring = node.number_of_offspring;
+	record.clone_size = node.clone_size;
+	record.crossover[0] = node.crossover[0];
+	record.crossover[1] = node.crossover[1];
+	record.children = node.child_edges.size();
+	record.steps = node.weight_distribution.size();
+	record.fitness = node.fitness;
+	nodes.push_back(record);
+	children.insert(children.end(), node.child_edges.begin(), node.child_edges.end());
+	steps.insert(steps.end(), node.weight_distribution.begin(), node.weight_distribution.end());
+}
+
+static node_t node_from_record(const checkpoint_node_t &record, const tree_key_t *&children, const step_t *&steps) {
+	node_t node;
+	node.own_key = record.own_key;
+	node.parent_node = record.parent_node;
+	node.number_of_offspring = record.number_of_offspring;
+	node.clone_size = record.clone_size;
+	node.crossover[0] = record.crossover[0];
+	node.crossover[1] = record.crossover[1];
+	node.fitness = record.fitness;
+	node.child_edges.assign(children, children + record.children);
+	node.weight_distribution.assign(steps, steps + record.steps);
+	children += record.children;
+	steps += record.steps;
+	return node;
+}
+
+/**
+ * @brief Write the complete state of the population to a binary file
+ *
+ * @param filename path of the file, which is overwritten
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The checkpoint holds the clones (genotypes as stored, clone sizes, fitness and traits), the trait
+ * coefficients, all parameters, the state of the random number generator and the genealogies, if
+ * tracked. A population restored from it by read_checkpoint() evolves exactly like this one.
+ * The layout is described next to checkpoint_header_t; clones are written straight from the clone
+ * store, without conversion.
+ */
+int haploid_highd::write_checkpoint(const char *filename) {
+	if (HP_VERBOSE) cerr <<"haploid_highd::write_checkpoint("<<filename<<")...";
+	checkpoint_writer_t writer;
+	const size_t slots = population.size();
+
+	checkpoint_parameters_t parameters;
+	memset(&parameters, 0, sizeof(parameters));
+	parameters.number_of_loci = number_of_loci;
+	parameters.number_of_traits = number_of_traits;
+	parameters.genotype_representation = population.get_representation();
+	parameters.number_of_slots = slots;
+	parameters.last_clone = last_clone;
+	parameters.population_size = population_size;
+	parameters.number_of_clones = number_of_clones;
+	parameters.generation = generation;
+	parameters.carrying_capacity = carrying_capacity;
+	parameters.recombination_model = recombination_model;
+	parameters.selection_model = selection_model;
+	parameters.circular = circular;
+	parameters.all_polymorphic = all_polymorphic;
+	parameters.clone_deduplication = clone_deduplication;
+	parameters.seed = seed;
+	parameters.outcrossing_rate = outcrossing_rate;
+	parameters.crossover_rate = crossover_rate;
+	parameters.growth_rate = growth_rate;
+	parameters.min_occupancy = min_occupancy;
+	parameters.mutation_rate = mutation_rate;
+	parameters.fitness_max = fitness_max;
+	parameters.weight_reference = weight_reference;
+	parameters.logmean_expfitness = logmean_expfitness;
+	parameters.participation_ratio = get_participation_ratio();
+	parameters.fitness_mean = fitness_stat.mean;
+	parameters.fitness_variance = fitness_stat.variance;
+	strncpy(parameters.rng_type, gsl_rng_name(evo_generator), sizeof(parameters.rng_type) - 1);
+	writer.add(CKPT_PARAMETERS, &parameters, 1);
+	writer.add(CKPT_RNG_STATE, (const char *)gsl_rng_state(evo_generator), gsl_rng_size(evo_generator));
+
+	// clones
+	writer.add(CKPT_CLONE_SIZES, population.clone_size);
+	writer.add(CKPT_FITNESS, population.fitness);
+	writer.add(CKPT_TRAITS, slots ? population.trait(0) : NULL, slots * number_of_traits);
+	vector <uint64_t> loci_offsets;
+	vector <int> derived_loci;
+	if (population.is_sparse()) {
+		loci_offsets.reserve(slots + 1);
+		loci_offsets.push_back(0);
+		for (size_t i = 0; i < slots; i++) {
+			derived_loci.insert(derived_loci.end(), population.derived_loci(i).begin(), population.derived_loci(i).end());
+			loci_offsets.push_back(derived_loci.size());
+		}
+		writer.add(CKPT_DERIVED_LOCI_OFFSETS, loci_offsets);
+		writer.add(CKPT_DERIVED_LOCI, derived_loci);
+	} else
+		writer.add(CKPT_GENOTYPE_WORDS, slots ? population.genotype(0) : NULL, slots * population.get_words());
+
+	// traits
+	vector <checkpoint_trait_t> traits(number_of_traits);
+	vector <checkpoint_additive_t> additive;
+	vector <checkpoint_epistasis_t> epistasis;
+	vector <int> epistasis_loci;
+	for (int t = 0; t < number_of_traits; t++) {
+		traits[t].seed = trait[t].get_seed();
+		traits[t].rng_offset = trait[t].rng_offset;
+		traits[t].hypercube_mean = trait[t].hypercube_mean;
+		traits[t].epistatic_std = trait[t].epistatic_std;
+		for (size_t c = 0; c < trait[t].coefficients_single_locus.size(); c++) {
+			checkpoint_additive_t record;
+			record.trait = t;
+			record.locus = trait[t].coefficients_single_locus[c].locus;
+			record.value = trait[t].coefficients_single_locus[c].value;
+			additive.push_back(record);
+		}
+		const epistasis_terms_t &terms = trait[t].get_epistasis_terms();
+		for (size_t c = 0; c < terms.size(); c++) {
+			checkpoint_epistasis_t record;
+			record.trait = t;
+			record.order = terms.order(c);
+			record.value = terms.values[c];
+			epistasis.push_back(record);
+		}
+		epistasis_loci.insert(epistasis_loci.end(), terms.loci.begin(), terms.loci.end());
+	}
+	writer.add(CKPT_TRAIT_WEIGHTS, trait_weights, number_of_traits);
+	writer.add(CKPT_TRAIT_PARAMETERS, traits);
+	writer.add(CKPT_ADDITIVE, additive);
+	writer.add(CKPT_EPISTASIS, epistasis);
+	writer.add(CKPT_EPISTASIS_LOCI, epistasis_loci);
+
+	// mutations
+	writer.add(CKPT_MUTATION_RATES, mutation_rate_map);
+	writer.add(CKPT_ANCESTRAL_STATE, ancestral_state);
+	vector <checkpoint_poly_t> polymorphisms, fixed;
+	transform(polymorphism.begin(), polymorphism.end(), back_inserter(polymorphisms), poly_record);
+	transform(fixed_mutations.begin(), fixed_mutations.end(), back_inserter(fixed), poly_record);
+	writer.add(CKPT_POLYMORPHISM, polymorphisms);
+	writer.add(CKPT_FIXED_MUTATIONS, fixed);
+	writer.add(CKPT_NUMBER_OF_MUTATIONS, number_of_mutations);
+
+	// genealogies
+	vector <checkpoint_tree_t> trees;
+	vector <checkpoint_node_t> nodes;
+	vector <checkpoint_edge_t> edges;
+	vector <tree_key_t> children, leafs;
+	vector <step_t> steps;
+	if (track_genealogy) {
+		for (size_t locus = 0; locus < genealogy.loci.size(); locus++) {
+			rooted_tree &tree = genealogy.trees[locus];
+			checkpoint_tree_t record;
+			record.root = tree.root;
+			record.MRCA = tree.MRCA;
+			record.nodes = tree.nodes.size();
+			record.edges = tree.edges.size();
+			record.leafs = tree.leafs.size();
+			record.new_generation = genealogy.newGenerations[locus].size();
+			trees.push_back(record);
+			for (map <tree_key_t, node_t>::iterator node = tree.nodes.begin(); node != tree.nodes.end(); node++)
+				add_node_record(node->second, nodes, children, steps);
+			for (size_t i = 0; i < genealogy.newGenerations[locus].size(); i++)
+				add_node_record(genealogy.newGenerations[locus][i], nodes, children, steps);
+			for (map <tree_key_t, edge_t>::iterator edge = tree.edges.begin(); edge != tree.edges.end(); edge++) {
+				checkpoint_edge_t edge_record;
+				edge_record.own_key = edge->second.own_key;
+				edge_record.parent_node = edge->second.parent_node;
+				edge_record.segment[0] = edge->second.segment[0];
+				edge_record.segment[1] = edge->second.segment[1];
+				edge_record.length = edge->second.length;
+				edge_record.number_of_offspring = edge->second.number_of_offspring;
+				edges.push_back(edge_record);
+			}
+			leafs.insert(leafs.end(), tree.leafs.begin(), tree.leafs.end());
+		}
+		writer.add(CKPT_GENEALOGY_LOCI, genealogy.loci);
+		writer.add(CKPT_TREES, trees);
+		writer.add(CKPT_TREE_NODES, nodes);
+		writer.add(CKPT_TREE_CHILDREN, children);
+		writer.add(CKPT_TREE_STEPS, steps);
+		writer.add(CKPT_TREE_EDGES, edges);
+		writer.add(CKPT_TREE_LEAFS, leafs);
+	}
+
+	// subclasses
+	vector <double> extra;
+	get_checkpoint_extra(extra);
+	writer.add(CKPT_EXTRA, extra);
+
+	int err = writer.write(filename);
+	if (HP_VERBOSE) cerr <<"done."<<endl;
+	return err;
+}
+
+/**
+ * @brief Restore the complete state of the population from a checkpoint
+ *
+ * @param filename path of a file written by write_checkpoint()
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The population must have the same number of loci and traits as the one that was saved; everything
+ * else, including the genotype representation and the generator of random numbers, is taken from the file.
+ * The file is memory mapped and the clones are copied in bulk, without evaluating the traits again. The
+ * population is left unchanged if the file is invalid or if memory runs out: the clones are copied into
+ * a new store, which replaces the old one only once it is complete, so that both are held for a moment.
+ */
+int haploid_highd::read_checkpoint(const char *filename) {
+	if (HP_VERBOSE) cerr <<"haploid_highd::read_checkpoint("<<filename<<")...";
+	mapped_checkpoint file;
+	int err = file.open(filename);
+	if (err) return err;
+
+	const checkpoint_parameters_t *parameters = file.get_parameters();
+	if ((parameters == NULL) or (parameters->number_of_loci != number_of_loci) or (parameters->number_of_traits != number_of_traits)) {
+		cerr <<"haploid_highd::read_checkpoint(): "<<filename<<" does not hold a population with "<<number_of_loci<<" loci and "<<number_of_traits<<" traits"<<endl;
+		return HP_BADARG;
+	}
+
+	// find and check all sections before anything is changed
+	const size_t slots = parameters->number_of_slots;
+	const bool sparse = (parameters->genotype_representation == SPARSE_GENOTYPES);
+	const size_t words = (number_of_loci + 63) / 64;
+	const gsl_rng_type *rng_type = NULL;
+	for (int backend = RNG_TAUS2; (backend <= RNG_PHILOX4X32) and (rng_type == NULL); backend++)
+		if (!strncmp(rng_backend_type(backend)->name, parameters->rng_type, sizeof(parameters->rng_type)))
+			rng_type = rng_backend_type(backend);
+	size_t n_sizes, n_fitness, n_traits, n_words, n_offsets, n_loci, n_weights, n_trait_parameters, n_additive, n_epistasis, n_epistasis_loci;
+	size_t n_rates, n_ancestral, n_polymorphisms, n_fixed, n_mutations, n_rng, n_extra;
+	const int32_t *clone_sizes = file.section<int32_t>(CKPT_CLONE_SIZES, n_sizes);
+	const double *fitness = file.section<double>(CKPT_FITNESS, n_fitness);
+	const double *traits = file.section<double>(CKPT_TRAITS, n_traits);
+	const uint64_t *genotype_words = file.section<uint64_t>(CKPT_GENOTYPE_WORDS, n_words);
+	const uint64_t *loci_offsets = file.section<uint64_t>(CKPT_DERIVED_LOCI_OFFSETS, n_offsets);
+	const int32_t *derived_loci = file.section<int32_t>(CKPT_DERIVED_LOCI, n_loci);
+	const double *weights = file.section<double>(CKPT_TRAIT_WEIGHTS, n_weights);
+	const checkpoint_trait_t *trait_parameters = file.section<checkpoint_trait_t>(CKPT_TRAIT_PARAMETERS, n_trait_parameters);
+	const checkpoint_additive_t *additive = file.section<checkpoint_additive_t>(CKPT_ADDITIVE, n_additive);
+	const checkpoint_epistasis_t *epistasis = file.section<checkpoint_epistasis_t>(CKPT_EPISTASIS, n_epistasis);
+	const int32_t *epistasis_loci = file.section<int32_t>(CKPT_EPISTASIS_LOCI, n_epistasis_loci);
+	const double *rates = file.section<double>(CKPT_MUTATION_RATES, n_rates);
+	const int32_t *ancestral = file.section<int32_t>(CKPT_ANCESTRAL_STATE, n_ancestral);
+	const checkpoint_poly_t *polymorphisms = file.section<checkpoint_poly_t>(CKPT_POLYMORPHISM, n_polymorphisms);
+	const checkpoint_poly_t *fixed = file.section<checkpoint_poly_t>(CKPT_FIXED_MUTATIONS, n_fixed);
+	const int32_t *mutations = file.section<int32_t>(CKPT_NUMBER_OF_MUTATIONS, n_mutations);
+	const char *rng_state = file.section<char>(CKPT_RNG_STATE, n_rng);
+	const double *extra = file.section<double>(CKPT_EXTRA, n_extra);
+
+	bool valid = (rng_type != NULL) and (rng_state != NULL) and (n_rng == rng_type->size) and
+		(parameters->number_of_slots >= 0) and (parameters->last_clone >= 0) and
+		(n_sizes == slots) and (n_fitness == slots) and (n_traits == slots * number_of_traits) and
+		(n_weights == (size_t)number_of_traits) and (n_trait_parameters == (size_t)number_of_traits) and
+		((n_rates == 0) or (n_rates == (size_t)number_of_loci)) and ((n_ancestral == 0) or (n_ancestral == (size_t)number_of_loci));
+	// per-locus mutation rates are nonnegative and not all zero, and not used with all_polymorphic
+	double total_rate = 0;
+	for (size_t locus = 0; valid and (locus < n_rates); locus++) {
+		valid = (rates[locus] >= 0);
+		total_rate += rates[locus];
+	}
+	valid = valid and ((n_rates == 0) or ((total_rate > 0) and (!parameters->all_polymorphic)));
+	if (valid and sparse) {
+		valid = (n_offsets == slots + 1) and (loci_offsets[0] == 0) and (loci_offsets[slots] == n_loci);
+		for (size_t i = 0; valid and (i < slots); i++)
+			valid = (loci_offsets[i] <= loci_offsets[i + 1]);
+		for (size_t l = 0; valid and (l < n_loci); l++)
+			valid = (derived_loci[l] >= 0) and (derived_loci[l] < number_of_loci);
+		// the derived loci of each clone are sorted and unique
+		for (size_t i = 0; valid and (i < slots); i++)
+			for (uint64_t l = loci_offsets[i]; valid and (l + 1 < loci_offsets[i + 1]); l++)
+				valid = (derived_loci[l] < derived_loci[l + 1]);
+	} else if (valid)
+		valid = (parameters->genotype_representation == DENSE_GENOTYPES) and (n_words == slots * words);
+	size_t used_loci = 0;
+	for (size_t c = 0; valid and (c < n_additive); c++)
+		valid = (additive[c].trait >= 0) and (additive[c].trait < number_of_traits) and (additive[c].locus >= 0) and (additive[c].locus < number_of_loci);
+	for (size_t c = 0; valid and (c < n_epistasis); c++) {
+		valid = (epistasis[c].trait >= 0) and (epistasis[c].trait < number_of_traits) and (epistasis[c].order >= 0);
+		used_loci += epistasis[c].order;
+	}
+	valid = valid and (used_loci == n_epistasis_loci);
+	for (size_t l = 0; valid and (l < n_epistasis_loci); l++)
+		valid = (epistasis_loci[l] >= 0) and (epistasis_loci[l] < number_of_loci);
+
+	// genealogies
+	size_t n_genealogy_loci, n_trees, n_nodes, n_children, n_steps, n_edges, n_leafs;
+	const int32_t *genealogy_loci = file.section<int32_t>(CKPT_GENEALOGY_LOCI, n_genealogy_loci);
+	const checkpoint_tree_t *trees = file.section<checkpoint_tree_t>(CKPT_TREES, n_trees);
+	const checkpoint_node_t *nodes = file.section<checkpoint_node_t>(CKPT_TREE_NODES, n_nodes);
+	const tree_key_t *children = file.section<tree_key_t>(CKPT_TREE_CHILDREN, n_children);
+	const step_t *steps = file.section<step_t>(CKPT_TREE_STEPS, n_steps);
+	const checkpoint_edge_t *edges = file.section<checkpoint_edge_t>(CKPT_TREE_EDGES, n_edges);
+	const tree_key_t *leafs = file.section<tree_key_t>(CKPT_TREE_LEAFS, n_leafs);
+	size_t used_nodes = 0, used_children = 0, used_steps = 0, used_edges = 0, used_leafs = 0;
+	valid = valid and (n_trees == n_genealogy_loci);
+	for (size_t locus = 0; valid and (locus < n_genealogy_loci); locus++)
+		valid = (genealogy_loci[locus] >= 0) and (genealogy_loci[locus] < number_of_loci);
+	for (size_t locus = 0; valid and (locus < n_trees); locus++) {
+		valid = (trees[locus].nodes >= 0) and (trees[locus].new_generation >= 0) and (trees[locus].edges >= 0) and (trees[locus].leafs >= 0);
+		used_nodes += trees[locus].nodes + trees[locus].new_generation;
+		used_edges += trees[locus].edges;
+		used_leafs += trees[locus].leafs;
+	}
+	valid = valid and (used_nodes == n_nodes) and (used_edges == n_edges) and (used_leafs == n_leafs);
+	for (size_t n = 0; valid and (n < n_nodes); n++) {
+		valid = (nodes[n].children >= 0) and (nodes[n].steps >= 0);
+		used_children += nodes[n].children;
+		used_steps += nodes[n].steps;
+	}
+	valid = valid and (used_children == n_children) and (used_steps == n_steps);
+	if (!valid) {
+		cerr <<"haploid_highd::read_checkpoint(): "<<filename<<" is incomplete or inconsistent"<<endl;
+		return HP_BADARG;
+	}
+
+	// the clones are restored into a new store and the subclass state is set first, so that nothing
+	// is changed if either fails
+	clone_store restored;
+	restored.set_up(number_of_loci, number_of_traits, parameters->genotype_representation);
+	if (restored.resize(slots)) return HP_MEMERR;
+	if (slots) {
+		if (sparse) {
+			for (size_t i = 0; i < slots; i++)
+				restored.set_derived_loci(i, derived_loci + loci_offsets[i], derived_loci + loci_offsets[i + 1]);
+		} else
+			memcpy(restored.genotype(0), genotype_words, slots * words * sizeof(uint64_t));
+		memcpy(&restored.clone_size[0], clone_sizes, slots * sizeof(int32_t));
+		memcpy(&restored.fitness[0], fitness, slots * sizeof(double));
+		memcpy(restored.trait(0), traits, slots * number_of_traits * sizeof(double));
+	}
+	for (size_t i = 0; i < slots; i++)
+		restored.fitness_weight[i] = exp(restored.fitness[i] - parameters->weight_reference);
+	err = set_checkpoint_extra(vector <double>(extra, extra + n_extra));
+	if (err) {
+		cerr <<"haploid_highd::read_checkpoint(): "<<filename<<" does not hold the state of this kind of population"<<endl;
+		return err;
+	}
+
+	// random number generator
+	if (evo_generator->type != rng_type) {
+		gsl_rng_free(evo_generator);
+		evo_generator = gsl_rng_alloc(rng_type);
+	}
+	memcpy(gsl_rng_state(evo_generator), rng_state, n_rng);
+	seed = parameters->seed;
+
+	// clones; the free slots are the empty ones
+	population.swap(restored);
+	weight_reference = parameters->weight_reference;
+	available_clones.clear();
+	for (size_t i = 0; i < slots; i++)
+		if (population.clone_size[i] <= 0) available_clones.release(i);
+	clones_needed_for_recombination.clear();
+	last_clone = parameters->last_clone;
+	population_size = parameters->population_size;
+	number_of_clones = parameters->number_of_clones;
+
+	// parameters and statistics
+	generation = parameters->generation;
+	carrying_capacity = parameters->carrying_capacity;
+	recombination_model = parameters->recombination_model;
+	selection_model = parameters->selection_model;
+	circular = parameters->circular;
+	all_polymorphic = parameters->all_polymorphic;
+	clone_deduplication = parameters->clone_deduplication;
+	outcrossing_rate = parameters->outcrossing_rate;
+	crossover_rate = parameters->crossover_rate;
+	growth_rate = parameters->growth_rate;
+	min_occupancy = parameters->min_occupancy;
+	fitness_max = parameters->fitness_max;
+	logmean_expfitness = parameters->logmean_expfitness;
+	participation_ratio = parameters->participation_ratio;
+	fitness_stat = stat_t(parameters->fitness_mean, parameters->fitness_variance);
+
+	// traits
+	for (int t = 0; t < number_of_traits; t++) {
+		trait[t].set_up(number_of_loci, trait_parameters[t].seed);
+		trait[t].rng_offset = trait_parameters[t].rng_offset;
+		trait[t].hypercube_mean = trait_parameters[t].hypercube_mean;
+		trait[t].epistatic_std = trait_parameters[t].epistatic_std;
+		trait_weights[t] = weights[t];
+	}
+	vector <int> loci(1);
+	for (size_t c = 0; c < n_additive; c++) {
+		loci[0] = additive[c].locus;
+		trait[additive[c].trait].add_coefficient(additive[c].value, loci);
+	}
+	for (size_t c = 0; c < n_epistasis; c++) {
+		loci.assign(epistasis_loci, epistasis_loci + epistasis[c].order);
+		epistasis_loci += epistasis[c].order;
+		trait[epistasis[c].trait].add_coefficient(epistasis[c].value, loci);
+	}
+
+	// mutations
+	mutation_rate_map.clear();
+	mutation_rate = parameters->mutation_rate;
+	if (n_rates) set_mutation_rates(vector <double>(rates, rates + n_rates));
+	ancestral_state.assign(ancestral, ancestral + n_ancestral);
+	polymorphism.clear();
+	transform(polymorphisms, polymorphisms + n_polymorphisms, back_inserter(polymorphism), poly_from_record);
+	fixed_mutations.clear();
+	transform(fixed, fixed + n_fixed, back_inserter(fixed_mutations), poly_from_record);
+	number_of_mutations.assign(mutations, mutations + n_mutations);
+
+	// genealogies
+	genealogy.reset();
+	track_genealogy = (n_genealogy_loci > 0);
+	for (size_t locus = 0; locus < n_genealogy_loci; locus++) {
+		genealogy.track_locus(genealogy_loci[locus]);
+		rooted_tree &tree = genealogy.trees[locus];
+		tree.nodes.clear();
+		tree.edges.clear();
+		tree.root = trees[locus].root;
+		tree.MRCA = trees[locus].MRCA;
+		for (int n = 0; n < trees[locus].nodes; n++, nodes++)
+			tree.nodes.insert(tree.nodes.end(), make_pair(nodes->own_key, node_from_record(*nodes, children, steps)));
+		genealogy.newGenerations[locus].reserve(trees[locus].new_generation);
+		for (int n = 0; n < trees[locus].new_generation; n++, nodes++)
+			genealogy.newGenerations[locus].push_back(node_from_record(*nodes, children, steps));
+		for (int e = 0; e < trees[locus].edges; e++, edges++) {
+			edge_t edge;
+			edge.own_key = edges->own_key;
+			edge.parent_node = edges->parent_node;
+			edge.segment[0] = edges->segment[0];
+			edge.segment[1] = edges->segment[1];
+			edge.length = edges->length;
+			edge.number_of_offspring = edges->number_of_offspring;
+			tree.edges.insert(tree.edges.end(), make_pair(edge.own_key, edge));
+		}
+		tree.leafs.assign(leafs, leafs + trees[locus].leafs);
+		leafs += trees[locus].leafs;
+	}
+
+	// caches are rebuilt on demand
+	allele_frequencies_up_to_date = false;
+	allele_counts_up_to_date = false;
+	clone_index.clear();
+	clone_sampler_up_to_date = false;
+
+	if (HP_VERBOSE) cerr <<"done."<<endl;
+	return 0;
+}
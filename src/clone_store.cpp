@@ -0,0 +1,674 @@
+/*
+ *  clone_store.cpp
+ *  Haploids
+ *
+ *
+ * Copyright (c) 2012-2013, Richard Neher, Fabio Zanini
+ * All rights reserved.
+ *
+ * This file is part of FFPopSim.
+ *
+ * FFPopSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FFPopSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FFPopSim. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include "ffpopsim_highd.h"
+
+#define CS_ALIGNMENT 64		// alignment of the genotype arena in bytes (one cache line)
+#define CI_MIN_SLOTS 1024	// smallest clone index table
+
+/*
+ * Genotype kernels. For W > 0 the number of words is a compile-time constant, otherwise the
+ * run-time argument is used (dynamic fallback).
+ */
+template <size_t W>
+static void recombine_words(uint64_t *o1, uint64_t *o2, const uint64_t *p1, const uint64_t *p2, const uint64_t *pattern, size_t words) {
+	const size_t n = W ? W : words;
+	for (size_t w = 0; w < n; w++) {
+		o1[w] = (p1[w] & pattern[w]) | (p2[w] & ~pattern[w]);
+		o2[w] = (p2[w] & pattern[w]) | (p1[w] & ~pattern[w]);
+	}
+}
+
+template <size_t W>
+static int count_words(const uint64_t *gt, size_t words) {
+	const size_t n = W ? W : words;
+	int c = 0;
+	for (size_t w = 0; w < n; w++) c += __builtin_popcountll(gt[w]);
+	return c;
+}
+
+template <size_t W>
+static int distance_words(const uint64_t *gt1, const uint64_t *gt2, size_t words) {
+	const size_t n = W ? W : words;
+	int d = 0;
+	for (size_t w = 0; w < n; w++) d += __builtin_popcountll(gt1[w] ^ gt2[w]);
+	return d;
+}
+
+template <size_t W>
+static int compare_words(const uint64_t *gt1, const uint64_t *gt2, size_t words) {
+	const size_t n = W ? W : words;
+	for (size_t w = 0; w < n; w++)
+		if (gt1[w] != gt2[w]) return (gt1[w] < gt2[w]) ? -1 : 1;
+	return 0;
+}
+
+#define GENOTYPE_KERNELS(W) {W, &recombine_words<W>, &count_words<W>, &distance_words<W>, &compare_words<W>}
+
+// specialized widths: short genomes, powers of two up to 4096 loci and HIVGENOME (10000 loci);
+// the last entry is the dynamic fallback
+static const genotype_kernels_t genotype_kernels[] = {
+	GENOTYPE_KERNELS(1), GENOTYPE_KERNELS(2), GENOTYPE_KERNELS(3), GENOTYPE_KERNELS(4),
+	GENOTYPE_KERNELS(5), GENOTYPE_KERNELS(6), GENOTYPE_KERNELS(7), GENOTYPE_KERNELS(8),
+	GENOTYPE_KERNELS(16), GENOTYPE_KERNELS(32), GENOTYPE_KERNELS(64), GENOTYPE_KERNELS(157),
+	GENOTYPE_KERNELS(0)
+};
+
+/**
+ * @brief Get the kernels specialized on a number of words, or the dynamic ones
+ */
+static const genotype_kernels_t *select_genotype_kernels(size_t words) {
+	const genotype_kernels_t *k = genotype_kernels;
+	while ((k->words != 0) and (k->words != words)) k++;
+	return k;
+}
+
+/*
+ * Bit-sliced allele counting. The counts of 512 consecutive loci (one cache line of genotype words)
+ * are held in CS_COUNT_PLANES bit planes, plane k holding bit k of all 512 counts. A clone of size n is
+ * added by a full adder running over the planes, the addend of plane k being the genotype words if bit k
+ * of n is set, so that all loci of the block are counted at once without branches. The planes are
+ * converted to integer counts only once per block.
+ *
+ * The kernel is written on 512-bit vectors, see HP_TARGET_CLONES.
+ */
+#define CS_COUNT_WORDS 8		// genotype words per block of loci
+#define CS_COUNT_PLANES 32		// bits per count
+#define CS_COUNT_PREFETCH 8		// rows to prefetch ahead
+
+typedef uint64_t count_vector_t __attribute__((vector_size(CS_COUNT_WORDS * sizeof(uint64_t))));
+
+/**
+ * @brief Add the weighted genotypes of clones 0..end-1 to the counts of one block of loci
+ *
+ * @param arena genotype words, one row of words per clone
+ * @param words row stride
+ * @param first_word first word of the block
+ * @param block_words words in the block (CS_COUNT_WORDS, less for the last block)
+ * @param weights clone sizes
+ * @param end number of clones
+ * @param counts allele counts of all loci
+ */
+HP_TARGET_CLONES
+static void count_alleles_block(const uint64_t *arena, size_t words, size_t first_word, size_t block_words,
+				const int *weights, size_t end, int *counts) {
+	count_vector_t planes[CS_COUNT_PLANES];
+	memset(planes, 0, sizeof(planes));
+	count_vector_t x, carry, overflow;
+	memset(&x, 0, sizeof(x));
+	uint64_t total = 0;
+	int top = 0;
+	const uint64_t *row = arena + first_word;
+	for (size_t i = 0; i < end; i++, row += words) {
+		// the rows are far apart for long genomes, so the hardware prefetcher does not help
+		if (i + CS_COUNT_PREFETCH < end) __builtin_prefetch(row + CS_COUNT_PREFETCH * words);
+		if (weights[i] <= 0) continue;
+		if (block_words == CS_COUNT_WORDS) memcpy(&x, row, sizeof(x));	// a single vector load
+		else memcpy(&x, row, block_words * sizeof(uint64_t));
+		//add the bits of the weight and the carries plane by plane, up to the highest plane the total can reach
+		uint64_t n = weights[i];
+		total += n;
+		while ((top < CS_COUNT_PLANES) and (total >> top)) top++;
+		memset(&carry, 0, sizeof(carry));
+		for (int k = 0; k < top; k++) {
+			count_vector_t addend = x & (uint64_t)(0 - ((n >> k) & 1));
+			count_vector_t partial = planes[k] ^ addend;
+			overflow = (planes[k] & addend) | (carry & partial);
+			planes[k] = partial ^ carry;
+			carry = overflow;
+		}
+	}
+
+	for (int k = 0; k < CS_COUNT_PLANES; k++)
+		for (size_t w = 0; w < block_words; w++)
+			for (uint64_t word = planes[k][w]; word; word &= word - 1)
+				counts[((first_word + w) << 6) + __builtin_ctzll(word)] += (int)(1u << k);
+}
+
+/**
+ * @brief Default constructor
+ *
+ * The store is empty until set_up is called.
+ */
+clone_store::clone_store() : number_of_loci(0), number_of_traits(0), representation(DENSE_GENOTYPES), words(0), capacity(0), arena(NULL),
+	kernels(select_genotype_kernels(0)) {
+}
+
+/**
+ * @brief Destructor
+ */
+clone_store::~clone_store() {
+	free(arena);
+}
+
+/**
+ * @brief Set the genome length, the number of traits and the genotype representation, and remove all clones
+ *
+ * @param L number of loci
+ * @param n_traits number of traits per clone
+ * @param representation_in DENSE_GENOTYPES or SPARSE_GENOTYPES
+ *
+ * @returns zero if successful, error codes otherwise
+ */
+int clone_store::set_up(int L, int n_traits, int representation_in) {
+	if ((L < 0) or (n_traits < 0)) return HP_BADARG;
+	if ((representation_in != DENSE_GENOTYPES) and (representation_in != SPARSE_GENOTYPES)) return HP_BADARG;
+	clear();
+	free(arena);
+	arena = NULL;
+	capacity = 0;
+	number_of_loci = L;
+	number_of_traits = n_traits;
+	representation = representation_in;
+	words = (L + 63) / 64;
+	kernels = select_genotype_kernels(words);
+	return 0;
+}
+
+/**
+ * @brief Change the number of clone slots
+ *
+ * @param n new number of slots
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * New slots are empty wildtype clones with zero fitness and traits. Existing slots keep their content.
+ * The arena grows geometrically, so that repeated small increments are amortized.
+ */
+int clone_store::resize(size_t n) {
+	size_t old_size = size();
+	if (is_sparse()) {
+		sparse_genotypes.resize(n);
+		for (size_t i = old_size; i < n; i++) sparse_genotypes[i].clear();
+	} else if (n > capacity) {
+		size_t new_capacity = max(n, capacity + capacity / 2);
+		void *new_arena = NULL;
+		if (posix_memalign(&new_arena, CS_ALIGNMENT, max(new_capacity * words, (size_t)1) * sizeof(uint64_t))) {
+			cerr <<"clone_store::resize(): cannot allocate "<<new_capacity<<" genotypes of "<<words<<" words!"<<endl;
+			return HP_MEMERR;
+		}
+		if (arena) {
+			memcpy(new_arena, arena, old_size * words * sizeof(uint64_t));
+			free(arena);
+		}
+		arena = (uint64_t *)new_arena;
+		capacity = new_capacity;
+	}
+	if ((!is_sparse()) and (n > old_size))
+		memset(arena + old_size * words, 0, (n - old_size) * words * sizeof(uint64_t));
+
+	clone_size.resize(n, 0);
+	fitness.resize(n, 0);
+	fitness_weight.resize(n, 0);
+	traits.resize(n * number_of_traits, 0);
+	return 0;
+}
+
+/**
+ * @brief Remove all clones (the arena is kept for reuse)
+ */
+void clone_store::clear() {
+	sparse_genotypes.clear();
+	clone_size.clear();
+	fitness.clear();
+	fitness_weight.clear();
+	traits.clear();
+}
+
+/**
+ * @brief Exchange all clones, the genome length and the representation with another store, without copying
+ */
+void clone_store::swap(clone_store &other) {
+	clone_size.swap(other.clone_size);
+	fitness.swap(other.fitness);
+	fitness_weight.swap(other.fitness_weight);
+	std::swap(number_of_loci, other.number_of_loci);
+	std::swap(number_of_traits, other.number_of_traits);
+	std::swap(representation, other.representation);
+	std::swap(words, other.words);
+	std::swap(capacity, other.capacity);
+	std::swap(arena, other.arena);
+	std::swap(kernels, other.kernels);
+	sparse_genotypes.swap(other.sparse_genotypes);
+	traits.swap(other.traits);
+}
+
+/**
+ * @brief Copy a bitset into the genotype of a clone
+ *
+ * @param i index of the clone
+ * @param gt genotype (of length L)
+ */
+void clone_store::set_genotype(size_t i, const boost::dynamic_bitset<> &gt) {
+	if (is_sparse()) {
+		sparse_genotypes[i].clear();
+		for (size_t locus = gt.find_first(); (locus != boost::dynamic_bitset<>::npos) and (locus < (size_t)number_of_loci); locus = gt.find_next(locus))
+			sparse_genotypes[i].push_back(locus);
+		return;
+	}
+	uint64_t *row = genotype(i);
+	memset(row, 0, words * sizeof(uint64_t));
+	for (size_t locus = gt.find_first(); (locus != boost::dynamic_bitset<>::npos) and (locus < (size_t)number_of_loci); locus = gt.find_next(locus))
+		row[locus >> 6] |= ((uint64_t)1) << (locus & 63);
+}
+
+/**
+ * @brief Get the genotype of a clone as a bitset
+ *
+ * @param i index of the clone
+ *
+ * @returns the genotype as a bitset of length L
+ */
+boost::dynamic_bitset<> clone_store::get_genotype(size_t i) const {
+	boost::dynamic_bitset<> gt(number_of_loci);
+	if (is_sparse()) {
+		for (vector<int>::const_iterator locus = sparse_genotypes[i].begin(); locus != sparse_genotypes[i].end(); locus++)
+			gt.set(*locus);
+		return gt;
+	}
+	const uint64_t *row = genotype(i);
+	for (size_t w = 0; w < words; w++)
+		for (uint64_t word = row[w]; word; word &= word - 1)
+			gt.set((w << 6) + __builtin_ctzll(word));
+	return gt;
+}
+
+/**
+ * @brief Hamming distance between the genotypes of two clones
+ */
+int clone_store::distance(size_t i, size_t j) const {
+	if (!is_sparse()) return kernels->distance(genotype(i), genotype(j), words);
+
+	// size of the symmetric difference of the sorted lists
+	const vector<int> &a = sparse_genotypes[i], &b = sparse_genotypes[j];
+	size_t ia = 0, ib = 0;
+	int common = 0;
+	while ((ia < a.size()) and (ib < b.size())) {
+		if (a[ia] < b[ib]) ia++;
+		else if (b[ib] < a[ia]) ib++;
+		else {common++; ia++; ib++;}
+	}
+	return a.size() + b.size() - 2 * common;
+}
+
+/**
+ * @brief Move a clone to another slot
+ *
+ * @param dest slot to move the clone to; its previous content is lost
+ * @param src clone to move, which is left empty
+ */
+void clone_store::move_clone(size_t dest, size_t src) {
+	if (is_sparse()) sparse_genotypes[dest].swap(sparse_genotypes[src]);
+	else memcpy(genotype(dest), genotype(src), words * sizeof(uint64_t));
+	clone_size[dest] = clone_size[src];
+	clone_size[src] = 0;
+	fitness[dest] = fitness[src];
+	fitness_weight[dest] = fitness_weight[src];
+	for (int t = 0; t < number_of_traits; t++) trait(dest)[t] = trait(src)[t];
+}
+
+/**
+ * @brief Total order on genotypes, for sorting
+ *
+ * @returns negative, zero or positive if genotype i is smaller, equal or larger than genotype j
+ */
+int clone_store::compare_genotypes(size_t i, size_t j) const {
+	if (!is_sparse()) return kernels->compare(genotype(i), genotype(j), words);
+	if (sparse_genotypes[i] == sparse_genotypes[j]) return 0;
+	return (sparse_genotypes[i] < sparse_genotypes[j]) ? -1 : 1;
+}
+
+/**
+ * @brief Add a weight to the counts of all derived alleles of a clone
+ *
+ * @param i index of the clone
+ * @param weight weight to add (usually the clone size)
+ * @param counts array of L counts
+ */
+template <class count_t>
+void clone_store::add_counts(size_t i, count_t weight, count_t *counts) const {
+	if (is_sparse()) {
+		for (vector<int>::const_iterator locus = sparse_genotypes[i].begin(); locus != sparse_genotypes[i].end(); locus++)
+			counts[*locus] += weight;
+		return;
+	}
+	const uint64_t *row = genotype(i);
+	for (size_t w = 0; w < words; w++)
+		for (uint64_t word = row[w]; word; word &= word - 1)
+			counts[(w << 6) + __builtin_ctzll(word)] += weight;
+}
+
+void clone_store::add_allele_counts(size_t i, double weight, double *counts) const {
+	add_counts(i, weight, counts);
+}
+
+void clone_store::add_allele_counts(size_t i, int weight, int *counts) const {
+	add_counts(i, weight, counts);
+}
+
+/**
+ * @brief Count the alleles of clones 0..end-1, weighted by the clone sizes
+ *
+ * @param end number of clones to count
+ * @param counts array of L counts, overwritten
+ *
+ * Dense genotypes are processed in blocks of 512 loci by a bit-sliced adder, see count_alleles_block.
+ */
+void clone_store::count_alleles(size_t end, int *counts) const {
+	for (int locus = 0; locus < number_of_loci; locus++) counts[locus] = 0;
+	end = min(end, size());
+	if (is_sparse()) {
+		for (size_t i = 0; i < end; i++)
+			if (clone_size[i] > 0) add_counts(i, clone_size[i], counts);
+		return;
+	}
+	if (end == 0) return;
+	count_packed_alleles(arena, words, &clone_size[0], end, counts);
+}
+
+/**
+ * @brief Add up the alleles of packed genotypes stored outside of a clone store
+ *
+ * @param rows genotypes, one row of words per clone, laid out as in the arena of a clone store
+ * @param words row stride
+ * @param weights clone sizes (clones of size zero or less are skipped)
+ * @param end number of clones
+ * @param counts allele counts of all loci, to which the alleles are added
+ */
+void clone_store::count_packed_alleles(const uint64_t *rows, size_t words, const int *weights, size_t end, int *counts) {
+	for (size_t w = 0; w < words; w += CS_COUNT_WORDS)
+		count_alleles_block(rows, words, w, min((size_t)CS_COUNT_WORDS, words - w), weights, end, counts);
+}
+
+/**
+ * @brief Get the kernels for genotypes of a number of words, e.g. of genotypes stored outside of a clone store
+ */
+const genotype_kernels_t *clone_store::get_kernels(size_t words) {
+	return select_genotype_kernels(words);
+}
+
+/**
+ * @brief Flip a locus in a sparse genotype (insert or remove it from the sorted list)
+ */
+void clone_store::flip_locus_sparse(size_t i, int locus) {
+	vector<int> &gt = sparse_genotypes[i];
+	vector<int>::iterator pos = lower_bound(gt.begin(), gt.end(), locus);
+	if ((pos != gt.end()) and (*pos == locus)) gt.erase(pos);
+	else gt.insert(pos, locus);
+}
+
+/**
+ * @brief Recombine two parental genotypes along a list of crossover points
+ *
+ * @param offspring1 index of the first offspring
+ * @param offspring2 index of the second offspring
+ * @param parent1 index of the first parent
+ * @param parent2 index of the second parent
+ * @param crossover_points sorted crossover points
+ *
+ * Offspring1 inherits from parent1 the loci before the first crossover point, from parent2
+ * the loci up to the second, and so on; offspring2 gets the complement. This is the same
+ * as recombining with the pattern that haploid_highd builds from the crossover points.
+ *
+ * In the sparse representation the parental lists are merged directly, without building the
+ * pattern. In the dense representation the pattern is built and recombine is called.
+ */
+void clone_store::recombine_crossovers(size_t offspring1, size_t offspring2, size_t parent1, size_t parent2, const vector<int> &crossover_points) {
+	if (is_sparse()) {
+		recombine_sparse(offspring1, offspring2, parent1, parent2, NULL, &crossover_points);
+		return;
+	}
+	vector<uint64_t> pattern(words);
+	crossover_mask(crossover_points, &pattern[0]);
+	recombine(offspring1, offspring2, parent1, parent2, &pattern[0]);
+}
+
+/**
+ * @brief Pack a crossover pattern into words
+ *
+ * @param crossover_points sorted crossover points
+ * @param pattern words to fill, one bit per locus
+ *
+ * The loci up to the first crossover point are set (i.e. taken from the first parent), the ones up to
+ * the next point are not, and so on. Runs of loci are written a word at a time.
+ */
+void clone_store::crossover_mask(const vector<int> &crossover_points, uint64_t *pattern) const {
+	memset(pattern, 0, words * sizeof(uint64_t));
+	bool origin = true;
+	int start = 0;
+	for (size_t c = 0; c <= crossover_points.size(); c++) {
+		int end = (c < crossover_points.size()) ? min(crossover_points[c], number_of_loci) : number_of_loci;
+		if (origin and (start < end)) {
+			int first = start >> 6, last = (end - 1) >> 6;
+			uint64_t head = ~((uint64_t)0) << (start & 63);
+			uint64_t tail = ~((uint64_t)0) >> (63 - ((end - 1) & 63));
+			if (first == last)
+				pattern[first] |= head & tail;
+			else {
+				pattern[first] |= head;
+				for (int w = first + 1; w < last; w++) pattern[w] = ~((uint64_t)0);
+				pattern[last] |= tail;
+			}
+		}
+		start = max(start, end);
+		origin = !origin;
+	}
+}
+
+/**
+ * @brief Merge two sparse parental genotypes into two offspring
+ *
+ * @param pattern recombination pattern packed into words, or NULL
+ * @param crossover_points sorted crossover points, used if pattern is NULL
+ *
+ * Loci carried by both parents go to both offspring. Any other derived locus goes to
+ * offspring1 if it comes from parent1 and the pattern is set (or from parent2 and the pattern is not set),
+ * to offspring2 otherwise. The merge preserves the order of the lists.
+ */
+void clone_store::recombine_sparse(size_t offspring1, size_t offspring2, size_t parent1, size_t parent2, const uint64_t *pattern, const vector<int> *crossover_points) {
+	const vector<int> &a = sparse_genotypes[parent1], &b = sparse_genotypes[parent2];
+	vector<int> &o1 = sparse_genotypes[offspring1], &o2 = sparse_genotypes[offspring2];
+	o1.clear();
+	o2.clear();
+	size_t ia = 0, ib = 0, c = 0;
+	bool origin = true;
+	int locus;
+	while ((ia < a.size()) or (ib < b.size())) {
+		if ((ib == b.size()) or ((ia < a.size()) and (a[ia] < b[ib]))) locus = a[ia];
+		else locus = b[ib];
+		bool from_a = (ia < a.size()) and (a[ia] == locus);
+		bool from_b = (ib < b.size()) and (b[ib] == locus);
+		if (from_a and from_b) {
+			o1.push_back(locus);
+			o2.push_back(locus);
+		} else {
+			bool set;
+			if (pattern) set = (pattern[locus >> 6] >> (locus & 63)) & 1;
+			else {
+				while ((c < crossover_points->size()) and ((*crossover_points)[c] <= locus)) {origin = !origin; c++;}
+				set = origin;
+			}
+			if (from_a == set) o1.push_back(locus);
+			else o2.push_back(locus);
+		}
+		if (from_a) ia++;
+		if (from_b) ib++;
+	}
+}
+
+/**
+ * @brief Check whether recombining two parents with a pattern gives back the parents
+ *
+ * @param parent1 index of the first parent
+ * @param parent2 index of the second parent
+ * @param pattern recombination pattern packed into words, as for recombine
+ *
+ * @returns true if the offspring would be copies of the parents, i.e. the pattern is set at all loci where
+ * the parents differ, or at none of them
+ *
+ * Dense genotypes are compared a word at a time, without building the offspring.
+ */
+bool clone_store::reproduces_parents(size_t parent1, size_t parent2, const uint64_t *pattern) const {
+	if (is_sparse()) return reproduces_parents_sparse(parent1, parent2, pattern, NULL);
+	const uint64_t *a = genotype(parent1), *b = genotype(parent2);
+	bool none = true, all = true;
+	for (size_t w = 0; (w < words) and (none or all); w++) {
+		uint64_t diff = a[w] ^ b[w], picked = diff & pattern[w];
+		none = none and (picked == 0);
+		all = all and (picked == diff);
+	}
+	return none or all;
+}
+
+/**
+ * @brief Check whether recombining two sparse parents gives back the parents
+ *
+ * @param pattern recombination pattern packed into words, or NULL
+ * @param crossover_points sorted crossover points, used if pattern is NULL
+ *
+ * The loci carried by one parent only are visited in order, as in recombine_sparse.
+ */
+bool clone_store::reproduces_parents_sparse(size_t parent1, size_t parent2, const uint64_t *pattern, const vector<int> *crossover_points) const {
+	const vector<int> &a = sparse_genotypes[parent1], &b = sparse_genotypes[parent2];
+	size_t ia = 0, ib = 0, c = 0;
+	bool origin = true, any_set = false, any_unset = false;
+	int locus;
+	while (((ia < a.size()) or (ib < b.size())) and !(any_set and any_unset)) {
+		if ((ib == b.size()) or ((ia < a.size()) and (a[ia] < b[ib]))) locus = a[ia];
+		else locus = b[ib];
+		bool from_a = (ia < a.size()) and (a[ia] == locus);
+		bool from_b = (ib < b.size()) and (b[ib] == locus);
+		if (from_a != from_b) {
+			bool set;
+			if (pattern) set = (pattern[locus >> 6] >> (locus & 63)) & 1;
+			else {
+				while ((c < crossover_points->size()) and ((*crossover_points)[c] <= locus)) {origin = !origin; c++;}
+				set = origin;
+			}
+			any_set = any_set or set;
+			any_unset = any_unset or !set;
+		}
+		if (from_a) ia++;
+		if (from_b) ib++;
+	}
+	return !(any_set and any_unset);
+}
+
+/**
+ * @brief Copy a clone out of the store
+ *
+ * @param i index of the clone
+ *
+ * @returns a clone_t with genotype, traits, fitness and size of clone i
+ */
+clone_t clone_store::get_clone(size_t i) const {
+	clone_t tempgt(number_of_traits);
+	tempgt.genotype = get_genotype(i);
+	for (int t = 0; t < number_of_traits; t++) tempgt.trait[t] = trait(i)[t];
+	tempgt.fitness = fitness[i];
+	tempgt.clone_size = clone_size[i];
+	return tempgt;
+}
+
+/**
+ * @brief Rebuild the clone index from scratch
+ *
+ * @param population clone store
+ * @param end one past the last clone to index
+ *
+ * All nonempty clones below end are hashed and entered. If several of them have the same genotype,
+ * lookups return one of them.
+ */
+void clone_index_t::rebuild(const clone_store &population, size_t end) {
+	hashes.assign(min(end, population.size()), 0);
+	for (size_t i = 0; i < hashes.size(); i++)
+		if (population.clone_size[i] > 0) hashes[i] = population.hash_genotype(i);
+	rehash(population);
+	up_to_date = true;
+}
+
+/**
+ * @brief Enter all nonempty clones in a fresh table, using the stored hashes
+ *
+ * @param population clone store
+ *
+ * The table is at most a quarter full afterwards.
+ */
+void clone_index_t::rehash(const clone_store &population) {
+	size_t nonempty = 0, n_slots = CI_MIN_SLOTS;
+	for (size_t i = 0; i < hashes.size(); i++)
+		if (population.clone_size[i] > 0) nonempty++;
+	while (n_slots < 4 * (nonempty + 1)) n_slots <<= 1;
+	slots.assign(n_slots, -1);
+	used = 0;
+	const size_t mask = n_slots - 1;
+	for (size_t i = 0; i < hashes.size(); i++)
+		if (population.clone_size[i] > 0) {
+			size_t pos = hashes[i] & mask;
+			while (slots[pos] >= 0) pos = (pos + 1) & mask;
+			slots[pos] = i;
+			used++;
+		}
+}
+
+/**
+ * @brief Look up a nonempty clone with the same genotype as a given clone
+ *
+ * @param population clone store
+ * @param clone clone whose genotype is looked up
+ * @param hash genotype hash of that clone
+ *
+ * @returns a nonempty clone other than clone with the same genotype, or -1 if there is none
+ */
+int clone_index_t::find(const clone_store &population, size_t clone, uint64_t hash) const {
+	const size_t mask = slots.size() - 1;
+	for (size_t pos = hash & mask; slots[pos] >= 0; pos = (pos + 1) & mask) {
+		const size_t candidate = slots[pos];
+		if ((candidate != clone) and (population.clone_size[candidate] > 0) and (hashes[candidate] == hash)
+		    and (population.compare_genotypes(candidate, clone) == 0))
+			return candidate;
+	}
+	return -1;
+}
+
+/**
+ * @brief Enter a clone in the index
+ *
+ * @param population clone store
+ * @param clone clone to enter
+ * @param hash genotype hash of that clone
+ *
+ * The first entry of a dead clone along the probe sequence is reused, if any.
+ */
+void clone_index_t::insert(const clone_store &population, size_t clone, uint64_t hash) {
+	if (hashes.size() < population.size()) hashes.resize(population.size(), 0);
+	if (2 * (used + 1) > slots.size()) rehash(population);
+	hashes[clone] = hash;
+	const size_t mask = slots.size() - 1;
+	size_t pos = hash & mask;
+	for (; slots[pos] >= 0; pos = (pos + 1) & mask)
+		if ((slots[pos] == (int)clone) or (population.clone_size[slots[pos]] == 0)) break;
+	if (slots[pos] < 0) used++;
+	slots[pos] = clone;
+}
@@ -26,6 +26,8 @@
 #define FFPOPGEN_GENERIC_H_
 
 #include <time.h>
+#include <string.h>
+#include <stdint.h>
 #include <cmath>
 #include <vector>
 #include <bitset>
@@ -43,7 +45,12 @@
 
 #define MIN(a,b) (a<b)?a:b
 #define MAX(a,b) (a>b)?a:b
-#define RNG gsl_rng_taus2		//choose the random number generator algorithm, see http://www.gnu.org/software/gsl/manual/html_node/Random-number-generator-algorithms.html
+#define RNG rng_backend_type()		//algorithm of newly allocated random number generators, see set_rng_backend
+
+// Random number generator backends
+#define RNG_TAUS2 0			//GSL's taus2, see http://www.gnu.org/software/gsl/manual/html_node/Random-number-generator-algorithms.html
+#define RNG_XOSHIRO256PP 1
+#define RNG_PHILOX4X32 2
 
 #define FREE_RECOMBINATION 1
 #define CROSSOVERS 2
@@ -51,6 +58,200 @@
 
 using namespace std;
 
+/**
+ * @brief Seed of an independent random number stream
+ *
+ * @param key random key, e.g. drawn once per generation from the main generator
+ * @param counter index of the stream (e.g. of a block of clones)
+ *
+ * @returns a well mixed seed (the counter-th output of a SplitMix64 generator started at key)
+ *
+ * Work that is split into blocks gets one stream per block rather than per thread,
+ * so that results depend on the seed only and not on the number of threads.
+ */
+inline unsigned long stream_seed(unsigned long key, unsigned long counter) {
+	uint64_t z = (uint64_t)key + ((uint64_t)counter + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (unsigned long)(z ^ (z >> 31));
+}
+
+/**
+ * @brief Counter-based random numbers (Philox4x32-10)
+ *
+ * @param counter four 32-bit words, replaced by four random words
+ * @param key two 32-bit words
+ *
+ * The output depends on counter and key only, so that random numbers can be generated
+ * independently (e.g. in parallel) for any key, without a generator state.
+ */
+inline void philox4x32(uint32_t counter[4], const uint32_t key[2]) {
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int round = 0; round < 10; round++) {
+		uint64_t p0 = (uint64_t)0xD2511F53 * counter[0];
+		uint64_t p1 = (uint64_t)0xCD9E8D57 * counter[2];
+		uint32_t c1 = counter[1], c3 = counter[3];
+		counter[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		counter[1] = (uint32_t)p1;
+		counter[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		counter[3] = (uint32_t)p0;
+		k0 += 0x9E3779B9;
+		k1 += 0xBB67AE85;
+	}
+}
+
+/**
+ * @brief Fast generator of random 64-bit words (xoshiro256++)
+ *
+ * Used where many random bits are needed at once, e.g. for free recombination, which
+ * takes one random bit per locus. The state is seeded by a SplitMix64 stream, hence it is never zero.
+ */
+struct xoshiro256pp_t {
+	uint64_t s[4];
+	xoshiro256pp_t(uint64_t seed_in=0) {seed(seed_in);}
+	void seed(uint64_t seed_in) {for (int k = 0; k < 4; k++) s[k] = stream_seed(seed_in, k);}
+	static uint64_t rotl(uint64_t x, int k) {return (x << k) | (x >> (64 - k));}
+	uint64_t next() {
+		uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+	double uniform() {return (next() >> 11) * (1.0 / 9007199254740992.0);}	//53 random bits in [0, 1)
+};
+
+/**
+ * @brief Selection of the random number generator algorithm
+ *
+ * All simulation classes allocate their GSL generators with the type RNG, which is the backend
+ * selected when they are constructed. Besides GSL's taus2, which is the default, xoshiro256++ and
+ * the counter-based Philox4x32-10 are available as GSL generator types, so that all gsl_ran_*
+ * distributions work with them. The random numbers are drawn in a different order than in
+ * FFPopSim 2.0, so seeded runs do not reproduce its results, whatever the backend.
+ */
+int set_rng_backend(int backend);
+int get_rng_backend();
+const gsl_rng_type *rng_backend_type();
+const gsl_rng_type *rng_backend_type(int backend);
+extern const gsl_rng_type *ffpopsim_rng_xoshiro256pp;
+extern const gsl_rng_type *ffpopsim_rng_philox4x32;
+
+/*
+ * Blocks of random numbers. The generators of this library draw them in tight loops over their
+ * state; any other generator gives the same numbers as the same sequence of gsl_rng_uniform,
+ * gsl_ran_poisson or gsl_ran_binomial calls.
+ */
+void rng_uniform_block(gsl_rng *rng, double *out, size_t n);
+void rng_poisson_block(gsl_rng *rng, const double *means, unsigned int *out, size_t n);
+void rng_binomial_block(gsl_rng *rng, double p, const unsigned int *trials, unsigned int *out, size_t n);
+
+/**
+ * @brief Random numbers from a Poisson distribution conditional on being at least one
+ *
+ * @param rng random number generator
+ * @param mean mean of the Poisson distribution before conditioning
+ *
+ * For small means, the distribution is inverted starting from one; for larger means, zeros are rejected.
+ */
+inline unsigned int zero_truncated_poisson(gsl_rng *rng, double mean) {
+	unsigned int k = 1;
+	if (mean > 1) {
+		do k = gsl_ran_poisson(rng, mean); while (k == 0);
+		return k;
+	}
+	double u = gsl_rng_uniform(rng) * (-expm1(-mean));
+	double p = mean * exp(-mean);
+	while ((u > p) and (p > 0)) {
+		u -= p;
+		k++;
+		p *= mean / k;
+	}
+	return k;
+}
+
+/**
+ * @brief Share of one category in a multinomial sample drawn by sequential conditional binomials
+ *
+ * @param rng random number generator
+ * @param weight weight of the category
+ * @param remaining_weight weight of this and all later categories, reduced by weight on return
+ * @param remaining number of draws not yet assigned, reduced by the share on return
+ * @param last whether this is the last category with nonzero weight
+ *
+ * Calling this for each category in turn draws the whole sample in one pass. The last category
+ * takes all remaining draws, so that rounding in remaining_weight cannot lose any.
+ */
+inline unsigned int conditional_binomial(gsl_rng *rng, double weight, double &remaining_weight, unsigned int &remaining, bool last) {
+	unsigned int n = 0;
+	if (last or (weight >= remaining_weight))
+		n = remaining;
+	else if ((remaining > 0) and (weight > 0))
+		n = gsl_ran_binomial(rng, weight / remaining_weight, remaining);
+	remaining -= n;
+	remaining_weight -= weight;
+	return n;
+}
+
+/**
+ * @brief Walker's alias table for drawing indices with given weights in constant time
+ */
+struct alias_table_t {
+	vector <double> probability;	//probability to keep the index drawn uniformly
+	vector <int> alias;		//index to take otherwise
+	double total;			//sum of the weights
+	alias_table_t() : total(0) {};
+	int set_up(const vector <double> &weights);
+	size_t size() const {return probability.size();}
+	int draw(gsl_rng *rng) const {
+		int i = gsl_rng_uniform_int(rng, probability.size());
+		return (gsl_rng_uniform(rng) < probability[i]) ? i : alias[i];}
+};
+
+/**
+ * @brief Set up the alias table (Vose's method)
+ *
+ * @param weights nonnegative weights, not all zero
+ *
+ * @returns zero if successful, -1 if the weights are invalid
+ */
+inline int alias_table_t::set_up(const vector <double> &weights) {
+	size_t n = weights.size();
+	total = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!(weights[i] >= 0)) return -1;
+		total += weights[i];
+	}
+	if (!(total > 0)) return -1;
+	probability.resize(n);
+	alias.resize(n);
+	vector <int> small, large;
+	for (size_t i = 0; i < n; i++) {
+		probability[i] = weights[i] * n / total;
+		alias[i] = i;
+		if (probability[i] < 1) small.push_back(i);
+		else large.push_back(i);
+	}
+	while (small.size() and large.size()) {
+		int s = small.back(), l = large.back();
+		small.pop_back();
+		alias[s] = l;
+		probability[l] -= 1 - probability[s];
+		if (probability[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	//the rest is one up to rounding errors
+	for (size_t i = 0; i < small.size(); i++) probability[small[i]] = 1;
+	for (size_t i = 0; i < large.size(); i++) probability[large[i]] = 1;
+	return 0;
+}
+
 /**
  * @brief Pairs of an index and a value
  */
@@ -51,13 +51,32 @@ using namespace std;
 struct coeff_t {
 	int order;
 	double value;
-	int *loci;
-	coeff_t(double value_in, vector <int> loci_in){
-		value=value_in;
-		order=loci_in.size();
-		loci=new int [order];
-		for (int i=0; i<order; i++) loci[i]=loci_in[i];
-	}
+	vector <int> loci;
+	coeff_t(double value_in, vector <int> loci_in) : order(loci_in.size()), value(value_in), loci(loci_in) {};
+};
+
+/**
+ * @brief Epistatic trait coefficients, stored flat.
+ *
+ * The loci of term t are loci[offsets[t]] to loci[offsets[t+1]-1] and its value is values[t].
+ * For genotypes packed into 64-bit words, each term is also compiled into (word, mask) pairs,
+ * mask_words[p] and masks[p] for p from mask_offsets[t] to mask_offsets[t+1]-1: the sign of the
+ * term is negative if an odd number of the masked loci are not set.
+ */
+struct epistasis_terms_t {
+	vector <int> offsets;
+	vector <int> loci;
+	vector <double> values;
+	vector <int> mask_offsets;
+	vector <int> mask_words;
+	vector <uint64_t> masks;
+
+	epistasis_terms_t() : offsets(1, 0), mask_offsets(1, 0) {};
+	size_t size() const {return values.size();}
+	int order(size_t t) const {return offsets[t + 1] - offsets[t];}
+	coeff_t get_coefficient(size_t t) const {return coeff_t(values[t], vector <int>(loci.begin() + offsets[t], loci.begin() + offsets[t + 1]));}
+	void add(double value, const vector <int> &term_loci);
+	void clear();
 };
 
 /**
@@ -72,6 +91,45 @@ struct coeff_single_locus_t {
 	coeff_single_locus_t(double value_in, int locus_in) : value(value_in), locus(locus_in) {};
 };
 
+/**
+ * @brief Hash a genotype packed into 64-bit words
+ *
+ * @param genotype packed genotype
+ * @param words number of words
+ *
+ * @returns a hash of the indices and values of the nonzero words
+ *
+ * The hash identifies genotypes in the random part of hypercubes and in the clone index of populations.
+ */
+inline uint64_t hash_genotype(const uint64_t *genotype, size_t words) {
+	uint64_t hash = 0;
+	for (size_t w = 0; w < words; w++)
+		if (genotype[w]) hash = stream_seed(hash ^ genotype[w], w);
+	return hash;
+}
+
+/**
+ * @brief Hash a genotype given as the sorted list of loci that are set
+ *
+ * @param derived_loci sorted list of set loci
+ *
+ * @returns the same hash as for the packed genotype
+ */
+inline uint64_t hash_genotype(const vector<int>& derived_loci) {
+	uint64_t hash = 0, word = 0;
+	int w = -1;
+	for (vector<int>::const_iterator locus = derived_loci.begin(); locus != derived_loci.end(); locus++) {
+		if (((*locus) >> 6) != w) {
+			if (w >= 0) hash = stream_seed(hash ^ word, w);
+			w = (*locus) >> 6;
+			word = 0;
+		}
+		word |= ((uint64_t)1) << ((*locus) & 63);
+	}
+	if (w >= 0) hash = stream_seed(hash ^ word, w);
+	return hash;
+}
+
 /**
  * @brief Hypercube class for high-dimensional simulations.
  *
@@ -100,11 +158,25 @@ private:
 
 	// iterators
 	vector<coeff_single_locus_t>::iterator coefficients_single_locus_iter;
-	vector<coeff_t>::iterator coefficients_epistasis_iter;
 
 	// static array of single locus coefficients (for performance reasons)
 	vector<double> coefficients_single_locus_static;
 
+	// additive coefficients summed by locus and over all loci, for sparse genotypes (rebuilt on demand)
+	vector<double> additive_by_locus;
+	double additive_sum;
+	bool additive_up_to_date;
+	void update_additive();
+
+	// epistatic coefficients, and the terms involving each locus
+	epistasis_terms_t epistasis;
+	vector<vector<int> > epistasis_by_locus;
+
+	// evaluation on any genotype representation
+	template <class genotype_t> void add_epistasis(const genotype_t &genotype, double &result);
+	template <class genotype_t> double get_func_diff_view(const genotype_t &genotype1, const genotype_t &genotype2, vector<int> &diffpos);
+	double random_epistasis(uint64_t genotype_hash);
+
 public:
         // random number generator
 	int rng_offset;
@@ -114,7 +186,6 @@ public:
 	double hypercube_mean;
 	double epistatic_std;
 	vector <coeff_single_locus_t> coefficients_single_locus;
-	vector <coeff_t> coefficients_epistasis;
 
 	// setting up
 	hypercube_highd();
@@ -126,8 +197,20 @@ public:
 	unsigned int get_dim(){return dim;}
 	unsigned int get_seed() {return seed;};
 	double get_func(boost::dynamic_bitset<>& genotype);
+	double get_func(const uint64_t *genotype);
 	double get_additive_coefficient(int locus);
+	vector <coeff_t> get_epistasis();
+	size_t get_number_of_epistatic_terms() {return epistasis.size();}
+	const epistasis_terms_t& get_epistasis_terms() const {return epistasis;}
 	double get_func_diff(boost::dynamic_bitset<>& genotype1, boost::dynamic_bitset<>& genotype2, vector<int> &diffpos);
+	double get_func_diff(const uint64_t *genotype1, const uint64_t *genotype2, vector<int> &diffpos);
+	double get_func(const vector<int>& derived_loci);
+	double get_func_diff(const vector<int>& derived_loci1, const vector<int>& derived_loci2, vector<int> &diffpos);
+
+	// evaluation of several hypercubes on the same genotype, also from several threads once the caches are up to date
+	void update_caches() {if (!additive_up_to_date) update_additive();}
+	static void get_funcs(hypercube_highd *cubes, int n_cubes, const uint64_t *genotype, double *values);
+	static void get_funcs(hypercube_highd *cubes, int n_cubes, const vector<int>& derived_loci, double *values);
 
 	// change the hypercube
 	void reset();
@@ -147,6 +230,26 @@ public:
 #define HP_NOTHING 1e-12
 #define HP_RANDOM_SAMPLE_FRAC 0.01
 #define HP_VERY_NEGATIVE -1e15
+#define HP_WEIGHT_RANGE 64			// distance of fitness_max from the reference of the selection weights before they are rebased
+#define HP_CLONES_PER_BLOCK 1024		// clones sharing a random number stream in parallel loops
+#define HP_CLONES_PER_CHUNK 64			// clones evaluated per task in parallel trait and fitness loops
+#define HP_PAIRS_PER_CHUNK 16			// mating pairs per task in parallel recombination
+
+// Kernels on genotype words are compiled for AVX-512, AVX2 and baseline x86-64, the version
+// matching the processor being picked at load time
+#if defined(__x86_64__) and defined(__linux__) and ((defined(__clang__) and (__clang_major__ >= 14)) or (!defined(__clang__) and defined(__GNUC__) and (__GNUC__ >= 6)))
+#define HP_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define HP_TARGET_CLONES
+#endif
+
+// Genotype representations (see clone_store)
+#define DENSE_GENOTYPES 0
+#define SPARSE_GENOTYPES 1
+
+// Selection models (see haploid_highd::select_gametes)
+#define POISSON_OFFSPRING 0
+#define WRIGHT_FISHER 1
 
 // Error Codes
 #define HP_BADARG -879564
@@ -156,6 +259,7 @@ public:
 #define HP_NOBINSERR 6
 #define HP_WRONGBINSERR 7
 #define HP_RUNTIMEERR 8
+#define HP_IOERR 9
 
 /**
  * @brief clone with a single genotype and a vector of phenotypic traits.
@@ -196,6 +300,201 @@ struct clone_t {
         }
 };
 
+/**
+ * @brief Kernels on packed genotypes.
+ *
+ * The clone store picks at set up a table whose loops are specialized on its number of words,
+ * so that they are fully unrolled and vectorized by the compiler. Genome lengths without a
+ * specialization use a table that loops over the run-time number of words (words == 0).
+ */
+struct genotype_kernels_t {
+	size_t words;
+	void (*recombine)(uint64_t *offspring1, uint64_t *offspring2, const uint64_t *parent1, const uint64_t *parent2, const uint64_t *pattern, size_t words);
+	int (*count)(const uint64_t *genotype, size_t words);
+	int (*distance)(const uint64_t *genotype1, const uint64_t *genotype2, size_t words);
+	int (*compare)(const uint64_t *genotype1, const uint64_t *genotype2, size_t words);
+};
+
+/**
+ * @brief Storage of all clones of a population as a structure of arrays.
+ *
+ * Clone sizes, fitness values and traits live in parallel arrays, together with the selection weight
+ * exp(fitness - reference) of each clone, which the population updates whenever fitness changes
+ * (see haploid_highd::calc_individual_fitness_from_traits). Genotypes have one of two
+ * representations, chosen at set up:
+ * - DENSE_GENOTYPES (default): genotypes are packed into a single, cache-line aligned arena of
+ *   64-bit words, one fixed-stride row per clone. Locus l of clone i is bit l % 64 of word l / 64
+ *   of row i, i.e. the same layout as the blocks of a boost::dynamic_bitset. Bits beyond the last
+ *   locus are always zero.
+ * - SPARSE_GENOTYPES: each genotype is the sorted list of its derived loci (the loci that differ
+ *   from the wildtype 00...0). Memory and copy costs scale with the diversity of the population
+ *   rather than with L, which pays off for very long genomes with few segregating sites.
+ *
+ * Copying, flipping and recombining genotypes work on clone slots in place; in the dense
+ * representation they never allocate, and memory is only touched when the number of clone
+ * slots grows (see resize).
+ */
+class clone_store {
+public:
+	vector <int> clone_size;
+	vector <double> fitness;
+	vector <double> fitness_weight;
+
+	clone_store();
+	virtual ~clone_store();
+	int set_up(int L, int n_traits, int representation_in=DENSE_GENOTYPES);
+	int resize(size_t n);
+	void clear();
+	void swap(clone_store &other);
+
+	size_t size() const {return clone_size.size();}
+	size_t get_words() const {return words;}
+	bool is_fixed_width() const {return kernels->words != 0;}
+	bool is_sparse() const {return representation == SPARSE_GENOTYPES;}
+	int get_representation() const {return representation;}
+	int get_number_of_loci() const {return number_of_loci;}
+	int get_number_of_traits() const {return number_of_traits;}
+
+	// genotypes (the raw rows are only available in the dense representation)
+	uint64_t *genotype(size_t i) {return arena + i * words;}
+	const uint64_t *genotype(size_t i) const {return arena + i * words;}
+	const vector<int>& derived_loci(size_t i) const {return sparse_genotypes[i];}
+	void set_derived_loci(size_t i, const int *first, const int *last) {sparse_genotypes[i].assign(first, last);}
+	bool get_locus(size_t i, int locus) const {
+		if (is_sparse()) return binary_search(sparse_genotypes[i].begin(), sparse_genotypes[i].end(), locus);
+		return (arena[i * words + (locus >> 6)] >> (locus & 63)) & 1;}
+	void flip_locus(size_t i, int locus) {
+		if (is_sparse()) flip_locus_sparse(i, locus);
+		else arena[i * words + (locus >> 6)] ^= ((uint64_t)1) << (locus & 63);}
+	void move_clone(size_t dest, size_t src);
+	void copy_genotype(size_t dest, size_t src) {
+		if (is_sparse()) sparse_genotypes[dest] = sparse_genotypes[src];
+		else memcpy(genotype(dest), genotype(src), words * sizeof(uint64_t));}
+	void set_genotype(size_t i, const boost::dynamic_bitset<> &gt);
+	boost::dynamic_bitset<> get_genotype(size_t i) const;
+	void recombine(size_t offspring1, size_t offspring2, size_t parent1, size_t parent2, const uint64_t *pattern) {
+		if (is_sparse()) recombine_sparse(offspring1, offspring2, parent1, parent2, pattern, NULL);
+		else kernels->recombine(genotype(offspring1), genotype(offspring2), genotype(parent1), genotype(parent2), pattern, words);}
+	void recombine_crossovers(size_t offspring1, size_t offspring2, size_t parent1, size_t parent2, const vector<int> &crossover_points);
+	void crossover_mask(const vector<int> &crossover_points, uint64_t *pattern) const;
+	bool reproduces_parents(size_t parent1, size_t parent2, const uint64_t *pattern) const;
+	bool reproduces_parents_crossovers(size_t parent1, size_t parent2, const vector<int> &crossover_points) const {
+		if (is_sparse()) return reproduces_parents_sparse(parent1, parent2, NULL, &crossover_points);
+		vector<uint64_t> pattern(words);
+		crossover_mask(crossover_points, &pattern[0]);
+		return reproduces_parents(parent1, parent2, &pattern[0]);}
+	int count(size_t i) const {
+		if (is_sparse()) return sparse_genotypes[i].size();
+		return kernels->count(genotype(i), words);}
+	int distance(size_t i, size_t j) const;
+	int compare_genotypes(size_t i, size_t j) const;
+	uint64_t hash_genotype(size_t i) const {
+		if (is_sparse()) return ::hash_genotype(sparse_genotypes[i]);
+		return ::hash_genotype(genotype(i), words);}
+	void add_allele_counts(size_t i, double weight, double *counts) const;
+	void add_allele_counts(size_t i, int weight, int *counts) const;
+	void count_alleles(size_t end, int *counts) const;
+
+	// traits
+	double *trait(size_t i) {return &traits[i * number_of_traits];}
+	const double *trait(size_t i) const {return &traits[i * number_of_traits];}
+
+	// materialize a single clone
+	clone_t get_clone(size_t i) const;
+
+	// kernels and allele counts for packed genotypes stored elsewhere in the same layout (e.g. in a mapped checkpoint)
+	static const genotype_kernels_t *get_kernels(size_t words);
+	static void count_packed_alleles(const uint64_t *rows, size_t words, const int *weights, size_t end, int *counts);
+
+private:
+	int number_of_loci;
+	int number_of_traits;
+	int representation;
+	size_t words;				// 64-bit words per genotype (row stride)
+	size_t capacity;			// rows allocated in the arena
+	uint64_t *arena;
+	const genotype_kernels_t *kernels;
+	vector <vector <int> > sparse_genotypes;
+	vector <double> traits;
+
+	void flip_locus_sparse(size_t i, int locus);
+	template <class count_t> void add_counts(size_t i, count_t weight, count_t *counts) const;
+	void recombine_sparse(size_t offspring1, size_t offspring2, size_t parent1, size_t parent2, const uint64_t *pattern, const vector<int> *crossover_points);
+	bool reproduces_parents_sparse(size_t parent1, size_t parent2, const uint64_t *pattern, const vector<int> *crossover_points) const;
+
+	// the arena is owned, copies are not allowed
+	clone_store(const clone_store &other);
+	clone_store& operator=(const clone_store &other);
+};
+
+/**
+ * @brief Hash table from genotypes to the clones carrying them.
+ *
+ * Open addressing with linear probing on the genotype hash. Entries are never removed: entries of
+ * clones that have died are skipped on lookup and overwritten by later insertions, and the table is
+ * rebuilt from the nonempty clones when it is half full, dropping dead entries. A clone slot that gets a new genotype
+ * must be inserted again before it is nonempty.
+ */
+struct clone_index_t {
+	vector <int> slots;			// clone of each slot, -1 if the slot is empty
+	vector <uint64_t> hashes;		// genotype hash of each clone
+	size_t used;				// nonempty slots
+	bool up_to_date;
+
+	clone_index_t() : used(0), up_to_date(false) {};
+	void clear() {slots.clear(); hashes.clear(); used = 0; up_to_date = false;}
+	void rebuild(const clone_store &population, size_t end);
+	int find(const clone_store &population, size_t clone, uint64_t hash) const;
+	void insert(const clone_store &population, size_t clone, uint64_t hash);
+
+private:
+	void rehash(const clone_store &population);
+};
+
+/**
+ * @brief Allocator of free clone slots, handing out the lowest free index first.
+ *
+ * A bitmap marks the free slots, and a summary bitmap marks the words of the bitmap that have
+ * any free slot, so that the lowest free slot is found with two find-first-set operations after
+ * skipping empty summary words. Releasing a slot that is already free has no effect.
+ */
+struct free_slots_t {
+	vector <uint64_t> bits;			// bit i is set if slot i is free
+	vector <uint64_t> summary;		// bit w is set if word w of bits is nonzero
+	size_t n_free;
+	size_t first_summary;			// the summary words before this one are zero
+
+	free_slots_t() : n_free(0), first_summary(0) {};
+	size_t size() const {return n_free;}
+	void clear() {bits.clear(); summary.clear(); n_free = 0; first_summary = 0;}
+	bool is_free(size_t i) const {return ((i >> 6) < bits.size()) and ((bits[i >> 6] >> (i & 63)) & 1);}
+	void release(size_t i) {
+		const size_t w = i >> 6;
+		if (w >= bits.size()) {
+			bits.resize(w + 1, 0);
+			summary.resize((bits.size() + 63) >> 6, 0);
+		}
+		const uint64_t bit = ((uint64_t)1) << (i & 63);
+		if (bits[w] & bit) return;
+		bits[w] |= bit;
+		summary[w >> 6] |= ((uint64_t)1) << (w & 63);
+		n_free++;
+		first_summary = min(first_summary, w >> 6);
+	}
+	int acquire() {
+		for (; first_summary < summary.size(); first_summary++)
+			if (summary[first_summary]) {
+				const size_t w = (first_summary << 6) + __builtin_ctzll(summary[first_summary]);
+				const size_t i = (w << 6) + __builtin_ctzll(bits[w]);
+				bits[w] &= bits[w] - 1;
+				if (!bits[w]) summary[first_summary] &= ~(((uint64_t)1) << (w & 63));
+				n_free--;
+				return i;
+			}
+		return -1;
+	}
+};
+
 
 /*
  *	@brief a class that implements a rooted tree to store genealogies
@@ -309,6 +608,7 @@ public:
 	int add_terminal_node(node_t &newNode);
 	tree_key_t erase_edge_node(tree_key_t to_be_erased);
 	tree_key_t bridge_edge_node(tree_key_t to_be_bridged);
+	int rename_leaf(tree_key_t old_key, tree_key_t new_key);
 	int external_branch_length();
 	int total_branch_length();
 	int ancestors_at_age(int age, tree_key_t subtree_root, vector <tree_key_t> &ancestors);
@@ -371,6 +671,286 @@ public:
 #endif /* MULTILOCUSGENEALOGY_H_ */
 
 
+/*
+ * Checkpoints: versioned binary files with the complete state of a population (see haploid_highd::write_checkpoint).
+ *
+ * A checkpoint_header_t and a table of checkpoint_section_t are followed by the sections, each of them a flat
+ * array of fixed-size elements that starts at a multiple of HP_CHECKPOINT_ALIGNMENT bytes, so that it can be used
+ * in place once the file is mapped into memory. Numbers are stored in the byte order of the machine that wrote
+ * the file, which is recorded in the header. Readers skip sections they do not know; the version is increased
+ * whenever the meaning of an existing section changes.
+ */
+#define HP_CHECKPOINT_MAGIC "FFPSCKPT"
+#define HP_CHECKPOINT_VERSION 1
+#define HP_CHECKPOINT_BYTE_ORDER 0x01020304
+#define HP_CHECKPOINT_ALIGNMENT 64
+
+// Sections of checkpoints
+#define CKPT_PARAMETERS 1		// checkpoint_parameters_t, a single one
+#define CKPT_CLONE_SIZES 2		// int32_t, one per clone slot (including empty slots)
+#define CKPT_FITNESS 3			// double, one per clone slot
+#define CKPT_TRAITS 4			// double, number_of_traits per clone slot
+#define CKPT_GENOTYPE_WORDS 5		// uint64_t, (L + 63) / 64 per clone slot, laid out as in clone_store (dense genotypes)
+#define CKPT_DERIVED_LOCI_OFFSETS 6	// uint64_t, one per clone slot plus one (sparse genotypes)
+#define CKPT_DERIVED_LOCI 7		// int32_t, the derived loci of all clone slots (sparse genotypes)
+#define CKPT_TRAIT_WEIGHTS 8		// double, one per trait
+#define CKPT_TRAIT_PARAMETERS 9		// checkpoint_trait_t, one per trait
+#define CKPT_ADDITIVE 10		// checkpoint_additive_t, in the order in which they were added
+#define CKPT_EPISTASIS 11		// checkpoint_epistasis_t, in the order in which they were added
+#define CKPT_EPISTASIS_LOCI 12		// int32_t, the loci of all epistatic terms
+#define CKPT_MUTATION_RATES 13		// double, one per locus, or none if all rates are equal
+#define CKPT_ANCESTRAL_STATE 14		// int32_t, one per locus
+#define CKPT_POLYMORPHISM 15		// checkpoint_poly_t
+#define CKPT_FIXED_MUTATIONS 16		// checkpoint_poly_t
+#define CKPT_NUMBER_OF_MUTATIONS 17	// int32_t
+#define CKPT_RNG_STATE 18		// bytes of the state of the random number generator
+#define CKPT_EXTRA 19			// double, state of subclasses (see haploid_highd::get_checkpoint_extra)
+#define CKPT_GENEALOGY_LOCI 20		// int32_t, the loci whose genealogy is tracked
+#define CKPT_TREES 21			// checkpoint_tree_t, one per tracked locus
+#define CKPT_TREE_NODES 22		// checkpoint_node_t, for each locus the nodes of the tree and then its new generation
+#define CKPT_TREE_CHILDREN 23		// tree_key_t, the child edges of all nodes
+#define CKPT_TREE_STEPS 24		// step_t, the weight distributions of all nodes
+#define CKPT_TREE_EDGES 25		// checkpoint_edge_t, for each locus the edges of the tree
+#define CKPT_TREE_LEAFS 26		// tree_key_t, for each locus the leafs of the tree
+
+struct checkpoint_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t number_of_sections;
+};
+
+struct checkpoint_section_t {
+	uint32_t id;
+	uint32_t element_size;
+	uint64_t offset;			// from the start of the file
+	uint64_t count;				// number of elements
+};
+
+struct checkpoint_parameters_t {
+	int32_t number_of_loci;
+	int32_t number_of_traits;
+	int32_t genotype_representation;
+	int32_t number_of_slots;		// clone slots, including the empty ones
+	int32_t last_clone;
+	int32_t population_size;
+	int32_t number_of_clones;
+	int32_t generation;
+	int32_t carrying_capacity;
+	int32_t recombination_model;
+	int32_t selection_model;
+	int32_t circular;
+	int32_t all_polymorphic;
+	int32_t clone_deduplication;
+	int32_t seed;
+	int32_t unused;
+	double outcrossing_rate;
+	double crossover_rate;
+	double growth_rate;
+	double min_occupancy;
+	double mutation_rate;
+	double fitness_max;
+	double weight_reference;
+	double logmean_expfitness;
+	double participation_ratio;
+	double fitness_mean;
+	double fitness_variance;
+	char rng_type[32];			// name of the GSL generator type
+};
+
+struct checkpoint_trait_t {
+	uint32_t seed;
+	int32_t rng_offset;
+	double hypercube_mean;
+	double epistatic_std;
+};
+
+struct checkpoint_additive_t {
+	int32_t trait;
+	int32_t locus;
+	double value;
+};
+
+struct checkpoint_epistasis_t {
+	int32_t trait;
+	int32_t order;				// number of loci of the term
+	double value;
+};
+
+struct checkpoint_poly_t {
+	int32_t birth;
+	int32_t sweep_time;
+	double effect;
+	double fitness;
+	double fitness_variance;
+};
+
+struct checkpoint_tree_t {
+	tree_key_t root;
+	tree_key_t MRCA;
+	int32_t nodes;
+	int32_t edges;
+	int32_t leafs;
+	int32_t new_generation;			// nodes of the new generation
+};
+
+struct checkpoint_node_t {
+	tree_key_t own_key;
+	tree_key_t parent_node;
+	int32_t number_of_offspring;
+	int32_t clone_size;
+	int32_t crossover[2];
+	int32_t children;			// number of child edges
+	int32_t steps;				// length of the weight distribution
+	double fitness;
+};
+
+struct checkpoint_edge_t {
+	tree_key_t own_key;
+	tree_key_t parent_node;
+	int32_t segment[2];
+	int32_t length;
+	int32_t number_of_offspring;
+};
+
+/**
+ * @brief Read-only memory map of a checkpoint.
+ *
+ * The file is checked when it is opened: the header must match this version and byte order, and all
+ * sections must lie within the file. The sections are then accessed in place, without copying.
+ */
+class mapped_checkpoint {
+public:
+	mapped_checkpoint();
+	virtual ~mapped_checkpoint();
+	int open(const char *filename);
+	void close();
+	bool is_open() const {return data != NULL;}
+
+	// pointer to the elements of a section and their number, NULL if the section is missing
+	template <class T> const T *section(uint32_t id, size_t &count) const {return (const T *)find_section(id, sizeof(T), count);}
+	const checkpoint_parameters_t *get_parameters() const;
+
+private:
+	char *data;
+	size_t length;
+	const checkpoint_section_t *sections;
+	size_t number_of_sections;
+	const void *find_section(uint32_t id, size_t element_size, size_t &count) const;
+
+	// the map is owned, copies are not allowed
+	mapped_checkpoint(const mapped_checkpoint &other);
+	mapped_checkpoint& operator=(const mapped_checkpoint &other);
+};
+
+/**
+ * @brief Read-only view of a population saved in a checkpoint.
+ *
+ * The view maps a checkpoint written by haploid_highd::write_checkpoint and works on its clone sizes,
+ * fitness values, traits and genotypes in place: nothing is copied into a population and the fitness
+ * landscape is not evaluated again. Fitness and traits are the values cached when the checkpoint was
+ * written. Statistics, random samples and histograms follow those of haploid_highd; samples are drawn
+ * from a generator owned by the view, so the analysis never touches the saved state of the population.
+ */
+class population_view {
+public:
+	population_view(int rng_seed=0);
+	virtual ~population_view();
+	int open(const char *filename);
+	void close();
+	bool is_open() const {return file.is_open();}
+
+	// population parameters (read only)
+	int L() const {return number_of_loci;}
+	int get_number_of_loci() const {return number_of_loci;}
+	int N() const {return population_size;}
+	int get_population_size() const {return population_size;}
+	int get_generation() const {return generation;}
+	int get_number_of_clones() const {return number_of_clones;}
+	int get_number_of_traits() const {return number_of_traits;}
+	int get_genotype_representation() const {return representation;}
+	int get_number_of_slots() const {return number_of_slots;}	// clone slots up to the last clone
+	double get_participation_ratio() const {return participation_ratio;}
+
+	// clones in place (one entry per clone slot, empty slots have size zero)
+	const int32_t *get_clone_sizes() const {return clone_sizes;}
+	const double *get_fitnesses() const {return fitness;}
+	const double *get_traits() const {return traits;}
+	const uint64_t *get_genotype_words(int n) const {return genotype_words ? genotype_words + n * words : NULL;}
+	int get_clone_size(int n) const {return clone_sizes[n];}
+	double get_fitness(int n) const {return fitness[n];}
+	double get_trait(int n, int t=0) const {return traits[n * number_of_traits + t];}
+	bool get_locus(int n, int locus) const;
+	boost::dynamic_bitset<> get_genotype(int n) const;
+	string get_genotype_string(int n) const {string gts; boost::to_string(get_genotype(n), gts); return gts;}
+	vector <int> get_nonempty_clones() const;
+
+	// allele frequencies
+	double get_allele_frequency(int l) {if (!allele_frequencies_up_to_date) {calc_allele_freqs();} return allele_frequencies[l];}
+	double get_derived_allele_frequency(int l) {if (ancestral_state and ancestral_state[l]) {return 1.0-get_allele_frequency(l);} else {return get_allele_frequency(l);}}
+	vector <double> get_allele_frequencies() {if (!allele_frequencies_up_to_date) {calc_allele_freqs();} return allele_frequencies;}
+
+	// statistics
+	stat_t get_fitness_statistics() {if (!clone_stat_up_to_date) {calc_clone_stat();} return fitness_stat;}
+	stat_t get_trait_statistics(int t=0) {if (!clone_stat_up_to_date) {calc_clone_stat();} return trait_stat[t];}
+	int random_clone();
+	int random_clones(unsigned int n_o_individuals, vector <int> *sample, bool replacement=true);
+	int distance_Hamming(unsigned int clone1, unsigned int clone2) const;
+	stat_t get_diversity_statistics(unsigned int n_sample=1000);
+	stat_t get_divergence_statistics(unsigned int n_sample=1000);
+
+	// histograms
+	int get_divergence_histogram(gsl_histogram **hist, unsigned int bins=10, unsigned int n_sample=1000);
+	int get_diversity_histogram(gsl_histogram **hist, unsigned int bins=10, unsigned int n_sample=1000);
+	int get_fitness_histogram(gsl_histogram **hist, unsigned int bins=10, unsigned int n_sample=1000);
+
+private:
+	mapped_checkpoint file;
+	gsl_rng *rng;
+	int seed;
+
+	// parameters
+	int number_of_loci;
+	int number_of_traits;
+	int representation;
+	int number_of_slots;
+	int number_of_clones;
+	int population_size;
+	int generation;
+	double participation_ratio;
+
+	// sections of the file
+	const int32_t *clone_sizes;
+	const double *fitness;
+	const double *traits;
+	const uint64_t *genotype_words;		// dense genotypes
+	const uint64_t *loci_offsets;		// sparse genotypes
+	const int32_t *derived_loci;
+	const int32_t *ancestral_state;
+	size_t words;
+	const genotype_kernels_t *kernels;
+
+	// derived quantities, calculated on demand
+	vector <double> allele_frequencies;
+	bool allele_frequencies_up_to_date;
+	void calc_allele_freqs();
+	stat_t fitness_stat;
+	vector <stat_t> trait_stat;
+	bool clone_stat_up_to_date;
+	void calc_clone_stat();
+	vector <int> sampler_clones;
+	alias_table_t clone_sampler;
+	bool clone_sampler_up_to_date;
+	int update_clone_sampler();
+	int count(int n) const;
+	static int distance_histogram(gsl_histogram **hist, unsigned int bins, const unsigned int *divs, unsigned int n_sample);
+
+	// the view owns the map, copies are not allowed
+	population_view(const population_view &other);
+	population_view& operator=(const population_view &other);
+};
+
+
 /**
  * @brief Population class for high-dimensional simulations.
  *
@@ -394,15 +974,17 @@ public:
 	virtual ~haploid_highd();
 
         // the population
-	vector <clone_t> population;
+	clone_store population;
 
 	// population parameters (read/write)
 	int carrying_capacity;			// carrying capacity of the environment (pop size)
 	double outcrossing_rate;		// probability of having sex
 	double crossover_rate;			// rate of crossover during sex
 	int recombination_model;		//model of recombination to be used
+	int selection_model;			//model of selection: Poisson offspring numbers or exactly carrying_capacity offspring
 	bool circular;				//topology of the chromosome
 	double growth_rate;			//growth rate for bottlenecks and the like
+	double min_occupancy;			//clones are compacted after a generation if fewer slots up to last_clone are occupied (0: never)
 
         // mutation rate (only if not all_polymorphic)
         double get_mutation_rate(){return mutation_rate;}
@@ -410,7 +992,9 @@ public:
         if(all_polymorphic){
                 if(HP_VERBOSE) cerr<<"Cannot set the mutation rate with all_polymorphic."<<endl;
                 throw HP_BADARG;
-        } else mutation_rate=m;}
+        } else {mutation_rate=m; mutation_rate_map.clear();}}
+	int set_mutation_rates(vector <double> rates);
+	vector <double> get_mutation_rates();
 
         // pseudo-infinite site model
         bool is_all_polymorphic(){return all_polymorphic;}
@@ -427,7 +1011,7 @@ public:
 	void set_generation(int g){generation = g;}
 	int get_number_of_clones(){return number_of_clones;}
 	int get_number_of_traits(){return number_of_traits;}
-	double get_participation_ratio(){return participation_ratio;}
+	double get_participation_ratio(){calc_participation_ratio(); return participation_ratio;}
 
 	// initialization
 	int set_allele_frequencies(double* frequencies, unsigned long N);
@@ -435,6 +1019,10 @@ public:
 	int set_genotypes(vector <genotype_value_pair_t> gt);
 	int set_wildtype(unsigned long N);
 	int track_locus_genealogy(vector <int> loci);
+	int set_genotype_representation(int representation);
+	int get_genotype_representation() {return population.get_representation();}
+	int set_clone_deduplication(bool deduplicate);
+	bool get_clone_deduplication() {return clone_deduplication;}
 
 	// modify population
 	void add_genotype(boost::dynamic_bitset<> genotype, int n=1);
@@ -458,6 +1046,7 @@ public:
 	// update traits and fitness and calculate statistics
 	void calc_stat();
 	void unique_clones();
+	void compact_clones();
         vector <int> get_nonempty_clones();
 
 	// readout
@@ -467,11 +1056,11 @@ public:
 
 	// random clones
 	int random_clone();
-	int random_clones(unsigned int n_o_individuals, vector <int> *sample);
+	int random_clones(unsigned int n_o_individuals, vector <int> *sample, bool replacement=true);
 
 	// genotype readout
-	string get_genotype_string(unsigned int i){string gts; boost::to_string(population[i].genotype, gts); return gts;}
-	int distance_Hamming(unsigned int clone1, unsigned int clone2, vector <unsigned int *> *chunks=NULL, unsigned int every=1){return distance_Hamming(population[clone1].genotype, population[clone2].genotype, chunks, every);}
+	string get_genotype_string(unsigned int i){string gts; boost::to_string(population.get_genotype(i), gts); return gts;}
+	int distance_Hamming(unsigned int clone1, unsigned int clone2, vector <unsigned int *> *chunks=NULL, unsigned int every=1);
 	int distance_Hamming(boost::dynamic_bitset<> gt1, boost::dynamic_bitset<> gt2, vector<unsigned int *> *chunks=NULL, unsigned int every=1);
 	stat_t get_diversity_statistics(unsigned int n_sample=1000);
 	stat_t get_divergence_statistics(unsigned int n_sample=1000);
@@ -480,6 +1069,7 @@ public:
 	double get_allele_frequency(int l) {if (!allele_frequencies_up_to_date){calc_allele_freqs();} return allele_frequencies[l];}
 	double get_derived_allele_frequency(int l) {if (ancestral_state[l]) {return 1.0-get_allele_frequency(l);} else {return get_allele_frequency(l);}}
 	bool get_ancestral_state(int l) {return ancestral_state[l];}
+	int check_allele_counts();
 
 	double get_pair_frequency(int locus1, int locus2);
 	vector <double> get_pair_frequencies(vector < vector <int> > *loci);
@@ -492,16 +1082,18 @@ public:
 	// fitness/phenotype readout
 	void set_trait_weights(double *weights){for(int t=0; t<number_of_traits; t++) trait_weights[t] = weights[t];}
 	double get_trait_weight(int t){return trait_weights[t];}
-	double get_fitness(int n) {calc_individual_fitness(population[n]); return population[n].fitness;}
-	int get_clone_size(int n) {return population[n].clone_size;}
-	double get_trait(int n, int t=0) {calc_individual_traits(population[n]); return population[n].trait[t];}
-	vector<coeff_t> get_trait_epistasis(int t=0){return trait[t].coefficients_epistasis;}
+	double get_fitness(int n) {calc_individual_fitness(n); return population.fitness[n];}
+	int get_clone_size(int n) {return population.clone_size[n];}
+	double get_trait(int n, int t=0) {calc_individual_traits(n); return population.trait(n)[t];}
+	vector<coeff_t> get_trait_epistasis(int t=0){return trait[t].get_epistasis();}
 	stat_t get_fitness_statistics() {update_fitness(); calc_fitness_stat(); return fitness_stat;}
 	stat_t get_trait_statistics(int t=0) {calc_trait_stat(); return trait_stat[t];}
 	double get_trait_covariance(int t1, int t2) {calc_trait_stat(); return trait_covariance[t1][t2];}
 	double get_max_fitness() {return fitness_max;}
 	void update_traits();
 	void update_fitness();
+	void update_traits_and_fitness(int first_clone=0, int end_clone=-1);
+	int calc_traits_and_fitness(const vector <boost::dynamic_bitset<> > &genotypes, vector <double> &traits, vector <double> &fitness);
 
 	// histograms
 	int get_divergence_histogram(gsl_histogram **hist, unsigned int bins=10, vector <unsigned int *> *chunks=NULL, unsigned int every=1, unsigned int n_sample=1000);
@@ -513,6 +1105,10 @@ public:
 	int read_ms_sample(istream &gts, int skip_locus, int multiplicity);
 	int read_ms_sample_sparse(istream &gts, int skip_locus, int multiplicity, int distance);
 
+	// checkpoints
+	int write_checkpoint(const char *filename);
+	int read_checkpoint(const char *filename);
+
         // genealogy
 	multi_locus_genealogy genealogy;
 
@@ -522,8 +1118,12 @@ protected:
 	gsl_rng* label_generator;
 	int seed;
 	int get_random_seed();
-	vector <int> random_sample;
-	void produce_random_sample(int size=1000);
+
+	// sampling of random individuals, from an alias table rebuilt lazily after the clone sizes change
+	alias_table_t clone_sampler;
+	vector <int> sampler_clones;		// clone of each entry of the alias table
+	bool clone_sampler_up_to_date;
+	int update_clone_sampler();
 
 	// population parameters
 	int number_of_loci;
@@ -531,13 +1131,15 @@ protected:
 	int number_of_traits;
 	int generation;
 	int number_of_clones;
-	double mutation_rate;			// rate of mutation per locus per generation
+	double mutation_rate;			// rate of mutation per locus per generation (mean over the loci)
+	vector <double> mutation_rate_map;	// rates of mutation of each locus, empty if all are equal
+	alias_table_t mutation_loci;		// draws the loci to mutate according to mutation_rate_map
 
 	// evolution
 	int mutate();
 	int select_gametes();
 	double relaxation_value();
-	double get_logmean_expfitness();	// Log of the population exp-average of the fitness: log[<exp(F)>_{population}]
+	double get_logmean_expfitness() {calc_clone_stat(false); return logmean_expfitness;}
 	
 	unsigned int flip_single_locus(unsigned int clonenum, int locus);
 	void shuffle_genotypes();
@@ -549,8 +1151,17 @@ protected:
 	int provide_at_least(int n);
 	int last_clone;
 
+	// merging of identical clones as they arise (not while the genealogy is tracked)
+	bool clone_deduplication;
+	clone_index_t clone_index;
+	bool deduplicating() {return clone_deduplication and !track_genealogy;}
+	int find_duplicate_clone(int new_clone);
+	bool leaf_in_use(int clone);
+
 	// allele_frequencies
 	bool allele_frequencies_up_to_date;
+	bool allele_counts_up_to_date;		// once built, the allele counts are updated along with the clone sizes
+	vector <int> allele_counts;
 	double *allele_frequencies;
 	double *gamete_allele_frequencies;
 	double *chi1;				//symmetric allele frequencies
@@ -561,16 +1172,21 @@ protected:
 	vector <poly_t> fixed_mutations;	//vector to store all fixed mutations
 	vector <int> number_of_mutations;	//vector to store the number of mutations introduced each generation
 	void calc_allele_freqs();
+	void calc_participation_ratio();
+	void count_alleles(vector <int> &counts);
+	void update_allele_counts(int clonenum, int delta) {if (allele_counts_up_to_date and delta) population.add_allele_counts(clonenum, delta, &allele_counts[0]);}
 
 	// recombination details
 	double outcrossing_rate_effective;
 	int *genome;				//Auxiliary array holding the positions along the genome
 	int *crossovers;
-	void reassortment_pattern();
-	void crossover_pattern();
+	void reassortment_pattern(xoshiro256pp_t &rng, uint64_t *pattern) const;
+	void draw_crossover_points(gsl_rng *rng, vector <int> &crossover_points) const;
+	int pattern_bit(const uint64_t *pattern, int locus) const {return (locus < number_of_loci) ? (pattern[locus >> 6] >> (locus & 63)) & 1 : 0;}
 	vector <int> sex_gametes;		//array holding the indices of gametes
 	int add_recombinants();
-	int recombine(int parent1, int parent2);
+	void add_offspring_to_parent(int parent);
+	void unpaired_gamete(int parent);
 	int recombine_crossover(int parent1, int parent2, int ng);
 
 	// fitness and traits
@@ -578,22 +1194,32 @@ protected:
 	stat_t fitness_stat;
 	stat_t *trait_stat;
 	double **trait_covariance;
-	void calc_fitness_stat();
-	void calc_trait_stat();
-	void calc_individual_traits(clone_t &tempgt);
-	void calc_individual_fitness(clone_t &tempgt);
-	void calc_individual_traits(int clonenum){calc_individual_traits(population[clonenum]);}
-	void calc_individual_fitness(int clonenum){calc_individual_fitness(population[clonenum]);}
-	void check_individual_maximal_fitness(clone_t &tempgt){fitness_max = fmax(fitness_max, tempgt.fitness);}
-	double get_trait_difference(clone_t &tempgt1, clone_t &tempgt2, vector<int>& diffpos, int traitnum);
+	double weight_reference;		// the selection weights of the clones are exp(fitness - weight_reference)
+	double logmean_expfitness;		// log of the population exp-average of the fitness relative to fitness_max: log[<exp(F-F_max)>]
+	bool rebase_fitness_weights();
+	void calc_clone_stat(bool traits);
+	void calc_fitness_stat() {calc_clone_stat(false);}
+	void calc_trait_stat() {calc_clone_stat(true);}
+	void calc_individual_traits(int clonenum);
+	void calc_individual_fitness(int clonenum);
+	double evaluate_clones(int first_clone, int end_clone, bool traits, bool fitness);
+	void check_individual_maximal_fitness(int clonenum){fitness_max = fmax(fitness_max, population.fitness[clonenum]);}
+	double get_trait_difference(int clonenum1, int clonenum2, vector<int>& diffpos, int traitnum);
 
 	// phenotype-fitness map. By default, a linear map with equal weights is set, but weights can be reset
 	double *trait_weights;
-	virtual void calc_individual_fitness_from_traits(clone_t &tempgt);
-	virtual void calc_individual_fitness_from_traits(int clonenum) {calc_individual_fitness_from_traits(population[clonenum]);}
+	virtual double calc_fitness_from_traits(const double *traits);
+	void calc_individual_fitness_from_traits(int clonenum) {
+		population.fitness[clonenum] = calc_fitness_from_traits(population.trait(clonenum));
+		population.fitness_weight[clonenum] = exp(population.fitness[clonenum] - weight_reference);
+	}
 	void add_clone_to_genealogy(int locus, int dest, int parent, int left, int right, int cs, int n);
 	bool track_genealogy;
 
+	// state of subclasses saved in checkpoints
+	virtual void get_checkpoint_extra(vector <double> &values) {values.clear();}
+	virtual int set_checkpoint_extra(const vector <double> &values) {return values.size() ? HP_BADARG : 0;}
+
 private:
 	// Memory management is private, subclasses must take care only of their own memory
 	bool mem;
@@ -601,12 +1227,10 @@ private:
 	int allocate_mem();
 	int free_mem();
 
-	// These two vectors are used to recycle dead clones
-	vector <int> available_clones;
+	// Dead clones are recycled, the lowest free slots first. Clones needed for recombination are freed after mating
+	free_slots_t available_clones;
 	vector <int> clones_needed_for_recombination;
 
-	boost::dynamic_bitset<> rec_pattern;
-
 	// counting reference
 	static size_t number_of_instances;
 };
@@ -73,9 +73,17 @@ haploid_highd::haploid_highd(int L_in, int rng_seed, int n_o_traits, bool all_po
 	outcrossing_rate = 0;
 	crossover_rate = 0;
 	recombination_model = CROSSOVERS;
+	selection_model = POISSON_OFFSPRING;
 	fitness_max = HP_VERY_NEGATIVE;
+	weight_reference = 0;
+	logmean_expfitness = 0;
 	all_polymorphic=all_polymorphic_in;
+	allele_counts_up_to_date = false;
+	clone_deduplication = false;
+	clone_sampler_up_to_date = false;
+	track_genealogy = false;
 	growth_rate = 2.0;
+	min_occupancy = 0;
 
 	//In case no seed is provided, get one from the OS
 	seed = rng_seed ? rng_seed : get_random_seed();
@@ -137,9 +145,15 @@ int haploid_highd::allocate_mem() {
 	genome = new int [number_of_loci+1];					// aux array holding range(0,number_of_loci) used to draw crossover points
 	for (int i = 0; i < number_of_loci; i++) genome[i] = i;
 	crossovers= new int [number_of_loci];					// aux array holding crossover points
-	rec_pattern.resize(number_of_loci, 0);
+
+	// clone storage
+	int err = population.set_up(number_of_loci, number_of_traits);
+	if (err) return err;
 
 	if (HP_VERBOSE) cerr <<"allele frequencies...";
+	allele_counts.assign(number_of_loci, 0);
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
 	allele_frequencies = new double [number_of_loci];
 	gamete_allele_frequencies = new double [number_of_loci];		//allele frequencies after selection
 
@@ -186,23 +200,16 @@ int haploid_highd::free_mem() {
 int haploid_highd::provide_at_least(int n) {
 	//calculate the number of clones that need to be newly allocated. Allow for some slack
 	//to avoid calling this too often
-	int needed_gts = n - available_clones.size() + 100 + 0.1 * population.size();
+	int needed_gts = n - (int)available_clones.size() + 100 + 0.1 * population.size();
 
 	//allocate at the necessary memory
 	if (needed_gts > 50) {
 		if (HP_VERBOSE) {cerr <<"haploid_highd::provide_at_least() requested: "<<n<<" providing: "<<needed_gts<<" total number of clones prev. allocated: "<<population.size()<< " number of clones available prev.: "<<available_clones.size()<<endl;}
-		population.reserve(population.size()+needed_gts);
-
-		//dummy clone used to push into the population
-		clone_t tempgt(number_of_traits);
-		tempgt.genotype.resize(number_of_loci,0);
-		tempgt.clone_size=0;
-		for (int ii = 0; ii < needed_gts; ii++) {
-			available_clones.push_back(population.size());
-			population.push_back(tempgt);
-		}
-		available_clones.reserve(population.size());
-		sort(available_clones.begin(), available_clones.end(), std::greater<int>());
+		//new slots are empty wildtype clones
+		size_t old_size = population.size();
+		if (population.resize(old_size + needed_gts)) throw (int)HP_MEMERR;
+		for (size_t ii = old_size; ii < population.size(); ii++)
+			available_clones.release(ii);
 		if (track_genealogy){
 			genealogy.extend_storage(population.size());
 		}
@@ -239,6 +246,8 @@ int haploid_highd::set_allele_frequencies(double* freq, unsigned long N_in) {
 
 	// reset the current population
 	population.clear();
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
 	available_clones.clear();
 	if (track_genealogy) {
 		genealogy.reset_but_loci();
@@ -250,7 +259,7 @@ int haploid_highd::set_allele_frequencies(double* freq, unsigned long N_in) {
 	provide_at_least(N_in);
         // set the allele frequencies
 	boost::dynamic_bitset<> tempgt(number_of_loci);
-	random_sample.clear();	//and the random sample
+	clone_sampler_up_to_date = false;	//and the sampler of random individuals
 	if (HP_VERBOSE) cerr <<"add "<<N_in<<" genotypes of length "<<number_of_loci<<"..."<<endl;
 	for (size_t i = 0; i < N_in; i++) {
 		tempgt.reset();
@@ -314,13 +323,15 @@ int haploid_highd::set_genotypes_and_ancestral_state(vector <genotype_value_pair
 
 	// Clear population
 	population.clear();
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
 	available_clones.clear();
 	if (track_genealogy) {
 		genealogy.reset_but_loci();
 	}
 
 	population_size = 0;
-	random_sample.clear();
+	clone_sampler_up_to_date = false;
 
 	// Initialize the clones and calculate the population size
 	population_size = 0;
@@ -378,6 +389,8 @@ int haploid_highd::set_wildtype(unsigned long N_in) {
 
 	// Clear population
 	population.clear();
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
 	available_clones.clear();
 	if (track_genealogy) {
 		genealogy.reset_but_loci();
@@ -386,7 +399,7 @@ int haploid_highd::set_wildtype(unsigned long N_in) {
 	population_size = 0;
 	number_of_clones = 0;
 	last_clone = 0;
-	random_sample.clear();
+	clone_sampler_up_to_date = false;
 	provide_at_least(10);
 
 	// Initialize the clones and calculate the population size
@@ -431,40 +444,103 @@ int haploid_highd::track_locus_genealogy(vector <int> loci) {
 	return 0;
 }
 
+/**
+ * @brief Choose how genotypes are stored
+ *
+ * @param representation DENSE_GENOTYPES (default) or SPARSE_GENOTYPES
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The sparse representation stores for each clone the sorted list of loci that differ from the
+ * wildtype 00...0. It is meant for very long genomes (L of order 10^5 or more) with few segregating
+ * sites, e.g. under low mutation rates; memory and time then scale with diversity rather than with L.
+ * Results are statistically equivalent to the dense representation.
+ *
+ * *Note*: the representation must be chosen BEFORE the population is set.
+ */
+int haploid_highd::set_genotype_representation(int representation) {
+	if((generation != -1) or (get_number_of_clones() > 0)){
+		cerr <<"haploid_highd::set_genotype_representation: you must choose the representation BEFORE the population is set"<<endl;
+		return HP_BADARG;
+	}
+	int err = population.set_up(number_of_loci, number_of_traits, representation);
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
+	if (err) {
+		cerr <<"haploid_highd::set_genotype_representation: unknown representation "<<representation<<endl;
+		return err;
+	}
+	available_clones.clear();
+	last_clone = 0;
+	return 0;
+}
+
 
 /**
  * @brief calculate and store allele frequencies
  *
  * Note: the allele frequencies are available in the allele_frequencies attribute.
+ *
+ * The allele counts are rebuilt from all clones only the first time, or after the population has been
+ * reset. From then on, they are updated whenever clone sizes or genotypes change during evolution, and
+ * population_size is kept up to date as well, so that the frequencies are obtained in O(L) rather than
+ * O(L * number of clones).
  */
 void haploid_highd::calc_allele_freqs() {
-	// TODO: all iterations over L could be optimized with pointers
 	if (HP_VERBOSE) cerr<<"haploid_highd::calc_allele_freqs()...";
-	double cs;
-	population_size = 0;
-	participation_ratio = 0.0;
+	if (!allele_counts_up_to_date) {
+		count_alleles(allele_counts);
+		allele_counts_up_to_date = true;
+	}
+
+	//convert counts into frequencies
 	for (int locus = 0; locus < number_of_loci; locus++)
-		allele_frequencies[locus] = 0.0;
+		allele_frequencies[locus] = double(allele_counts[locus]) / population_size;
+	if (HP_VERBOSE) cerr<<"done.\n";
+	allele_frequencies_up_to_date = true;
+}
 
-	//loop over all clones
-	int i = 0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); (pop_iter != population.end()) && (i < last_clone+1); pop_iter++, i++) {
-		cs = pop_iter->clone_size;
-		if (cs > 0) {
-			for (int locus=0; locus<number_of_loci; locus++)	//add clone size to allele frequency of clone carries allele
-				if (pop_iter->genotype[locus])
-					allele_frequencies[locus] += cs;
-			population_size += cs;
-			participation_ratio += (cs * cs);
-		}
+/**
+ * @brief Calculate and store the participation ratio, the sum of the squared clone sizes over N^2
+ *
+ * This takes a sweep over the clones, hence it is done only when the participation ratio is asked for.
+ */
+void haploid_highd::calc_participation_ratio() {
+	double cs;
+	participation_ratio = 0.0;
+	int end_clone = min(last_clone + 1, (int)population.size());
+	for (int i = 0; i < end_clone; i++) {
+		cs = population.clone_size[i];
+		if (cs > 0) participation_ratio += (cs * cs);
 	}
-	//convert counts into frequencies
 	participation_ratio /= population_size;
 	participation_ratio /= population_size;
+}
+
+/**
+ * @brief Count the alleles of the whole population from scratch
+ *
+ * @param counts vector that is filled with the number of individuals carrying the allele at each locus
+ */
+void haploid_highd::count_alleles(vector <int> &counts) {
+	counts.assign(number_of_loci, 0);
+	population.count_alleles(last_clone + 1, &counts[0]);
+}
+
+/**
+ * @brief Check the incrementally updated allele counts against a full recount
+ *
+ * @returns the number of loci at which the counts disagree (zero if the counts are not tracked yet)
+ */
+int haploid_highd::check_allele_counts() {
+	if (!allele_counts_up_to_date) return 0;
+	vector <int> counts;
+	count_alleles(counts);
+	int mismatches = 0;
 	for (int locus = 0; locus < number_of_loci; locus++)
-		allele_frequencies[locus] /= population_size;
-	if (HP_VERBOSE) cerr<<"done.\n";
-	allele_frequencies_up_to_date = true;
+		if (counts[locus] != allele_counts[locus]) mismatches++;
+	if (mismatches and HP_VERBOSE) cerr <<"haploid_highd::check_allele_counts(): counts differ at "<<mismatches<<" loci"<<endl;
+	return mismatches;
 }
 
 /**
@@ -479,10 +555,10 @@ double haploid_highd::get_pair_frequency(int locus1, int locus2) {
 	if (HP_VERBOSE) cerr<<"haploid_highd::get_pair_frequency()...";
 
 	double frequency = 0;
-	int i = 0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); (pop_iter != population.end()) && (i < last_clone+1); pop_iter++, i++)
-		if ((pop_iter->clone_size > 0) and pop_iter->genotype[locus1] and pop_iter->genotype[locus2])
-			frequency += pop_iter->clone_size;
+	int end_clone = min(last_clone + 1, (int)population.size());
+	for (int i = 0; i < end_clone; i++)
+		if ((population.clone_size[i] > 0) and population.get_locus(i, locus1) and population.get_locus(i, locus2))
+			frequency += population.clone_size[i];
 	frequency /= population_size;
 
 	if (HP_VERBOSE) cerr<<"done.\n";
@@ -543,21 +619,23 @@ int haploid_highd::evolve(int gen) {
 	// evolve cycle
 	while((err == 0) && (g < gen)) {
 		if (HP_VERBOSE) cerr<<"generation "<<generation<<endl;
-		random_sample.clear();			//discard the old random sample
+		clone_sampler_up_to_date = false;	//the clone sizes change
 		if(err==0) err=select_gametes();	//select a new set of gametes (partitioned into sex and asex)
 		else if(HP_VERBOSE) cerr<<"Error in select_gametes()"<<endl;
-		sort(available_clones.begin(), available_clones.end(), std::greater<int>()); //sort clones in order to use the first ones again and again
 		if(err==0) err=add_recombinants();	//do the recombination between pairs of sex gametes
 		else if(HP_VERBOSE) cerr<<"Error in recombine()"<<endl;
 		if(err==0) err=mutate();		//mutation step
 		else if(HP_VERBOSE) cerr<<"Error in mutate()"<<endl;
-		random_sample.clear();			//discard the old random sample
 		g++;
 		generation++;
 
 		//add the current generation to the genealogies and prune (i.e. remove parts that do not contribute the present.
 		if (track_genealogy) genealogy.add_generation(fitness_max);
 
+		//move the clones into a dense prefix if too many slots up to last_clone are empty
+		if ((min_occupancy > 0) and (number_of_clones < min_occupancy * (last_clone + 1)))
+			compact_clones();
+
 	}
 	if (HP_VERBOSE) {
 		if(err==0) cerr<<"done."<<endl;
@@ -566,6 +644,24 @@ int haploid_highd::evolve(int gen) {
 	return err;
 }
 
+/**
+ * @brief Partial results of the selection step on a block of clones
+ *
+ * The blocks are merged in order after selection, so that the result is the same
+ * whichever thread processed which block.
+ */
+struct selection_block_t {
+	vector <int> sex_gametes;
+	vector <int> dead_clones;
+	vector <int> clones_needed_for_recombination;
+	vector <pair <int, int> > size_changes;	// (clone, change in size), only if the allele counts are tracked
+	int population_size;
+	int number_of_clones;
+	int last_clone;
+	double fitness_max;
+	selection_block_t() : population_size(0), number_of_clones(0), last_clone(0), fitness_max(HP_VERY_NEGATIVE) {};
+};
+
 /**
  * @brief Generate offspring according to fitness (selection) and segregate some for sexual mating
  *
@@ -576,70 +672,198 @@ int haploid_highd::evolve(int gen) {
  * (1-r) reproduces by exact duplication (mutations are introduced later).
  * The population size relaxes to a carrying capacity, i.e. selection is soft but the population
  * size is not exactly fixed.
+ *
+ * The fitness enters through the selection weights exp(fitness - weight_reference) cached with the
+ * clones, so that no exponentials are computed here.
+ *
+ * If selection_model is WRIGHT_FISHER, exactly carrying_capacity offspring are drawn instead, from
+ * a multinomial distribution with weights proportional to clone size times exp(fitness). The sample
+ * is drawn by conditional binomials, first over the blocks and then over the clones of each block,
+ * and the offspring of each clone are split into sexual and asexual ones by a binomial.
+ *
+ * The clones are processed in blocks of HP_CLONES_PER_BLOCK, possibly on several threads. Each block
+ * draws from its own random number stream, seeded by a key from the main generator and the block
+ * index, hence the outcome depends on the seed only and not on the number of threads.
  */
 int haploid_highd::select_gametes() {
-	// TODO: spot redundant recombination events
 	if (HP_VERBOSE) cerr<<"haploid_highd::select_gametes()...";
 
 	//determine the current mean fitness, which includes a term to keep the population size constant
-	double relaxation = relaxation_value();
+	bool wright_fisher = (selection_model == WRIGHT_FISHER);
+	double relaxation = wright_fisher ? 0 : relaxation_value();
+	//scale of the Poisson means relative to the cached selection weights of the clones
+	double weight_scale = wright_fisher ? 0 : exp(weight_reference - relaxation);
 	allele_frequencies_up_to_date = false;
 
-	//draw gametes according to parental fitness
-	double delta_fitness;
-	int os,o, nrec=0;
 	int err = 0;
-	population_size = 0;
-	
+
 	//sanity check
 	if (outcrossing_rate_effective>1 or outcrossing_rate_effective<-HP_NOTHING) {
 		cerr <<"haploid_highd::select_gametes(): outcrossing_rate needs to be <=1 and >=0, got: "<<outcrossing_rate_effective<<'\n';
 		return HP_BADARG;
 	}
+	if (wright_fisher and (carrying_capacity < 1)) {
+		cerr <<"haploid_highd::select_gametes(): carrying_capacity needs to be positive, got: "<<carrying_capacity<<'\n';
+		return HP_BADARG;
+	}
 	//to speed things up, reserve the expected amount of memory for sex gametes and the new population (+10%)
 	sex_gametes.clear();
 	clones_needed_for_recombination.clear();
 	clones_needed_for_recombination.reserve(number_of_clones*outcrossing_rate_effective*1.1);
 	sex_gametes.reserve(population_size*outcrossing_rate_effective*1.1);
-	int new_last_clone = 0;
-	number_of_clones = 0;
-	fitness_max = HP_VERY_NEGATIVE;
-	unsigned int clone_index = 0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); (pop_iter != population.end()) && (clone_index < (unsigned int)(last_clone + 1)); pop_iter++, clone_index++){
-		//poisson distributed random numbers -- mean exp(f)/bar{exp(f)})
-		if (pop_iter->clone_size > 0) {
-			//the number of asex offspring of clone[i] is poisson distributed around e^F / <e^F> * (1-r)
-			delta_fitness = pop_iter->fitness - relaxation;
-			//if (HP_VERBOSE >= 2) cerr<<i<<": relative fitness = "<<delta_fitness<<", Poisson intensity = "<<(pop_iter->clone_size*exp(delta_fitness)*(1-outcrossing_rate_effective))<<endl;
-			//draw the number of sexual offspring, add them to the list of sex_gametes one by one
-			if (outcrossing_rate_effective > 0){
-				nrec = gsl_ran_poisson(evo_generator, pop_iter->clone_size * exp(delta_fitness) * outcrossing_rate_effective);
-				for(o=0; o<nrec; o++) sex_gametes.push_back(clone_index);
-			}
 
-			os = gsl_ran_poisson(evo_generator, pop_iter->clone_size * exp(delta_fitness) * (1 - outcrossing_rate_effective));
-			if (os > 0) {
-				// clone[i] to new_pop with os as clone size
-				pop_iter->clone_size = os;
-				population_size += os;
-				fitness_max = fmax(fitness_max, pop_iter->fitness);
-				new_last_clone = clone_index;
-				number_of_clones++;
+	//draw gametes according to parental fitness, one block of clones at a time
+	int n_blocks = last_clone / HP_CLONES_PER_BLOCK + 1;
+	int end_clone = min(last_clone + 1, (int)population.size());
+	unsigned long block_key = gsl_rng_get(evo_generator);
+	vector <selection_block_t> blocks(n_blocks);
+
+	//for exactly N offspring, weigh the clones and share the offspring among the blocks
+	vector <double> block_weight;
+	vector <int> block_last;
+	vector <unsigned int> block_offspring;
+	if (wright_fisher) {
+		rebase_fitness_weights();
+		block_weight.assign(n_blocks, 0);
+		block_last.assign(n_blocks, -1);
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int b = 0; b < n_blocks; b++) {
+			for (int clone_index = b * HP_CLONES_PER_BLOCK; clone_index < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); clone_index++) {
+				double weight = population.clone_size[clone_index] * population.fitness_weight[clone_index];
+				if (weight > 0) {
+					block_weight[b] += weight;
+					block_last[b] = clone_index;
+				}
+			}
+		}
+		double total_weight = 0;
+		int last_block = -1;
+		for (int b = 0; b < n_blocks; b++)
+			if (block_weight[b] > 0) {total_weight += block_weight[b]; last_block = b;}
+		if (last_block < 0) {
+			if (HP_VERBOSE) cerr<<"error "<<HP_EXTINCTERR<<". The population went extinct!"<<endl;
+			return HP_EXTINCTERR;
+		}
+		unsigned int remaining = carrying_capacity;
+		block_offspring.resize(n_blocks);
+		for (int b = 0; b < n_blocks; b++)
+			block_offspring[b] = conditional_binomial(evo_generator, block_weight[b], total_weight, remaining, b == last_block);
+	}
 
-			} else {
-				pop_iter->clone_size = 0;
-				if (nrec == 0)
-					available_clones.push_back(clone_index);
-				else
-					clones_needed_for_recombination.push_back(clone_index);
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+	gsl_rng *block_generator = gsl_rng_alloc(evo_generator->type);
+	vector <double> means(2 * HP_CLONES_PER_BLOCK);
+	vector <unsigned int> draws(2 * HP_CLONES_PER_BLOCK);
+	vector <unsigned int> offspring(HP_CLONES_PER_BLOCK);
+#ifdef _OPENMP
+	#pragma omp for schedule(dynamic)
+#endif
+	for (int b = 0; b < n_blocks; b++) {
+		selection_block_t &block = blocks[b];
+		double expected_offspring;
+		int os, o, nrec = 0;
+		unsigned int remaining = wright_fisher ? block_offspring[b] : 0;
+		double remaining_weight = wright_fisher ? block_weight[b] : 0;
+		gsl_rng_set(block_generator, stream_seed(block_key, b));
+		//the Poisson numbers of sexual and asexual offspring of the whole block are drawn at once, and so
+		//are the binomial splits of the multinomial offspring numbers into sexual and asexual ones
+		size_t n_draws = 0;
+		if (wright_fisher) {
+			for (int clone_index = b * HP_CLONES_PER_BLOCK; clone_index < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); clone_index++) {
+				int clone_size = population.clone_size[clone_index];
+				if (clone_size > 0) {
+					double weight = clone_size * population.fitness_weight[clone_index];
+					offspring[n_draws++] = conditional_binomial(block_generator, weight, remaining_weight, remaining, clone_index == block_last[b]);
+				}
 			}
-			if (track_genealogy){
-				for (unsigned int locus=0; locus<genealogy.loci.size(); locus++){
-					add_clone_to_genealogy(locus, clone_index, clone_index, 0,number_of_loci,os,(os>0));
+			if (outcrossing_rate_effective > 0)
+				rng_binomial_block(block_generator, outcrossing_rate_effective, &offspring[0], &draws[0], n_draws);
+			n_draws = 0;
+		} else {
+			for (int clone_index = b * HP_CLONES_PER_BLOCK; clone_index < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); clone_index++) {
+				int clone_size = population.clone_size[clone_index];
+				if (clone_size > 0) {
+					//poisson distributed random numbers -- mean exp(f)/bar{exp(f)})
+					//the number of asex offspring of clone[i] is poisson distributed around e^F / <e^F> * (1-r)
+					expected_offspring = clone_size * population.fitness_weight[clone_index] * weight_scale;
+					if (outcrossing_rate_effective > 0)
+						means[n_draws++] = expected_offspring * outcrossing_rate_effective;
+					means[n_draws++] = expected_offspring * (1 - outcrossing_rate_effective);
+				}
+			}
+			rng_poisson_block(block_generator, &means[0], &draws[0], n_draws);
+			n_draws = 0;
+		}
+		for (int clone_index = b * HP_CLONES_PER_BLOCK; clone_index < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); clone_index++) {
+			int &clone_size = population.clone_size[clone_index];
+			if (clone_size > 0) {
+				if (wright_fisher) {
+					//multinomial offspring numbers, split into sexual and asexual ones
+					int n = offspring[n_draws];
+					nrec = (outcrossing_rate_effective > 0) ? draws[n_draws] : 0;
+					n_draws++;
+					for(o=0; o<nrec; o++) block.sex_gametes.push_back(clone_index);
+					os = n - nrec;
+				} else {
+					//add the sexual offspring to the list of sex_gametes one by one
+					if (outcrossing_rate_effective > 0){
+						nrec = draws[n_draws++];
+						for(o=0; o<nrec; o++) block.sex_gametes.push_back(clone_index);
+					}
+					os = draws[n_draws++];
+				}
+				//sex gametes are still counted with their parent clone until they are mated
+				if (allele_counts_up_to_date and (os + nrec != clone_size))
+					block.size_changes.push_back(make_pair(clone_index, os + nrec - clone_size));
+				if (os > 0) {
+					// clone[i] to new_pop with os as clone size
+					clone_size = os;
+					block.population_size += os;
+					block.fitness_max = fmax(block.fitness_max, population.fitness[clone_index]);
+					block.last_clone = clone_index;
+					block.number_of_clones++;
+
+				} else {
+					clone_size = 0;
+					if (nrec == 0)
+						block.dead_clones.push_back(clone_index);
+					else
+						block.clones_needed_for_recombination.push_back(clone_index);
+				}
+				if (track_genealogy){
+					for (unsigned int locus=0; locus<genealogy.loci.size(); locus++){
+						add_clone_to_genealogy(locus, clone_index, clone_index, 0,number_of_loci,os,(os>0));
+					}
 				}
 			}
 		}
 	}
+	gsl_rng_free(block_generator);
+	}
+
+	//merge the blocks in order
+	population_size = 0;
+	number_of_clones = 0;
+	fitness_max = HP_VERY_NEGATIVE;
+	int new_last_clone = 0;
+	for (vector<selection_block_t>::iterator block = blocks.begin(); block != blocks.end(); block++) {
+		sex_gametes.insert(sex_gametes.end(), block->sex_gametes.begin(), block->sex_gametes.end());
+		for (vector <int>::iterator c = block->dead_clones.begin(); c != block->dead_clones.end(); c++)
+			available_clones.release(*c);
+		clones_needed_for_recombination.insert(clones_needed_for_recombination.end(),
+				block->clones_needed_for_recombination.begin(), block->clones_needed_for_recombination.end());
+		for (vector <pair <int, int> >::iterator change = block->size_changes.begin(); change != block->size_changes.end(); change++)
+			update_allele_counts(change->first, change->second);
+		population_size += block->population_size;
+		number_of_clones += block->number_of_clones;
+		fitness_max = fmax(fitness_max, block->fitness_max);
+		if (block->number_of_clones) new_last_clone = block->last_clone;
+	}
 	last_clone = new_last_clone;
 	if(population_size+sex_gametes.size() < 1) {
 		err = HP_EXTINCTERR;
@@ -671,23 +895,26 @@ int haploid_highd::bottleneck(int size_of_bottleneck) {
 	unsigned int old_size = population_size;
 	if (HP_VERBOSE) cerr<<"haploid_highd::bottleneck()...";
 	allele_frequencies_up_to_date = false;
+	clone_sampler_up_to_date = false;
 
 	population_size = 0;
 
 	// resample each clone according to Poisson with a expected size reduced by bottleneck/N_old
 	// eep track of the maximal fitness
 	fitness_max = HP_VERY_NEGATIVE;
-	unsigned int clone_index = 0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); pop_iter != population.end() and (clone_index < (unsigned int)(last_clone + 1)); pop_iter++, clone_index++) {
-		ostmp = pop_iter->clone_size * size_of_bottleneck / double(old_size);
+	unsigned int end_clone = min((unsigned int)(last_clone + 1), (unsigned int)population.size());
+	for(unsigned int clone_index = 0; clone_index < end_clone; clone_index++) {
+		ostmp = population.clone_size[clone_index] * size_of_bottleneck / double(old_size);
 		os = gsl_ran_poisson(evo_generator, ostmp);
+		update_allele_counts(clone_index, int(os) - population.clone_size[clone_index]);
 		if(os > 0) {
-			pop_iter->clone_size = os;
+			population.clone_size[clone_index] = os;
 			population_size += os;
-			check_individual_maximal_fitness(*pop_iter);
-		} else {
-			pop_iter->clone_size = 0;
-			available_clones.push_back(clone_index);
+			check_individual_maximal_fitness(clone_index);
+		} else if (population.clone_size[clone_index] > 0) {
+			//empty clones are already available and must not be handed out twice
+			population.clone_size[clone_index] = 0;
+			available_clones.release(clone_index);
 		}
 	}
 
@@ -709,38 +936,77 @@ int haploid_highd::bottleneck(int size_of_bottleneck) {
  * The user can therefore call this function safely even if in non-mutating populations, without
  * loss of performance.
  *
- * Function is now rewritten to allow for multiple mutants.
- * TODO: Poisson conditional on at least one
+ * Each individual is hit by a Poisson number of mutations, with mean equal to the sum of the mutation
+ * rates over the loci. The clones are walked in order, skipping a geometric number of individuals from
+ * one mutant to the next, and each mutant gets a zero-truncated Poisson number of mutations at loci
+ * drawn according to the mutation rates (see set_mutation_rates()). The mutations are drawn in blocks of
+ * HP_CLONES_PER_BLOCK clones with one random number stream each, possibly on several threads, and
+ * introduced in the order of the clones afterwards.
+ *
  * FIXME!: all_polymorphic assumes that all additive effects are set, i.e. that locus equals the index of the
  * coefficient in the vector of additive effects
  */
 int haploid_highd::mutate() {
 	if (HP_VERBOSE)	cerr <<"haploid_highd::mutate() ..."<<endl;
 
-	vector <int> mutations;
 	int tmp_individual=0, nmut=0;
-	size_t mutant;
 	allele_frequencies_up_to_date = false;
-	int actual_n_o_mutations,actual_n_o_mutants;
 	if (mutation_rate > HP_NOTHING and not all_polymorphic) {
-		//determine the number of individuals that are hit by at least one mutation
-		actual_n_o_mutants = gsl_ran_poisson(evo_generator, (1.0-exp(-mutation_rate*number_of_loci))*population_size);
-		produce_random_sample(min(actual_n_o_mutants, population_size));
+		//individuals are mutants with probability 1 - exp(-total rate)
+		double total_rate = mutation_rate * number_of_loci;
+		double log_no_mutation = -total_rate;
+		bool rate_map = mutation_rate_map.size() > 0;
+
+		//for each block of clones, list the mutants as (clone, number of mutations, loci...)
+		int n_blocks = last_clone / HP_CLONES_PER_BLOCK + 1;
+		int end_clone = min(last_clone + 1, (int)population.size());
+		unsigned long block_key = gsl_rng_get(evo_generator);
+		vector <vector <int> > mutants(n_blocks);
+		vector <int> block_mutants(n_blocks, 0);
+#ifdef _OPENMP
+		#pragma omp parallel
+#endif
+		{
+		gsl_rng *block_generator = gsl_rng_alloc(evo_generator->type);
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+#endif
+		for (int b = 0; b < n_blocks; b++) {
+			gsl_rng_set(block_generator, stream_seed(block_key, b));
+			//number of individuals to skip until the next mutant
+			double skip = floor(log(gsl_rng_uniform_pos(block_generator)) / log_no_mutation);
+			for (int clone_index = b * HP_CLONES_PER_BLOCK; clone_index < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); clone_index++) {
+				int clone_size = population.clone_size[clone_index];
+				if (clone_size <= 0) continue;
+				while (skip < clone_size) {
+					int n_mutations = zero_truncated_poisson(block_generator, total_rate);
+					mutants[b].push_back(clone_index);
+					mutants[b].push_back(n_mutations);
+					for (int m = 0; m < n_mutations; m++)
+						mutants[b].push_back(rate_map ? mutation_loci.draw(block_generator) : gsl_rng_uniform_int(block_generator, number_of_loci));
+					block_mutants[b]++;
+					skip += 1 + floor(log(gsl_rng_uniform_pos(block_generator)) / log_no_mutation);
+				}
+				skip -= clone_size;
+			}
+		}
+		gsl_rng_free(block_generator);
+		}
 
 		//make sure enough empty clones are available to accomodate the new mutants
-		provide_at_least(min(actual_n_o_mutants, population_size));
-
-		//loop over the mutant individuals and introduce the mutations
-		for (int individual = 0; individual != actual_n_o_mutants; individual++) {
-			//determine the target clone
-			mutant = random_clone();
-			//determine the number of mutation it suffers. this should be Poisson conditional on having at least one
-			//in practice the solution is fine but it is somewhat inaccurate for multiple mutations
-			actual_n_o_mutations = gsl_ran_poisson(evo_generator, number_of_loci * mutation_rate)+1;
-			//introduce the mutations, not that flip_single_locus returns the number of new mutant, which is fed back into
-			//flip_single_locus to introduce the next mutation
-			for (int i = 0; i != actual_n_o_mutations; i++)
-				mutant=flip_single_locus(mutant, gsl_rng_uniform_int(evo_generator,number_of_loci));
+		int n_mutants = 0;
+		for (int b = 0; b < n_blocks; b++) n_mutants += block_mutants[b];
+		provide_at_least(n_mutants);
+
+		//introduce the mutations, note that flip_single_locus returns the number of new mutant, which is fed back into
+		//flip_single_locus to introduce the next mutation
+		for (int b = 0; b < n_blocks; b++) {
+			for (vector <int>::iterator m = mutants[b].begin(); m != mutants[b].end();) {
+				size_t mutant = *(m++);
+				int n_mutations = *(m++);
+				for (int i = 0; i != n_mutations; i++)
+					mutant = flip_single_locus(mutant, *(m++));
+			}
 		}
 	} else if(all_polymorphic) {
 		if(HP_VERBOSE) cerr <<"haploid_highd::mutate(): keeping all loci polymorphic"<<endl;
@@ -753,7 +1019,7 @@ int haploid_highd::mutate() {
                 {	//if they are in the ancestral state
 					tmp_individual = flip_single_locus(locus);		//introduce new allele
 					polymorphism[locus].birth = get_generation();
-					polymorphism[locus].fitness = population[tmp_individual].fitness-fitness_stat.mean;
+					polymorphism[locus].fitness = population.fitness[tmp_individual]-fitness_stat.mean;
 					polymorphism[locus].fitness_variance = fitness_stat.variance;
 					nmut++;
 				}else{	//if locus is in derived state, flip coefficient of trait zero
@@ -764,7 +1030,7 @@ int haploid_highd::mutate() {
 					ancestral_state[locus]= (ancestral_state[locus]==0)?1:0;
 					polymorphism[locus].birth = get_generation();
 					polymorphism[locus].effect = (2*ancestral_state[locus]-1)*trait[0].get_additive_coefficient(locus);
-					polymorphism[locus].fitness = population[tmp_individual].fitness;
+					polymorphism[locus].fitness = population.fitness[tmp_individual];
 					polymorphism[locus].fitness_variance = fitness_stat.variance;
 					nmut++;
 				}
@@ -792,7 +1058,9 @@ int haploid_highd::mutate() {
 unsigned int haploid_highd::flip_single_locus(int locus) {
 	if (available_clones.size() == 0)
 		provide_at_least(1);
-	return flip_single_locus(random_clone(), locus);
+	unsigned int new_clone = flip_single_locus(random_clone(), locus);
+	clone_sampler_up_to_date = false;
+	return new_clone;
 }
 
 
@@ -806,35 +1074,51 @@ unsigned int haploid_highd::flip_single_locus(int locus) {
  * and assigns it a fitness.
  *
  * Note: This might produce duplicate clones since the mutant clone produced might
- * already exist. Duplicates can be merged by the member unique_clones()
+ * already exist. Duplicates can be merged by the member unique_clones(), or avoided altogether
+ * by set_clone_deduplication(); in the latter case, the existing clone is returned.
  */
 unsigned int haploid_highd::flip_single_locus(unsigned int clonenum, int locus) {
 	// produce new genotype
-	int new_clone = available_clones.back();
-	available_clones.pop_back();
+	int new_clone = available_clones.acquire();
 	allele_frequencies_up_to_date = false;
 
 	//copy old genotype
-	population[new_clone].genotype = population[clonenum].genotype;
-	// new clone size == 1, old clone reduced by 1
-	population[new_clone].clone_size = 1;
-	population[clonenum].clone_size--;
+	population.copy_genotype(new_clone, clonenum);
+	// old clone reduced by 1
+	population.clone_size[clonenum]--;
 	// flip the locus in new clone
-	population[new_clone].genotype.flip(locus);
+	population.flip_locus(new_clone, locus);
+	if (allele_counts_up_to_date)
+		allele_counts[locus] += population.get_locus(new_clone, locus) ? 1 : -1;
+
+	// a mutant with the genotype of an existing clone joins it
+	int existing = deduplicating() ? find_duplicate_clone(new_clone) : -1;
+	if (existing >= 0) {
+		available_clones.release(new_clone);
+		population.clone_size[existing]++;
+		if (population.clone_size[clonenum] == 0) {
+			available_clones.release(clonenum);
+			number_of_clones--;
+		}
+		return existing;
+	}
+
+	// new clone size == 1
+	population.clone_size[new_clone] = 1;
 	// calculate traits and fitness
 	vector<int> diff(1, locus);
 	for (int t = 0; t < number_of_traits; t++){
-		population[new_clone].trait[t] = population[clonenum].trait[t] + get_trait_difference(population[new_clone], population[clonenum], diff, t);
+		population.trait(new_clone)[t] = population.trait(clonenum)[t] + get_trait_difference(new_clone, clonenum, diff, t);
 	}
-	calc_individual_fitness_from_traits(population[new_clone]);
-	check_individual_maximal_fitness(population[new_clone]);
+	calc_individual_fitness_from_traits(new_clone);
+	check_individual_maximal_fitness(new_clone);
 
 	//update the last clones that is to be tracked
 	last_clone = (new_clone<last_clone)?last_clone:new_clone;
 
 	// add clone to current population
-	if (population[clonenum].clone_size == 0)
-		available_clones.push_back(clonenum);
+	if (population.clone_size[clonenum] == 0)
+		available_clones.release(clonenum);
 	else
 		number_of_clones++;
 
@@ -853,125 +1137,220 @@ unsigned int haploid_highd::flip_single_locus(unsigned int clonenum, int locus)
 	return new_clone;
 }
 
+/**
+ * @brief Mating of two sex gametes, see add_recombinants()
+ */
+struct mating_t {
+	int parent1, parent2;
+	int offspring1, offspring2;
+	bool redundant;		//the offspring have the genotypes of the parents
+};
+
 /**
  * @brief Pair and mate sexual gametes
  *
  * @returns zero if successful, nonzero otherwise
  *
- * Using the previously produced list of sex_gametes, pair them at random and mate
+ * Using the previously produced list of sex_gametes, pair them at random and mate. Each pair
+ * produces two offspring genotypes by combining the relevant bits from both parents. This is done
+ * in three steps:
+ * - the slots of all offspring are reserved;
+ * - each pair draws its recombination pattern, builds and evaluates its offspring, possibly on
+ *   several threads. Each pair draws from its own random number stream, seeded by a key from the
+ *   main generator and the index of the pair, hence the outcome does not depend on the number of threads;
+ * - the offspring are added to the population (and the genealogy) pair by pair, in order.
+ *
+ * Matings are redundant if both gametes come from the same clone, or if the genotypes of the parents
+ * agree wherever the pattern picks the other parent, i.e. the offspring are copies of the parents.
+ * This is checked on the parents before the offspring are built (see clone_store::reproduces_parents).
+ * The offspring of redundant matings are neither built nor evaluated, but join the parental clones instead.
+ * Copies of different parents are only detected if the genealogy is not tracked, since
+ * offspring and parent may descend from different lineages at the tracked loci.
+ *
+ * Note: recombination conserves the alleles of each pair, hence the allele counts only change
+ * for gametes that remain unpaired (see unpaired_gamete).
  */
 int haploid_highd::add_recombinants() {
 	//construct new generation
 	int n_sex_gam = sex_gametes.size();
-	int parent1, parent2, err;
 	if (HP_VERBOSE) cerr <<"haploid_highd::add_recombinants(): add "<<n_sex_gam<<" recombinants!\n";
 
 	if (n_sex_gam > 1) {
 		//sexual offspring -- shuffle the set of gametes to ensure random mating
 		gsl_ran_shuffle(evo_generator, &sex_gametes[0], n_sex_gam, sizeof(int));
 		//make sure they are in even number
-		if(n_sex_gam % 2) {sex_gametes.pop_back(); n_sex_gam--;}
+		if(n_sex_gam % 2) {unpaired_gamete(sex_gametes.back()); sex_gametes.pop_back(); n_sex_gam--;}
 		provide_at_least(n_sex_gam);
-		//cout <<n_sex_gam<<'\t'<<population_size<<'\t'<<outcrossing_rate_effective<<endl;
-		for(vector<int>::iterator iter = sex_gametes.begin(); iter != sex_gametes.end(); iter++) {
-			parent1 = *iter;
-			iter++;
-			parent2 = *iter;
-			//The recombination function stores two new genotypes
-			//in new_genotypes[new_population_size] and [new_population_size+1]
-			err = recombine(parent1, parent2);
-			if(err) throw HP_RUNTIMEERR;
+		allele_frequencies_up_to_date = false;
+
+		//reserve the slots of all offspring
+		int n_pairs = n_sex_gam / 2;
+		vector <mating_t> matings(n_pairs);
+		for (int p = 0; p < n_pairs; p++) {
+			matings[p].parent1 = sex_gametes[2 * p];
+			matings[p].parent2 = sex_gametes[2 * p + 1];
+			matings[p].offspring1 = available_clones.acquire();
+			matings[p].offspring2 = available_clones.acquire();
+			matings[p].redundant = (matings[p].parent1 == matings[p].parent2);
 		}
+
+		//build and evaluate the offspring. For the genealogy, the segment around each tracked
+		//locus that offspring1 inherits from the same parent is stored as (left, right, from parent1)
+		int n_genealogy_loci = track_genealogy ? genealogy.loci.size() : 0;
+		vector <int> segments(3 * n_pairs * n_genealogy_loci);
+		unsigned long pair_key = gsl_rng_get(evo_generator);
+		for (int t = 0; t < number_of_traits; t++)
+			trait[t].update_caches();
+#ifdef _OPENMP
+		#pragma omp parallel
+#endif
+		{
+		gsl_rng *pair_generator = gsl_rng_alloc(evo_generator->type);
+		xoshiro256pp_t word_generator;
+		vector <uint64_t> pattern(population.get_words(), 0);
+		vector <int> points;
+		//sparse genotypes are merged along the crossover points directly, the pattern is only needed for the genealogy
+		bool use_crossover_points = (recombination_model==CROSSOVERS) and population.is_sparse();
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, HP_PAIRS_PER_CHUNK)
+#endif
+		for (int p = 0; p < n_pairs; p++) {
+			mating_t &mating = matings[p];
+			if (mating.redundant) continue;
+			//depending on the recombination model, produce a map that determines which offspring
+			//inherites which part of the parental genomes (any other model leaves the pattern empty)
+			if (recombination_model==FREE_RECOMBINATION) {
+				word_generator.seed(stream_seed(pair_key, p));
+				reassortment_pattern(word_generator, &pattern[0]);
+			} else if (recombination_model==CROSSOVERS) {
+				gsl_rng_set(pair_generator, stream_seed(pair_key, p));
+				draw_crossover_points(pair_generator, points);
+				if ((!use_crossover_points) or track_genealogy)
+					population.crossover_mask(points, &pattern[0]);
+			}
+
+			//offspring that would be copies of their parents are not built
+			if ((!track_genealogy) and (use_crossover_points ?
+			    population.reproduces_parents_crossovers(mating.parent1, mating.parent2, points) :
+			    population.reproduces_parents(mating.parent1, mating.parent2, &pattern[0]))) {
+				mating.redundant = true;
+				continue;
+			}
+			if (use_crossover_points)
+				population.recombine_crossovers(mating.offspring1, mating.offspring2, mating.parent1, mating.parent2, points);
+			else
+				population.recombine(mating.offspring1, mating.offspring2, mating.parent1, mating.parent2, &pattern[0]);
+			calc_individual_traits(mating.offspring1);
+			calc_individual_traits(mating.offspring2);
+			calc_individual_fitness_from_traits(mating.offspring1);
+			calc_individual_fitness_from_traits(mating.offspring2);
+
+			for (int genlocus = 0; genlocus < n_genealogy_loci; genlocus++) {
+				int locus = genealogy.loci[genlocus];
+				int brleft = locus, brright = locus;
+				int state = pattern_bit(&pattern[0], locus);
+				while (pattern_bit(&pattern[0], brleft)==state and brleft>0) brleft--;
+				while (pattern_bit(&pattern[0], brright)==state and brright<number_of_loci) brright++;
+				brright--;
+				int *segment = &segments[3 * (p * n_genealogy_loci + genlocus)];
+				segment[0] = brleft;
+				segment[1] = brright;
+				segment[2] = state;
+			}
+		}
+		gsl_rng_free(pair_generator);
+		}
+
+		//add the offspring to the population in order
+		for (int p = 0; p < n_pairs; p++) {
+			if (matings[p].redundant) {
+				available_clones.release(matings[p].offspring1);
+				available_clones.release(matings[p].offspring2);
+				add_offspring_to_parent(matings[p].parent1);
+				add_offspring_to_parent(matings[p].parent2);
+				population_size+=2;
+				continue;
+			}
+			int offspring[2] = {matings[p].offspring1, matings[p].offspring2};
+			for (int k = 0; k < 2; k++) {
+				if (deduplicating()) {
+					// offspring with the genotype of an existing clone join it
+					int existing = find_duplicate_clone(offspring[k]);
+					if (existing >= 0) {
+						available_clones.release(offspring[k]);
+						population.clone_size[existing]++;
+						continue;
+					}
+				}
+				// clone size of new genoytpes is 1 each
+				population.clone_size[offspring[k]] = 1;
+				number_of_clones++;
+				check_individual_maximal_fitness(offspring[k]);
+				last_clone = (offspring[k]<last_clone)?last_clone:offspring[k];
+			}
+			population_size+=2;
+
+			for (int genlocus = 0; genlocus < n_genealogy_loci; genlocus++) {
+				int *segment = &segments[3 * (p * n_genealogy_loci + genlocus)];
+				if (segment[2]){
+					add_clone_to_genealogy(genlocus, matings[p].offspring1, matings[p].parent1, segment[0], segment[1], 1, 1);
+					add_clone_to_genealogy(genlocus, matings[p].offspring2, matings[p].parent2, segment[0], segment[1], 1, 1);
+				}else{
+					add_clone_to_genealogy(genlocus, matings[p].offspring2, matings[p].parent1, segment[0], segment[1], 1, 1);
+					add_clone_to_genealogy(genlocus, matings[p].offspring1, matings[p].parent2, segment[0], segment[1], 1, 1);
+				}
+			}
+		}
+	} else if (n_sex_gam == 1) {
+		//a single gamete finds no partner
+		unpaired_gamete(sex_gametes[0]);
 	}
+	//parents that got offspring back from redundant matings are alive
 	for (vector<int>::iterator c = clones_needed_for_recombination.begin(); c != clones_needed_for_recombination.end(); c++)
-		available_clones.push_back(*c);
+		if (population.clone_size[*c] == 0) available_clones.release(*c);
 	clones_needed_for_recombination.clear();
 	return 0;
 }
 
-
 /**
- * @brief Recombine two genotypes parent1 and parent2 to produce two new genotypes
- *
- * @param parent1 first parent
- * @param parent2 second parent
- *
- * @returns zero if successful
- *
- * The new genotypes are stored in new_pop at positions ng and ng+1.
+ * @brief Add an offspring of a redundant mating to its parental clone
  *
+ * @param parent parental clone, possibly without asexual offspring
  */
-int haploid_highd::recombine(int parent1, int parent2) {
-	if(HP_VERBOSE >= 2) cerr<<"haploid_highd::recombine(int parent1, int parent2)... parent 1: "<<parent1<<" parent 2: "<<parent2<<endl;
-
-	allele_frequencies_up_to_date = false;
-
-	//depending on the recombination model, produce a map that determines which offspring
-	//inherites which part of the parental genomes
-	if (recombination_model==FREE_RECOMBINATION)
-		reassortment_pattern();
-	else if (recombination_model==CROSSOVERS)
-		crossover_pattern();
-	//else {rec_pattern.resize(number_of_loci);}
-
-	// produce two new genoytes
-	int offspring_num1 = available_clones.back();
-	available_clones.pop_back();
-	number_of_clones++;
-	int offspring_num2 = available_clones.back();
-	available_clones.pop_back();
-	number_of_clones++;
-
-	if(HP_VERBOSE >= 2) cerr<<"offpring 1: "<<offspring_num1<<" offpring 2: "<<offspring_num2<<endl;
-
-	// assign the genotypes by combining the relevant bits from both parents
-	population[offspring_num1].genotype = (population[parent1].genotype&rec_pattern) | (population[parent2].genotype&(~rec_pattern));
-	population[offspring_num2].genotype = (population[parent2].genotype&rec_pattern) | (population[parent1].genotype&(~rec_pattern));
-	// clone size of new genoytpes is 1 each
-	population[offspring_num1].clone_size = 1;
-	population[offspring_num2].clone_size = 1;
-	// calculate traits and fitness
-	calc_individual_traits(population[offspring_num1]);
-	calc_individual_traits(population[offspring_num2]);
-	calc_individual_fitness_from_traits(population[offspring_num1]);
-	calc_individual_fitness_from_traits(population[offspring_num2]);
-	check_individual_maximal_fitness(population[offspring_num1]);
-	check_individual_maximal_fitness(population[offspring_num2]);
-
-	last_clone = (offspring_num1<last_clone)?last_clone:offspring_num1;
-	last_clone = (offspring_num2<last_clone)?last_clone:offspring_num2;
-
-	//Check what's going on
-	if(HP_VERBOSE >= 3) {
-		cerr<<rec_pattern<<endl;
-		cerr<<population[parent1].genotype<<endl;
-		cerr<<population[parent2].genotype<<endl;
-		cerr<<population[offspring_num1].genotype<<endl;
-		cerr<<population[offspring_num2].genotype<<endl<<endl;
-	}
-
-	population_size+=2;
-
-	if (track_genealogy) {
-		for (unsigned int genlocus=0; genlocus<genealogy.loci.size(); genlocus++){
-			int locus=genealogy.loci[genlocus];
-			int brleft=locus, brright=locus;
-			bool state = rec_pattern[locus];
-			while (rec_pattern[brleft]==state and brleft>0){brleft--;}
-			while (rec_pattern[brright]==state and brright<number_of_loci){brright++;}
-			brright--;
-			if (state==1){
-				add_clone_to_genealogy(genlocus, offspring_num1,parent1, brleft, brright, 1, 1);
-				add_clone_to_genealogy(genlocus, offspring_num2,parent2, brleft, brright, 1, 1);
-			}else{
-				add_clone_to_genealogy(genlocus, offspring_num2,parent1, brleft, brright, 1, 1);
-				add_clone_to_genealogy(genlocus, offspring_num1,parent2, brleft, brright, 1, 1);
+void haploid_highd::add_offspring_to_parent(int parent) {
+	if (population.clone_size[parent] == 0) {
+		//the parent comes back to life, unless a clone with its genotype has been created meanwhile
+		if (deduplicating()) {
+			int existing = find_duplicate_clone(parent);
+			if (existing >= 0) {
+				population.clone_size[existing]++;
+				return;
 			}
 		}
+		number_of_clones++;
+		check_individual_maximal_fitness(parent);
+		last_clone = (parent<last_clone)?last_clone:parent;
 	}
+	population.clone_size[parent]++;
+	if (track_genealogy)
+		for (unsigned int genlocus=0; genlocus<genealogy.loci.size(); genlocus++)
+			add_clone_to_genealogy(genlocus, parent, parent, 0, number_of_loci, population.clone_size[parent], 1);
+}
 
-	if(HP_VERBOSE >= 2) cerr<<"done."<<endl;
-	return 0;
+/**
+ * @brief Dispose of a sex gamete that finds no partner
+ *
+ * @param parent parental clone of the gamete
+ *
+ * The gamete is lost, unless selection_model is WRIGHT_FISHER: then it is added to its parent
+ * as an asexual offspring, so that the population size stays exactly at carrying_capacity.
+ */
+void haploid_highd::unpaired_gamete(int parent) {
+	if (selection_model == WRIGHT_FISHER) {
+		add_offspring_to_parent(parent);
+		population_size++;
+	} else
+		update_allele_counts(parent, -1);
 }
 
 void haploid_highd::add_clone_to_genealogy(int locusIndex, int dest, int parent, int left, int right, int cs, int n){
@@ -990,7 +1369,7 @@ void haploid_highd::add_clone_to_genealogy(int locusIndex, int dest, int parent,
 	genealogy.newGenerations[locusIndex][dest].parent_node.age=generation-1;
 	genealogy.newGenerations[locusIndex][dest].own_key.index=dest;
 	genealogy.newGenerations[locusIndex][dest].own_key.age=generation;
-	genealogy.newGenerations[locusIndex][dest].fitness= population[dest].fitness;
+	genealogy.newGenerations[locusIndex][dest].fitness= population.fitness[dest];
 	genealogy.newGenerations[locusIndex][dest].number_of_offspring=n;
 	genealogy.newGenerations[locusIndex][dest].clone_size=cs;
 	genealogy.newGenerations[locusIndex][dest].crossover[0]=left;
@@ -1004,25 +1383,114 @@ void haploid_highd::add_clone_to_genealogy(int locusIndex, int dest, int parent,
  * @brief For each clone, recalculate its traits
  */
 void haploid_highd::update_traits() {
-	int i=0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); (pop_iter != population.end()) && (i<last_clone+1); pop_iter++, i++)
-		if (pop_iter->clone_size>0)
-			calc_individual_traits(*pop_iter);
+	evaluate_clones(0, min(last_clone + 1, (int)population.size()), true, false);
 }
 
 /**
  * @brief For each clone, update fitness assuming traits are already up to date
  */
 void haploid_highd::update_fitness() {
-	if(population.size() > 0) {
-		fitness_max = HP_VERY_NEGATIVE;
-		unsigned int i = 0;
-		for(vector<clone_t>::iterator pop_iter = population.begin(); (pop_iter != population.end()) and (i < (unsigned int)(last_clone + 1)); pop_iter++, i++)
-			if (pop_iter->clone_size > 0) {
-				calc_individual_fitness_from_traits(*pop_iter);
-				check_individual_maximal_fitness(*pop_iter);
-			}
+	if(population.size() > 0)
+		fitness_max = evaluate_clones(0, min(last_clone + 1, (int)population.size()), false, true);
+}
+
+/**
+ * @brief Recalculate traits and fitness of a range of clones
+ *
+ * @param first_clone first clone of the range
+ * @param end_clone one past the last clone of the range (by default, all clones)
+ *
+ * This is a single pass over the genotypes, equivalent to update_traits() followed by update_fitness()
+ * on the range. The maximal fitness is recomputed if all clones are evaluated, and raised to the maximum of
+ * the range otherwise.
+ */
+void haploid_highd::update_traits_and_fitness(int first_clone, int end_clone) {
+	if (end_clone < 0 or end_clone > min(last_clone + 1, (int)population.size()))
+		end_clone = min(last_clone + 1, (int)population.size());
+	first_clone = max(first_clone, 0);
+	if (first_clone >= end_clone) return;
+	double range_max = evaluate_clones(first_clone, end_clone, true, true);
+	if (first_clone == 0 and end_clone == min(last_clone + 1, (int)population.size()))
+		fitness_max = range_max;
+	else
+		fitness_max = fmax(fitness_max, range_max);
+}
+
+/**
+ * @brief Calculate traits and fitness of arbitrary genotypes
+ *
+ * @param genotypes genotypes to evaluate, of length number_of_loci
+ * @param traits output, number_of_traits values per genotype one after the other
+ * @param fitness output, one value per genotype
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The population is not changed. The genotypes are evaluated in parallel when OpenMP is enabled.
+ */
+int haploid_highd::calc_traits_and_fitness(const vector <boost::dynamic_bitset<> > &genotypes, vector <double> &traits, vector <double> &fitness) {
+	for (size_t i = 0; i < genotypes.size(); i++)
+		if ((int)genotypes[i].size() != number_of_loci) {
+			cerr <<"haploid_highd::calc_traits_and_fitness(): genotype "<<i<<" has length "<<genotypes[i].size()<<", expected "<<number_of_loci<<endl;
+			return HP_BADARG;
+		}
+	int n_genotypes = genotypes.size();
+	traits.resize((size_t)n_genotypes * number_of_traits);
+	fitness.resize(n_genotypes);
+	for (int t = 0; t < number_of_traits; t++)
+		trait[t].update_caches();
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+	vector <uint64_t> words((number_of_loci + 63) / 64);
+#ifdef _OPENMP
+	#pragma omp for schedule(dynamic, HP_CLONES_PER_CHUNK)
+#endif
+	for (int i = 0; i < n_genotypes; i++) {
+		const boost::dynamic_bitset<> &genotype = genotypes[i];
+		fill(words.begin(), words.end(), 0);
+		for (size_t locus = genotype.find_first(); locus != boost::dynamic_bitset<>::npos; locus = genotype.find_next(locus))
+			words[locus >> 6] |= ((uint64_t)1) << (locus & 63);
+		double *genotype_traits = &traits[(size_t)i * number_of_traits];
+		hypercube_highd::get_funcs(trait, number_of_traits, &words[0], genotype_traits);
+		fitness[i] = calc_fitness_from_traits(genotype_traits);
 	}
+	}
+	return 0;
+}
+
+/**
+ * @brief Recalculate traits and/or fitness of the nonempty clones in a range
+ *
+ * @param first_clone first clone of the range
+ * @param end_clone one past the last clone of the range
+ * @param traits whether to recalculate the traits
+ * @param fitness whether to recalculate fitness from the traits
+ *
+ * @returns the maximal fitness in the range, or HP_VERY_NEGATIVE if fitness is not recalculated
+ *
+ * The clones are split in chunks of HP_CLONES_PER_CHUNK, which are evaluated in parallel when OpenMP
+ * is enabled. All traits of a clone are evaluated in one pass over its genotype (see hypercube_highd::get_funcs).
+ *
+ * *Note*: calc_fitness_from_traits is called from several threads at once and must not change the population.
+ */
+double haploid_highd::evaluate_clones(int first_clone, int end_clone, bool traits, bool fitness) {
+	double range_max = HP_VERY_NEGATIVE;
+	if (traits)
+		for (int t = 0; t < number_of_traits; t++)
+			trait[t].update_caches();
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic, HP_CLONES_PER_CHUNK) reduction(max: range_max)
+#endif
+	for (int i = first_clone; i < end_clone; i++)
+		if (population.clone_size[i] > 0) {
+			if (traits) calc_individual_traits(i);
+			if (fitness) {
+				calc_individual_fitness_from_traits(i);
+				range_max = fmax(range_max, population.fitness[i]);
+			}
+		}
+	return range_max;
 }
 
 /**
@@ -1039,243 +1507,177 @@ void haploid_highd::update_fitness() {
  * at the expense of performance, that everything is up to date.
  */
 void haploid_highd::calc_stat() {
-	update_traits();
-	update_fitness();
-	calc_trait_stat();
-	calc_fitness_stat();
+	update_traits_and_fitness();
+	calc_clone_stat(true);
 	calc_allele_freqs();
 }
 
 /**
  * @brief Calculate traits of the chosen clone
  *
- * @param tempgt clone whose traits are to be calculated
+ * @param clonenum clone whose traits are to be calculated
  */
-void haploid_highd::calc_individual_traits(clone_t &tempgt) {
-	for (int t = 0; t < number_of_traits; t++)
-		tempgt.trait[t] = trait[t].get_func(tempgt.genotype);
+void haploid_highd::calc_individual_traits(int clonenum) {
+	if (population.is_sparse())
+		hypercube_highd::get_funcs(trait, number_of_traits, population.derived_loci(clonenum), population.trait(clonenum));
+	else
+		hypercube_highd::get_funcs(trait, number_of_traits, population.genotype(clonenum), population.trait(clonenum));
 }
 
 /**
  * @brief Calculate trait difference between two clones
  *
- * @param tempgt1 first clone
- * @param tempgt2 second clone
+ * @param clonenum1 first clone
+ * @param clonenum2 second clone
  * @param diffpos positions at which the genotypes differ
  * @param traitnum number of the trait to calculate
  *
  * @returns vector of differences
  *
- * The operation is, for each trait, tempgt1 - tempgt2.
+ * The operation is, for each trait, clonenum1 - clonenum2.
  */
-double haploid_highd::get_trait_difference(clone_t &tempgt1, clone_t &tempgt2, vector<int>& diffpos, int traitnum) {
-	return trait[traitnum].get_func_diff(tempgt1.genotype, tempgt2.genotype, diffpos);
+double haploid_highd::get_trait_difference(int clonenum1, int clonenum2, vector<int>& diffpos, int traitnum) {
+	if (population.is_sparse())
+		return trait[traitnum].get_func_diff(population.derived_loci(clonenum1), population.derived_loci(clonenum2), diffpos);
+	return trait[traitnum].get_func_diff(population.genotype(clonenum1), population.genotype(clonenum2), diffpos);
 }
 
 /**
- * @brief Calculate fitness from traits of the chosen clone
+ * @brief Phenotype-fitness map
+ *
+ * @param traits array of the number_of_traits traits of a clone
  *
- * @param tempgt clone whose fitness is to be calculated
+ * @returns the fitness corresponding to those traits
  *
  * This function is linear in the traits with weights equal to trait_weights.
- * By default, only the first weight is different from zero.
+ * By default, only the first weight is different from zero. Subclasses can override it
+ * to implement a different map.
  */
-void haploid_highd::calc_individual_fitness_from_traits(clone_t &tempgt) {
-	tempgt.fitness = trait_weights[0] * tempgt.trait[0];
+double haploid_highd::calc_fitness_from_traits(const double *traits) {
+	double fitness = trait_weights[0] * traits[0];
 	for (int t = 1; t < number_of_traits; t++)
-		tempgt.fitness += trait_weights[t] * tempgt.trait[t];
+		fitness += trait_weights[t] * traits[t];
+	return fitness;
 }
 
 /**
  * @brief Calculate fitness of a particular clone
  *
- * @param tempgt clone whose fitness is being calculated
+ * @param clonenum clone whose fitness is being calculated
  *
  * Note: this function also updates the traits information for the same clone, because the
  * phenotype is needed to calculate fitness. If you have already calculated the traits,
  * you can rely calc_individual_fitness_from_traits.
  */
-void haploid_highd::calc_individual_fitness(clone_t &tempgt) {
+void haploid_highd::calc_individual_fitness(int clonenum) {
 	//calculate the new fitness value of the mutant
-	calc_individual_traits(tempgt);
-	calc_individual_fitness_from_traits(tempgt);
+	calc_individual_traits(clonenum);
+	calc_individual_fitness_from_traits(clonenum);
 	//FIXME: why is this commented?
-	//check_individual_maximal_fitness(tempgt);
+	//check_individual_maximal_fitness(clonenum);
 }
 
 /**
- * @brief Choose a number of crossover points and produce a crossover pattern
+ * @brief Choose a number of crossover points at random
  *
- * @returns crossover pattern
- *
- * A typical crossover pattern would be 0000111100011111101101.
+ * @param rng random number generator to draw from
+ * @param crossover_points sorted crossover points (output). A crossover point x means that
+ * the offspring switches parent between loci x-1 and x.
  */
-void haploid_highd::crossover_pattern() {
-	if (HP_VERBOSE) cerr<<"haploid_highd::crossover_pattern() "<<"...";
-
+void haploid_highd::draw_crossover_points(gsl_rng *rng, vector <int> &crossover_points) const {
 	int n_o_c = 0;
-	vector <int> crossover_points;
 	double total_rec = number_of_loci * crossover_rate;
 
 	//TODO this should be poisson conditional on having at least one
 	if (total_rec < 0.1) n_o_c=1;
-	else while (n_o_c == 0) n_o_c = gsl_ran_poisson(evo_generator,total_rec);
+	else while (n_o_c == 0) n_o_c = gsl_ran_poisson(rng,total_rec);
 
 	//for circular chromosomes make sure there is an even number of crossovers
 	if (circular) {
 		n_o_c *= 2;
 		n_o_c = (n_o_c < number_of_loci)?n_o_c:number_of_loci;	//make sure there are fewer xovers than loci
-		crossover_points.resize(n_o_c);
-		//choose xovers at random from the genome label list
-		//choose is expensive. could be replaced by simply random number followed by sorting
-		gsl_ran_choose(evo_generator,(void*) &crossover_points[0],n_o_c,genome,number_of_loci,sizeof(int));
+		if (2 * n_o_c > number_of_loci) {
+			//choose xovers at random from the genome label list
+			crossover_points.resize(n_o_c);
+			gsl_ran_choose(rng,(void*) &crossover_points[0],n_o_c,genome,number_of_loci,sizeof(int));
+		} else {
+			//few xovers: draw random loci and redraw the duplicates, which is much cheaper than choose
+			crossover_points.clear();
+			while ((int)crossover_points.size() < n_o_c) {
+				for (int i = crossover_points.size(); i < n_o_c; i++)
+					crossover_points.push_back(gsl_rng_uniform_int(rng, number_of_loci));
+				sort(crossover_points.begin(), crossover_points.end());
+				crossover_points.erase(unique(crossover_points.begin(), crossover_points.end()), crossover_points.end());
+			}
+		}
 		for(vector<int>::iterator cp_iter = crossover_points.begin(); cp_iter != crossover_points.end(); cp_iter++)
 			(*cp_iter)++; //increase all points by since crossover is after the selected locus
 	} else {
 		n_o_c = (n_o_c < number_of_loci)?n_o_c:(number_of_loci - 1);
 		crossover_points.resize(n_o_c);
 		for(vector<int>::iterator cp_iter = crossover_points.begin(); cp_iter != crossover_points.end(); cp_iter++)
-			(*cp_iter) = gsl_rng_uniform_int(evo_generator,number_of_loci - 1) + 1;
+			(*cp_iter) = gsl_rng_uniform_int(rng,number_of_loci - 1) + 1;
 		sort(crossover_points.begin(), crossover_points.end());
 	}
-
-	bool origin = true;
-	rec_pattern.clear();
-	//start with an empty bitset and extend to crossovers[c] with origing =0,1
-	if (HP_VERBOSE>2) cerr<<" n_o_c: "<<n_o_c<<" origin "<<origin<<endl;
-	for(vector<int>::iterator cp_iter = crossover_points.begin(); cp_iter != crossover_points.end(); cp_iter++) {
-		if (HP_VERBOSE>2) {
-			cerr<<" xo: "<<(*cp_iter)<<" origin "<<origin<<endl;
-			cerr<<rec_pattern<<endl;
-		}
-		rec_pattern.resize((*cp_iter), origin);
-		origin = !origin; //toggle origin
-	}
-	//extend to full length
-	if (HP_VERBOSE>2) {
-		cerr<<" xo: "<<" origin "<<origin;
-		cerr<<rec_pattern<<endl;
-	}
-	rec_pattern.resize(number_of_loci, origin);
-
-	if (HP_VERBOSE) {
-		cerr<<rec_pattern<<endl;
-		cerr <<"..done"<<endl;
-	}
-	return;
 }
 
 /**
  * @brief Produce a random reassortement pattern
  *
- * @returns reassortement pattern
- */
-void haploid_highd::reassortment_pattern() {
-	//the blocks of the bitset are to long for the rng, hence divide them by 4
-	//TODO: this looks quite suspicious
-	int bpblock = rec_pattern.bits_per_block / 4;
-	long unsigned int temp_rec_pattern=0;
-	int bits_left = number_of_loci, still_to_append;
-
-	//set the random bitset with bpblock at a time
-	rec_pattern.clear();
-	while(bits_left >= 4 * bpblock) {
-		temp_rec_pattern=gsl_rng_uniform_int(evo_generator, 1<<bpblock);
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<bpblock;
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<(2*bpblock);
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<(3*bpblock);
-		//cout <<bpblock<<"  "<<temp_rec_pattern<<endl;
-		rec_pattern.append(temp_rec_pattern);
-		bits_left-=4*bpblock;
-	}
-
-	//set the remaining bits in blocks of bpblock and the remainder until nothing is left
-	still_to_append = bits_left;
-	if (bits_left >= 3 * bpblock) {
-		temp_rec_pattern=gsl_rng_uniform_int(evo_generator, 1<<bpblock);
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<bpblock;
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<(2*bpblock);
-		bits_left-=3*bpblock;
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bits_left)<<(3*bpblock);
-	} else if (bits_left >= 2 * bpblock) {
-		temp_rec_pattern=gsl_rng_uniform_int(evo_generator, 1<<bpblock);
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bpblock)<<bpblock;
-		bits_left-=2*bpblock;
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bits_left)<<(2*bpblock);
-	} else if (bits_left >= bpblock) {
-		temp_rec_pattern=gsl_rng_uniform_int(evo_generator, 1<<bpblock);
-		bits_left-=bpblock;
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bits_left)<<bpblock;
-	} else
-		temp_rec_pattern+=gsl_rng_uniform_int(evo_generator, 1<<bits_left);
-
-	while (still_to_append) {
-		still_to_append--;
-		rec_pattern.push_back(((temp_rec_pattern&(1<<still_to_append))>0));
-	}
+ * @param rng random number generator to draw from
+ * @param pattern words to fill, one bit per locus
+ *
+ * The pattern is drawn one random 64-bit word per block of loci.
+ */
+void haploid_highd::reassortment_pattern(xoshiro256pp_t &rng, uint64_t *pattern) const {
+	size_t words = population.get_words();
+	for (size_t w = 0; w < words; w++)
+		pattern[w] = rng.next();
+	//loci beyond the end of the genome are not inherited
+	if (number_of_loci & 63)
+		pattern[words - 1] &= (((uint64_t)1) << (number_of_loci & 63)) - 1;
 }
 
 /**
- * @brief Produce and store a random sample of the population for stochastic processes
- *
- * @param size size of the sample
+ * @brief Build the alias table of the clones weighted by their sizes
  *
- * Produce a random sample of genotypes (labeled by their clone of origin)
- * which is to be used for mutations and sampling. The vector random_sample
- * exists for efficiency reasons, for it is faster to call the random number
- * generator once than many times.
+ * @returns zero if successful, error codes otherwise
  *
- * Note: if you want to get random clones, please use random_clone().
+ * The table is rebuilt lazily, at the first draw after the clone sizes have changed.
  */
-void haploid_highd::produce_random_sample(int size) {
-	if (HP_VERBOSE) cerr<<"haploid_highd::produce_random_sample(int): size "<<size<<"...";
-
-	random_sample.clear();
-	random_sample.reserve((size+50)*1.1);
-	int thechosen, o;
-	double frac = 1.1*(size+50)/population_size;
-	//loop over all clones and choose a poisson distributed number of genoytpes
-	unsigned int i = 0, cs;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++, i++) {
-		cs= pop_iter->clone_size;
-		if (cs > 0) {
-			thechosen = gsl_ran_poisson(evo_generator, frac*cs);
-			//make sure it is not larger than the clone itself.
-			thechosen = (pop_iter->clone_size < thechosen)?(cs):thechosen;
-			//add each of the chosen individually to the random_sample vector
-			if (thechosen) for (o = 0; o < thechosen; o++) random_sample.push_back(i);
+int haploid_highd::update_clone_sampler() {
+	vector <double> sizes;
+	sizes.reserve(number_of_clones);
+	sampler_clones.clear();
+	sampler_clones.reserve(number_of_clones);
+	int end_clone = min(last_clone + 1, (int)population.size());
+	for (int i = 0; i < end_clone; i++)
+		if (population.clone_size[i] > 0) {
+			sampler_clones.push_back(i);
+			sizes.push_back(population.clone_size[i]);
 		}
+	if (clone_sampler.set_up(sizes)) {
+		cerr <<"haploid_highd::update_clone_sampler(): population extinct!"<<endl;
+		return HP_EXTINCTERR;
 	}
-	gsl_ran_shuffle(evo_generator, &random_sample[0], random_sample.size(), sizeof(int));
-	if (HP_VERBOSE) cerr<<"done"<<endl;
+	clone_sampler_up_to_date = true;
+	return 0;
 }
 
 /**
  * @brief Get a random clone from the population
  *
- * @returns the index of the random clone
+ * @returns the index of the random clone, or NO_GENOTYPE if the population is extinct
  *
  * The probability density function from which the individual is chosen is flat over the
  * population (larger clones are proportionally more likely to be returned here).
  *
- * Note: for efficiency reasons, the class keeps a storage of random clone indices.
- * If you need much more than, say, 1000 random clones at a time, please call
- * produce_random_sample with the required size in advance.
+ * Each draw takes constant time, from an alias table of the clone sizes.
  */
 int haploid_highd::random_clone() {
-	int rclone;
-	int size = 1000;
-	if (random_sample.size() > 1) {
-		rclone=random_sample.back();
-		random_sample.pop_back();
-		return rclone;
-	} else {
-		//if no genotypes left in sample, produce new sample
-		produce_random_sample(min(population_size, size));
-		rclone=random_sample.back();
-		random_sample.pop_back();
-		return rclone;
-	}
+	if ((!clone_sampler_up_to_date) and update_clone_sampler())
+		return NO_GENOTYPE;
+	return sampler_clones[clone_sampler.draw(evo_generator)];
 }
 
 /**
@@ -1283,6 +1685,7 @@ int haploid_highd::random_clone() {
  *
  * @param n_o_individuals number of individuals to sample
  * @param sample pointer to vector where to put the result
+ * @param replacement whether the same individual may be sampled more than once
  *
  * @returns zero if successful, nonzero otherwise
  *
@@ -1291,11 +1694,40 @@ int haploid_highd::random_clone() {
  * In any case, clone numbers of the sampled individuals are appended to *sample. Hence,
  * you can use this function iteratively (although there might not be a good reason to
  * do so).
+ *
+ * With replacement, each individual is drawn in constant time (see random_clone). Without
+ * replacement, the numbers of sampled individuals of all clones are drawn at once by conditional
+ * hypergeometric numbers, and the sample is shuffled; at most the whole population can be sampled.
  */
-int haploid_highd::random_clones(unsigned int n_o_individuals, vector <int> *sample) {
-	sample->reserve(n_o_individuals);
-	for(size_t i=0; i< n_o_individuals; i++)
-		sample->push_back(random_clone());
+int haploid_highd::random_clones(unsigned int n_o_individuals, vector <int> *sample, bool replacement) {
+	if (replacement) {
+		if ((!clone_sampler_up_to_date) and update_clone_sampler())
+			return HP_EXTINCTERR;
+		sample->reserve(sample->size() + n_o_individuals);
+		for(size_t i=0; i< n_o_individuals; i++)
+			sample->push_back(sampler_clones[clone_sampler.draw(evo_generator)]);
+		return 0;
+	}
+
+	if (n_o_individuals > (unsigned int)population_size) {
+		cerr <<"haploid_highd::random_clones(): cannot sample "<<n_o_individuals<<" individuals without replacement from "<<population_size<<endl;
+		return HP_BADARG;
+	}
+	size_t first = sample->size();
+	sample->reserve(first + n_o_individuals);
+	unsigned int remaining = n_o_individuals, others = population_size;
+	int end_clone = min(last_clone + 1, (int)population.size());
+	for (int i = 0; (i < end_clone) and (remaining > 0); i++) {
+		unsigned int cs = population.clone_size[i];
+		if (cs > 0) {
+			others -= cs;
+			unsigned int chosen = gsl_ran_hypergeometric(evo_generator, cs, others, remaining);
+			sample->insert(sample->end(), chosen, i);
+			remaining -= chosen;
+		}
+	}
+	if (n_o_individuals > 1)
+		gsl_ran_shuffle(evo_generator, &(*sample)[first], n_o_individuals, sizeof(int));
 	return 0;
 }
 
@@ -1312,22 +1744,32 @@ void haploid_highd::add_genotype(boost::dynamic_bitset<> genotype, int n) {
 		allele_frequencies_up_to_date = false;
 		if (available_clones.size() == 0)
 			provide_at_least(1);
-		int new_gt = available_clones.back();
-		available_clones.pop_back();
-
-		population[new_gt].genotype = genotype;
-		population[new_gt].clone_size = n;
-		calc_individual_traits(population[new_gt]);
-		calc_individual_fitness_from_traits(population[new_gt]);
-		check_individual_maximal_fitness(population[new_gt]);
+		int new_gt = available_clones.acquire();
 
+		population.set_genotype(new_gt, genotype);
 		population_size += n;
+
+		// a genotype that is already present joins the existing clone
+		int existing = deduplicating() ? find_duplicate_clone(new_gt) : -1;
+		if (existing >= 0) {
+			available_clones.release(new_gt);
+			population.clone_size[existing] += n;
+			update_allele_counts(existing, n);
+			return;
+		}
+
+		population.clone_size[new_gt] = n;
+		update_allele_counts(new_gt, n);
+		calc_individual_traits(new_gt);
+		calc_individual_fitness_from_traits(new_gt);
+		check_individual_maximal_fitness(new_gt);
+
 		last_clone = (new_gt < last_clone)?last_clone:new_gt;
 		number_of_clones++;
 
 		if (track_genealogy) {
 			node_t leaf;
-			leaf.fitness = population[new_gt].fitness;
+			leaf.fitness = population.fitness[new_gt];
 			leaf.own_key.age=generation;
 			leaf.own_key.index=new_gt;
 			leaf.number_of_offspring = 1;
@@ -1351,7 +1793,8 @@ void haploid_highd::add_genotype(boost::dynamic_bitset<> genotype, int n) {
 double haploid_highd::relaxation_value() {
 	if (HP_VERBOSE) cerr <<"haploid_highd::relaxation_value()...";
 
-	double logmean_expfitness = get_logmean_expfitness();
+	//one sweep over the clones updates the exp-average of fitness and fitness_max
+	calc_clone_stat(false);
 	// the second term is the growth rate when we start from N << carrying capacity
 	double relax = logmean_expfitness + (fmin(log(growth_rate)*(double(population_size) / carrying_capacity - 1), 2.0)) + fitness_max;
 	if (HP_VERBOSE)	cerr<<"log(<exp(F-Fmax)>) = "<<logmean_expfitness<<"... relaxation value = "<<relax<<"...done."<<endl;
@@ -1359,125 +1802,127 @@ double haploid_highd::relaxation_value() {
 }
 
 /**
- * @brief Calculate and store fitness population statistics
+ * @brief Partial sums of a sweep over a block of clones
  *
- * The fitness statistics are stored in fitness_stat.
+ * The blocks are merged in order, so that the sums do not depend on the number of threads.
+ */
+struct clone_stat_block_t {
+	int population_size;
+	double fitness_sum;
+	double fitness_square_sum;
+	double weight_sum;
+	double fitness_max;
+	vector <double> trait_sums;	// sums of the traits, followed by the sums of their pairwise products
+	clone_stat_block_t() : population_size(0), fitness_sum(0), fitness_square_sum(0), weight_sum(0), fitness_max(HP_VERY_NEGATIVE) {};
+};
+
+/**
+ * @brief Calculate and store population statistics of fitness and, optionally, of the traits
+ *
+ * @param traits whether to calculate trait statistics and covariances as well
+ *
+ * A single sweep over the clones yields population_size, fitness_max, fitness_stat and logmean_expfitness,
+ * and trait_stat and trait_covariance if requested. The exp-average of fitness is summed from the cached
+ * selection weights of the clones, without any exponentials. The clones are swept in blocks of
+ * HP_CLONES_PER_BLOCK, possibly on several threads.
  *
- * *Note*: this function assumes that fitness is up to date. If you are not sure, call update_traits() and update_fitness() first.
+ * *Note*: this function assumes that traits and fitness are up to date. If you are not sure, call update_traits_and_fitness() first.
  */
-void haploid_highd::calc_fitness_stat() {
-	if (HP_VERBOSE) {cerr <<"haploid_highd::calc_fitness_stat()...";}
+void haploid_highd::calc_clone_stat(bool traits) {
+	if (HP_VERBOSE) {cerr <<"haploid_highd::calc_clone_stat()...";}
+
+	int n_traits = traits ? number_of_traits : 0;
+	int end_clone = min(last_clone + 1, (int)population.size());
+	int n_blocks = end_clone / HP_CLONES_PER_BLOCK + 1;
+	vector <clone_stat_block_t> blocks(n_blocks);
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for (int b = 0; b < n_blocks; b++) {
+		clone_stat_block_t &block = blocks[b];
+		block.trait_sums.assign(n_traits * (n_traits + 1), 0);
+		for (int i = b * HP_CLONES_PER_BLOCK; i < min((b + 1) * HP_CLONES_PER_BLOCK, end_clone); i++) {
+			int csize = population.clone_size[i];
+			if (csize > 0) {
+				double temp = population.fitness[i];
+				block.population_size += csize;
+				block.fitness_sum += temp * csize;
+				block.fitness_square_sum += temp * temp * csize;
+				block.weight_sum += population.fitness_weight[i] * csize;
+				block.fitness_max = fmax(block.fitness_max, temp);
+				const double *clone_traits = population.trait(i);
+				for (int t = 0; t < n_traits; t++) {
+					block.trait_sums[t] += clone_traits[t] * csize;
+					for (int t1 = 0; t1 < n_traits; t1++)
+						block.trait_sums[n_traits * (t + 1) + t1] += clone_traits[t] * clone_traits[t1] * csize;
+				}
+			}
+		}
+	}
 
-	double temp;
-	int csize;
-	fitness_stat.mean = 0;
-	fitness_stat.variance = 0;
+	//merge the blocks in order
+	double fitness_sum = 0, fitness_square_sum = 0, weight_sum = 0;
+	vector <double> trait_sums(n_traits * (n_traits + 1), 0);
 	population_size = 0;
-	//loop over clones and add stuff up
-	unsigned int i = 0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++, i++) {
-		csize = pop_iter->clone_size;
-		if (csize > 0) {
-			temp = pop_iter->fitness;
-			fitness_stat.mean += temp * csize;
-			fitness_stat.variance += temp * temp * csize;
-			population_size += csize;
-		}
+	fitness_max = HP_VERY_NEGATIVE;
+	for (vector<clone_stat_block_t>::iterator block = blocks.begin(); block != blocks.end(); block++) {
+		population_size += block->population_size;
+		fitness_sum += block->fitness_sum;
+		fitness_square_sum += block->fitness_square_sum;
+		weight_sum += block->weight_sum;
+		fitness_max = fmax(fitness_max, block->fitness_max);
+		for (size_t k = 0; k < trait_sums.size(); k++)
+			trait_sums[k] += block->trait_sums[k];
 	}
 
+	//complain if population went extinct
 	if (population_size == 0)
-		cerr <<"haploid_highd::calc_fitness_stat(): population extinct! clones: "<<population.size()<<endl;
+		cerr <<"haploid_highd::calc_clone_stat(): population extinct! clones: "<<population.size()<<endl;
+
+	//the weights are summed again if their reference had to be moved
+	if (rebase_fitness_weights()) {
+		weight_sum = 0;
+		for (int i = 0; i < end_clone; i++)
+			if (population.clone_size[i] > 0)
+				weight_sum += population.fitness_weight[i] * population.clone_size[i];
+	}
 
-	//if (HP_VERBOSE) {cerr <<"pop size: "<<population_size<<", sum of fitnesses: "<<fitness_stat.mean<<"...";}
-	fitness_stat.mean /= population_size;
-	fitness_stat.variance /= population_size;
-	fitness_stat.variance -= fitness_stat.mean * fitness_stat.mean;
+	//normalize
+	fitness_stat.mean = fitness_sum / population_size;
+	fitness_stat.variance = fitness_square_sum / population_size - fitness_stat.mean * fitness_stat.mean;
+	logmean_expfitness = log(weight_sum / population_size) + weight_reference - fitness_max;
+	for (int t = 0; t < n_traits; t++) {
+		trait_stat[t].mean = trait_sums[t] / population_size;
+		trait_stat[t].variance = trait_sums[n_traits * (t + 1) + t] / population_size - trait_stat[t].mean * trait_stat[t].mean;
+	}
+	for (int t = 0; t < n_traits; t++)
+		for (int t1 = 0; t1 < n_traits; t1++)
+			trait_covariance[t][t1] = trait_sums[n_traits * (t + 1) + t1] / population_size - trait_stat[t].mean * trait_stat[t1].mean;
 
 	if (HP_VERBOSE) cerr <<"done."<<endl;
 }
 
-
 /**
- * @brief Get the population exp-average of fitness, used for keeping the population size fixed
+ * @brief Move the reference of the selection weights to fitness_max, if it has drifted too far
  *
- * @returns the population exp-average of fitness
- *
- * Mathematically, this is \f$ \log\left( \left< e^(F-F_{max}) \right> \right) \f$. The baseline is \f$ F_{max} \f$
- * in order to avoid exponentiating large numbers.
+ * @returns true if the weights have been recalculated
  *
+ * The selection weights exp(fitness - weight_reference) are cached with the clones. They are
+ * recalculated only when fitness_max moves by more than HP_WEIGHT_RANGE from the reference,
+ * so that neither the weights nor their sums overflow or underflow.
  */
-double haploid_highd::get_logmean_expfitness() {
-	if (HP_VERBOSE) cerr <<"haploid_highd::get_logmean_expfitness()...";
-
-	double logmean_expfitness = 0;
-	//loop over clones and add stuff up
-	unsigned int i=0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++,i++)
-		if (pop_iter->clone_size > 0)
-			logmean_expfitness += pop_iter->clone_size * exp(pop_iter->fitness - fitness_max);
-	logmean_expfitness /= population_size;
-	logmean_expfitness = log(logmean_expfitness);
-	if (HP_VERBOSE) cerr <<"done."<<endl;
-	return logmean_expfitness;
-}
-
-
-/**
- * @brief Calculate and store trait population statistics and covariances
- *
- * The traits statistics are stored in traits_stat.
- *
- * *Note*: this function assumes that traits are up to date. If you are not sure, call update_traits() first.
- */
-void haploid_highd::calc_trait_stat() {
-	if (HP_VERBOSE) {cerr <<"haploid_highd::calc_trait_stat()...";}
-	double temp,temp1;
-	int t,t1, csize;
-	population_size=0;
-
-	// reset class attributes
-	for(t = 0; t < number_of_traits; t++) {
-		trait_stat[t].mean = 0;
-		trait_stat[t].variance = 0;
-		for(t1=0; t1<number_of_traits; t1++)
-			trait_covariance[t][t1] = 0;
-	}
-
-	//loop over clones and add stuff up
-	unsigned int i=0;
-	for(vector<clone_t>::iterator pop_iter = population.begin(); pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++,i++) {
-		csize = pop_iter->clone_size;
-		if (csize>0) {
-			for(t = 0; t < number_of_traits; t++) {
-				temp = pop_iter->trait[t];
-				trait_stat[t].mean += temp * csize;
-				trait_stat[t].variance += temp * temp * csize;
-				for(t1 = 0; t1 < number_of_traits; t1++) {
-					temp1 = pop_iter->trait[t1];
-					trait_covariance[t][t1] += temp * temp1 * csize;
-				}
-			}
-			population_size += csize;
-		}
-	}
-	//complain if population went extinct
-	if (population_size == 0)
-		cerr <<"haploid_highd::calc_trait_stat(): population extinct! clones: "<<population.size()<<endl;
-
-	//normalize the means and variances
-	for(t = 0; t < number_of_traits; t++) {
-		trait_stat[t].mean /= population_size;
-		trait_stat[t].variance /= population_size;
-		trait_stat[t].variance -= trait_stat[t].mean * trait_stat[t].mean;
-	}
-	//calculate the covariances
-	for(t = 0; t < number_of_traits; t++)
-		for(t1 = 0; t1 < number_of_traits; t1++) {
-			trait_covariance[t][t1] /= population_size;
-			trait_covariance[t][t1] -= trait_stat[t].mean * trait_stat[t1].mean;
-		}
-
-	if (HP_VERBOSE) {cerr <<"done"<<endl;}
+bool haploid_highd::rebase_fitness_weights() {
+	if ((population_size == 0) or (fabs(fitness_max - weight_reference) <= HP_WEIGHT_RANGE))
+		return false;
+	if (HP_VERBOSE) cerr <<"haploid_highd::rebase_fitness_weights(): new reference "<<fitness_max<<endl;
+	weight_reference = fitness_max;
+	int end_clone = population.size();
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < end_clone; i++)
+		population.fitness_weight[i] = exp(population.fitness[i] - weight_reference);
+	return true;
 }
 
 /**
@@ -1533,7 +1978,9 @@ int haploid_highd::read_ms_sample(istream &gts, int skip_locus, int multiplicity
 	boost::dynamic_bitset<> newgt(number_of_loci);
 	//reset population
 	population.clear();
-	random_sample.clear();
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
+	clone_sampler_up_to_date = false;
 	population_size = 0;
 	if (mem) {
 		set_wildtype(0);
@@ -1619,7 +2066,9 @@ int haploid_highd::read_ms_sample_sparse(istream &gts, int skip_locus, int multi
 	boost::dynamic_bitset<> newgt(number_of_loci);
 	//reset population
 	population.clear();
-	random_sample.clear();
+	allele_counts_up_to_date = false;
+	clone_index.up_to_date = false;
+	clone_sampler_up_to_date = false;
 	population_size = 0;
 	if (mem) {
 		set_wildtype(0);
@@ -1719,6 +2168,26 @@ int haploid_highd::distance_Hamming(boost::dynamic_bitset<> gt1, boost::dynamic_
 }
 
 
+/**
+ * @brief Calculate Hamming distance between the genotypes of two clones
+ *
+ * @param clone1 index of the first clone
+ * @param clone2 index of the second clone
+ * @param chunks (pointer to) vector of ranges (C pairs), see the overload taking bitsets
+ * @param every check only every X sites, starting from the first of each chunk
+ *
+ * @returns Hamming distance, not normalized
+ *
+ * Without chunks, the distance is computed directly on the packed genotypes.
+ */
+int haploid_highd::distance_Hamming(unsigned int clone1, unsigned int clone2, vector <unsigned int *> *chunks, unsigned int every) {
+	if((!chunks) or (chunks->size() == 0)) {
+		if(every!=1) return HP_BADARG;
+		else return population.distance(clone1, clone2);
+	}
+	return distance_Hamming(population.get_genotype(clone1), population.get_genotype(clone2), chunks, every);
+}
+
 /**
  * @brief Calculate the cumulative partition of sequences into clones
  *
@@ -1737,10 +2206,9 @@ int haploid_highd::partition_cumulative(vector <unsigned int> &partition_cum) {
 		return HP_EXTINCTERR;
 
 	partition_cum.clear();
-	partition_cum.push_back(population[0].clone_size);
-	if(population.size() > 1) 
-		for(vector<clone_t>::iterator pop_iter = population.begin() + 1; pop_iter != population.end(); pop_iter++)
-			partition_cum.push_back(pop_iter->clone_size + partition_cum.back());
+	partition_cum.push_back(population.clone_size[0]);
+	for(size_t i = 1; i < population.size(); i++)
+		partition_cum.push_back(population.clone_size[i] + partition_cum.back());
 	return 0;
 }
 
@@ -1749,17 +2217,16 @@ int haploid_highd::partition_cumulative(vector <unsigned int> &partition_cum) {
  *
  * @param n_sample size of the statistical sample to use (the whole pop is often too large)
  *
- * @returns mean and variance of the divergence in a stat_t 
+ * @returns mean and variance of the divergence in a stat_t (zero if the population is extinct)
  */
 stat_t haploid_highd::get_divergence_statistics(unsigned int n_sample) {
 	stat_t div;
 	unsigned int tmp;
 	vector <int> clones;
-	produce_random_sample(n_sample);
-	random_clones(n_sample, &clones);
+	if (random_clones(n_sample, &clones)) return div;
 
 	for (size_t i = 0; i < n_sample; i++) {
-		tmp = (population[clones[i]].genotype).count();
+		tmp = population.count(clones[i]);
 		div.mean += tmp;
 		div.variance += tmp * tmp;
 	}
@@ -1774,16 +2241,14 @@ stat_t haploid_highd::get_divergence_statistics(unsigned int n_sample) {
  *
  * @param n_sample size of the statistical sample to use (the whole pop is often too large)
  *
- * @returns mean and variance of the diversity in a stat_t
+ * @returns mean and variance of the diversity in a stat_t (zero if the population is extinct)
  */
 stat_t haploid_highd::get_diversity_statistics(unsigned int n_sample) {
 	stat_t div;
 	unsigned int tmp;
 	vector <int> clones1;
 	vector <int> clones2;
-	produce_random_sample(n_sample * 2);
-	random_clones(n_sample, &clones1);
-	random_clones(n_sample, &clones2);
+	if (random_clones(n_sample, &clones1) or random_clones(n_sample, &clones2)) return div;
 
 	for (size_t i = 0; i < n_sample; i++) {
 		if (clones1[i] != clones2[i]) {
@@ -1827,10 +2292,10 @@ int haploid_highd::get_fitness_histogram(gsl_histogram **hist, unsigned int bins
 	// Calculate fitness of the sample
 	double fitnesses[n_sample];
 	vector <int> clones;
-	produce_random_sample(n_sample);
-	random_clones(n_sample, &clones);
+	int err = random_clones(n_sample, &clones);
+	if (err) return err;
 	for(size_t i = 0; i < n_sample; i++)
-		fitnesses[i] = population[clones[i]].fitness;
+		fitnesses[i] = population.fitness[clones[i]];
 
 	// Set the bins according to average and variance in fitness in the population
 	calc_fitness_stat();
@@ -1902,10 +2367,13 @@ int haploid_highd::get_divergence_histogram(gsl_histogram **hist, unsigned int b
 	int temp;
 	unsigned int divs[n_sample];
 	vector <int> clones;
-	produce_random_sample(n_sample);
-	random_clones(n_sample, &clones);
+	int err = random_clones(n_sample, &clones);
+	if (err) return err;
 	for(size_t i = 0; i < n_sample; i++) {
-		temp = distance_Hamming(gt_wt, population[clones[i]].genotype, chunks, every);
+		if((!chunks) or (chunks->size() == 0))
+			temp = (every != 1) ? HP_BADARG : population.count(clones[i]);
+		else
+			temp = distance_Hamming(gt_wt, population.get_genotype(clones[i]), chunks, every);
 		// negative distances are error codes
 		if(temp < 0) return temp;
 		else divs[i] = temp;
@@ -1975,9 +2443,9 @@ int haploid_highd::get_diversity_histogram(gsl_histogram **hist, unsigned int bi
 	unsigned int divs[n_sample];
 	vector <int> clones1;
 	vector <int> clones2;
-	produce_random_sample(n_sample * 2);
-	random_clones(n_sample, &clones1);
-	random_clones(n_sample, &clones2);
+	int err = random_clones(n_sample, &clones1);
+	if (!err) err = random_clones(n_sample, &clones2);
+	if (err) return err;
 	for(size_t i = 0; i < n_sample; i++) {
 		temp = distance_Hamming(clones1[i], clones2[i], chunks, every);
 		// negative distances are error codes
@@ -2014,62 +2482,208 @@ int haploid_highd::get_diversity_histogram(gsl_histogram **hist, unsigned int bi
 	return 0;
 }
 
+/**
+ * @brief Order of clones by fitness first and genotype last, ties broken by index
+ */
+struct clone_order_t {
+	const clone_store &population;
+	clone_order_t(const clone_store &population_in) : population(population_in) {};
+	bool operator()(int i, int j) const {
+		if (population.fitness[i] != population.fitness[j]) return population.fitness[i] < population.fitness[j];
+		int c = population.compare_genotypes(i, j);
+		if (c) return c < 0;
+		return i < j;
+	}
+};
+
 /**
  * @brief Remove duplicate clones.
  *
  * The library does not usually check whether two clones with the same genotype are present, but
  * this can happen in case of recurrent mutation. This function merges duplicates.
  *
+ * The clones are sorted by index rather than moved in the store, and each group of duplicates is
+ * merged into its member with the lowest index.
+ *
  * *Note*: this is only needed for studying the clone structure. Evolution itself does not need to
- * make sure that clones are unique.
+ * make sure that clones are unique, but see set_clone_deduplication().
  */
 void haploid_highd::unique_clones() {
-	random_sample.clear();
+	clone_sampler_up_to_date = false;
 	number_of_clones = 0;
 	population_size = 0;
 	int new_last_clone = 0;
 	if(population.size() > 1) {
 		// sort them O(nlog(n))
-		sort(population.begin(), population.begin() + last_clone + 1);
-		sort(available_clones.begin(), available_clones.end(), std::greater<int>());
-		reverse(population.begin(), population.begin() + last_clone + 1);
-		//available_clones.clear();
-		while (available_clones.back() < last_clone+1) available_clones.pop_back();
+		vector <int> order = get_nonempty_clones();
+		sort(order.begin(), order.end(), clone_order_t(population));
 		// merge clones with the same fitness and genotype
-		vector<clone_t>::iterator pop_iter = population.begin();
-		unsigned int i = 0;
-		while (pop_iter->clone_size == 0) {
-			pop_iter++;
-			i++;
-		}
-		clone_t  *current_last_clone = &(*pop_iter);
-		number_of_clones++;
-		new_last_clone = i;
-		population_size += pop_iter->clone_size;
-		pop_iter++;
-		i++;
-		for(; pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++,i++) {
-		//for(; pop_iter != population.end(); pop_iter++,i++) {
-			if (pop_iter->clone_size > 0){
-				if((*pop_iter) == (*current_last_clone)) {
-					current_last_clone->clone_size += pop_iter->clone_size;
-					available_clones.push_back(i);
-					population_size += pop_iter->clone_size;
-					pop_iter->clone_size=0;
-				} else {
-					current_last_clone= &(*pop_iter);
-					number_of_clones++;
-					population_size += pop_iter->clone_size;
-					new_last_clone = i;
-				}
-			} else
-				available_clones.push_back(i);
+		int current = -1;
+		for(vector<int>::iterator c = order.begin(); c != order.end(); c++) {
+			population_size += population.clone_size[*c];
+			if((current >= 0) and (population.fitness[*c] == population.fitness[current]) and (population.compare_genotypes(*c, current) == 0)) {
+				population.clone_size[current] += population.clone_size[*c];
+				population.clone_size[*c] = 0;
+				available_clones.release(*c);
+			} else {
+				current = *c;
+				number_of_clones++;
+			}
 		}
-		sort(available_clones.begin(), available_clones.end(), std::greater<int>());
+		for(int i = min(last_clone, (int)population.size() - 1); i >= 0; i--)
+			if(population.clone_size[i] > 0) {new_last_clone = i; break;}
 		last_clone=new_last_clone;
 	}
 }
 
+/**
+ * @brief Move all clones into a dense prefix of the clone slots
+ *
+ * The nonempty clones with the highest indices are moved into the empty slots with the lowest
+ * indices, until all nonempty clones precede all empty ones. Loops over clones, which run up to
+ * last_clone, then take a time proportional to the number of clones rather than to the largest
+ * number of clones in the past. Clones are relabelled, hence the outcome of later random
+ * draws changes, but not its distribution.
+ *
+ * If the genealogy is tracked, the leafs of the moved clones are renamed in all trees, so that the
+ * index of a leaf remains the index of its clone. Slots that still label a leaf are skipped. evolve()
+ * calls this function after a generation whenever less than min_occupancy of the slots up to
+ * last_clone are occupied.
+ *
+ * *Note*: this must be called between generations.
+ */
+void haploid_highd::compact_clones() {
+	if (HP_VERBOSE) cerr <<"haploid_highd::compact_clones()...";
+	clone_sampler_up_to_date = false;
+	tree_key_t old_key, new_key;
+	old_key.age = new_key.age = generation - 1;
+	int dest = 0, src = min(last_clone + 1, (int)population.size()) - 1;
+	while (true) {
+		while ((dest < src) and ((population.clone_size[dest] > 0) or leaf_in_use(dest))) dest++;
+		while ((src > dest) and (population.clone_size[src] <= 0)) src--;
+		if (dest >= src) break;
+		population.move_clone(dest, src);
+		if (track_genealogy) {
+			old_key.index = src;
+			new_key.index = dest;
+			for (unsigned int locus=0; locus<genealogy.loci.size(); locus++) {
+				if (genealogy.trees[locus].check_node(old_key))
+					genealogy.trees[locus].rename_leaf(old_key, new_key);
+				genealogy.newGenerations[locus][dest] = genealogy.newGenerations[locus][src];
+				genealogy.newGenerations[locus][dest].own_key.index = dest;
+				genealogy.newGenerations[locus][src].clone_size = 0;
+			}
+		}
+		dest++;
+		src--;
+	}
+	// the slots after the last clone are all free
+	last_clone = 0;
+	for (int i = min(dest + 1, (int)population.size() - 1); i >= 0; i--)
+		if (population.clone_size[i] > 0) {last_clone = i; break;}
+	available_clones.clear();
+	for (size_t i = 0; i < population.size(); i++)
+		if (population.clone_size[i] <= 0) available_clones.release(i);
+	clone_index.up_to_date = false;
+	if (HP_VERBOSE) cerr <<"done, last clone: "<<last_clone<<endl;
+}
+
+/**
+ * @brief Check whether a clone slot labels a leaf of a tracked genealogy
+ *
+ * @param clone slot to check
+ *
+ * @returns true if any tree has a leaf of the last generation with this index
+ */
+bool haploid_highd::leaf_in_use(int clone) {
+	if (!track_genealogy) return false;
+	tree_key_t key;
+	key.age = generation - 1;
+	key.index = clone;
+	for (unsigned int locus=0; locus<genealogy.loci.size(); locus++)
+		if (genealogy.trees[locus].check_node(key)) return true;
+	return false;
+}
+
+/**
+ * @brief Set a mutation rate for each locus
+ *
+ * @param rates mutation rates, one per locus
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The loci to mutate are drawn from an alias table in constant time. The mean rate is
+ * reported by get_mutation_rate(); set_mutation_rate() makes all rates equal again.
+ */
+int haploid_highd::set_mutation_rates(vector <double> rates) {
+	if (all_polymorphic) {
+		if(HP_VERBOSE) cerr<<"Cannot set the mutation rate with all_polymorphic."<<endl;
+		return HP_BADARG;
+	}
+	if (((int)rates.size() != number_of_loci) or mutation_loci.set_up(rates)) {
+		if(HP_VERBOSE) cerr<<"haploid_highd::set_mutation_rates(): expected "<<number_of_loci<<" nonnegative rates, not all zero"<<endl;
+		return HP_BADARG;
+	}
+	mutation_rate_map = rates;
+	mutation_rate = mutation_loci.total / number_of_loci;
+	return 0;
+}
+
+/**
+ * @brief Get the mutation rate of each locus
+ *
+ * @returns mutation rates, one per locus
+ */
+vector <double> haploid_highd::get_mutation_rates() {
+	if (mutation_rate_map.size()) return mutation_rate_map;
+	return vector <double>(number_of_loci, mutation_rate);
+}
+
+/**
+ * @brief Merge clones with identical genotypes as they arise
+ *
+ * @param deduplicate whether to merge
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * When switched on, a hash index from genotypes to clones is kept, and new mutants, recombinants
+ * and added genotypes that are identical to an existing clone increase its size instead of occupying
+ * a new clone. Existing duplicates are merged first (see unique_clones()). This keeps the number of
+ * clones, and hence the cost of every loop over clones, as small as possible when many identical
+ * genotypes arise, e.g. with short genomes or high mutation rates.
+ *
+ * *Note*: merging clones is not compatible with tracking the genealogy, which follows individual clones.
+ */
+int haploid_highd::set_clone_deduplication(bool deduplicate) {
+	if (deduplicate and track_genealogy) {
+		cerr <<"haploid_highd::set_clone_deduplication(): clones cannot be merged when the genealogy is tracked"<<endl;
+		return HP_BADARG;
+	}
+	if (deduplicate and !clone_deduplication) {
+		if (get_number_of_clones() > 0) unique_clones();
+		clone_index.up_to_date = false;
+	}
+	clone_deduplication = deduplicate;
+	return 0;
+}
+
+/**
+ * @brief Look up an existing clone with the genotype of a new clone
+ *
+ * @param new_clone clone slot holding the new genotype, still empty
+ *
+ * @returns a nonempty clone with the same genotype, or -1 if there is none. In the latter case,
+ * new_clone is entered in the index and must be made nonempty by the caller.
+ */
+int haploid_highd::find_duplicate_clone(int new_clone) {
+	if (!clone_index.up_to_date)
+		clone_index.rebuild(population, min(last_clone + 1, (int)population.size()));
+	uint64_t hash = population.hash_genotype(new_clone);
+	int existing = clone_index.find(population, new_clone, hash);
+	if (existing < 0) clone_index.insert(population, new_clone, hash);
+	return existing;
+}
+
 /**
  * @brief Obtain a list of the good clones.
  *
@@ -2078,10 +2692,9 @@ void haploid_highd::unique_clones() {
 vector <int> haploid_highd::get_nonempty_clones() {
 	vector <int> good;
 	good.reserve(population.size());
-	unsigned int i = 0;
-	vector<clone_t>::iterator pop_iter = population.begin();
-	for(; pop_iter != population.end() && (i < (unsigned int)(last_clone + 1)); pop_iter++,i++)
-		if(pop_iter->clone_size)
+	unsigned int end_clone = min((unsigned int)(last_clone + 1), (unsigned int)population.size());
+	for(unsigned int i = 0; i < end_clone; i++)
+		if(population.clone_size[i])
 			good.push_back(i);
 	return good;
 }
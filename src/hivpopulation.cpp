@@ -69,12 +69,14 @@ hivpopulation::~hivpopulation() {
 
 
 /**
- * @brief Set the fitness from replication and resistance for a single clone
+ * @brief Fitness from replication and resistance
  *
- * @param tempgt clone whose fitness is calculated
+ * @param traits replication (trait 0) and resistance (trait 1) of a clone
+ *
+ * @returns the fitness of the clone under the current treatment
  */
-void hivpopulation::calc_individual_fitness_from_traits(clone_t *tempgt) {
-	tempgt->fitness = tempgt->trait[0] + treatment * tempgt->trait[1];
+double hivpopulation::calc_fitness_from_traits(const double *traits) {
+	return traits[0] + treatment * traits[1];
 }
 
 
@@ -111,8 +113,7 @@ int hivpopulation::read_replication_coefficients(istream &model){
 	}
 
 	// update the replication and fitness of all clones
-	update_traits();
-	update_fitness();
+	update_traits_and_fitness();
 
 	if (HIVPOP_VERBOSE) cerr<<"...done"<<endl;
 	return 0;
@@ -157,8 +158,7 @@ int hivpopulation::read_resistance_coefficients(istream &model){
 	trait[1].hypercube_mean=-wt_resistance;
 
 	// update the replication and fitness of all clones
-	update_traits();
-	update_fitness();
+	update_traits_and_fitness();
 
 	if (HIVPOP_VERBOSE){
 		cerr<<"...done"<<endl;
@@ -181,16 +181,21 @@ int hivpopulation::write_genotypes(ostream &out, int sample_size, string gt_labe
 		if (length <= 0)
 			length = number_of_loci - start;
 
-		produce_random_sample(sample_size);
+		vector <int> sample;
 		if (sample_size>get_population_size()){
 			cerr<<"hivpopulation::write_genotypes(): requested sample size exceeds population size"<<endl;
 			return HIVPOP_BADARG;
 		}else{
+			//distinct individuals
+			if (random_clones(sample_size, &sample, false)) {
+				cerr<<"hivpopulation::write_genotypes(): cannot sample the population"<<endl;
+				return HIVPOP_BADARG;
+			}
 			for (int s=0; s<sample_size; s++){
-				gti=random_clone();
+				gti=sample[s];
 				out <<">GT-"<<gt_label<<"_"<<gti<<'\n';
 				for (int i =start; i<start+length; i++ ){
-					if (population[gti].genotype[i]) out <<'1';
+					if (population.get_locus(gti, i)) out <<'1';
 					else out <<'0';
 				}
 				out<<'\n';
@@ -116,7 +116,7 @@ public:
 	hivgene rev;
 
 	// treatment (set/get)
-	void set_treatment(double t){treatment=t; update_traits(); update_fitness();}
+	void set_treatment(double t){treatment=t; update_fitness();}	// traits do not depend on the treatment
 	double get_treatment() {return treatment;}
 
 	// stream I/O
@@ -126,7 +126,11 @@ public:
 
 protected:
 	// fitness landscape
-	virtual void calc_individual_fitness_from_traits(clone_t *tempgt);
+	virtual double calc_fitness_from_traits(const double *traits);
+
+	// the treatment is saved in checkpoints
+	virtual void get_checkpoint_extra(vector <double> &values) {values.assign(1, treatment);}
+	virtual int set_checkpoint_extra(const vector <double> &values) {if (values.size() != 1) return HIVPOP_BADARG; treatment = values[0]; return 0;}
 
 private:
 	//random number generator
@@ -82,6 +82,9 @@ int hypercube_highd::allocate_mem() {
 
 	// static single locus coefficients
 	coefficients_single_locus_static = vector<double>(dim, 0);
+	additive_up_to_date = false;
+	epistasis.clear();
+	epistasis_by_locus.assign(dim, vector<int>());
 
 	mem=true;
 	if (HCF_VERBOSE) cerr<<"done.\n";
@@ -99,6 +102,177 @@ int hypercube_highd::free_mem() {
  	return 0;
 }
 
+// test a locus of a genotype packed into 64-bit words (see clone_store)
+#define HC_LOCUS(genotype, locus) (((genotype)[(locus) >> 6] >> ((locus) & 63)) & 1)
+
+/*
+ * Read-only views of a genotype, used to share the evaluation loops between representations
+ */
+struct packed_genotype_t {
+	const uint64_t *words;
+	packed_genotype_t(const uint64_t *words_in) : words(words_in) {};
+	bool operator[](int locus) const {return HC_LOCUS(words, locus);}
+	// the parity of the unset loci of an epistatic term, from its (word, mask) pairs
+	bool negative(const epistasis_terms_t &terms, size_t t) const {
+		uint64_t unset = 0;
+		for (int p = terms.mask_offsets[t]; p < terms.mask_offsets[t + 1]; p++)
+			unset ^= ~words[terms.mask_words[p]] & terms.masks[p];
+		return __builtin_parityll(unset);
+	}
+};
+
+struct sparse_genotype_t {
+	const vector<int> &derived_loci;
+	sparse_genotype_t(const vector<int> &derived_loci_in) : derived_loci(derived_loci_in) {};
+	bool operator[](int locus) const {return binary_search(derived_loci.begin(), derived_loci.end(), locus);}
+	bool negative(const epistasis_terms_t &terms, size_t t) const {
+		bool odd = false;
+		for (int i = terms.offsets[t]; i < terms.offsets[t + 1]; i++)
+			if (!(*this)[terms.loci[i]]) odd = !odd;
+		return odd;
+	}
+};
+
+/**
+ * @brief Add an epistatic term
+ *
+ * @param value coefficient of the term
+ * @param term_loci loci of the term
+ *
+ * The loci are stored as given, the masks combine the loci in the same word. A locus that appears
+ * twice does not change the sign and cancels from the masks.
+ */
+void epistasis_terms_t::add(double value, const vector <int> &term_loci) {
+	loci.insert(loci.end(), term_loci.begin(), term_loci.end());
+	offsets.push_back(loci.size());
+	values.push_back(value);
+
+	vector <int> sorted_loci(term_loci);
+	sort(sorted_loci.begin(), sorted_loci.end());
+	for (size_t i = 0; i < sorted_loci.size();) {
+		int word = sorted_loci[i] >> 6;
+		uint64_t mask = 0;
+		for (; (i < sorted_loci.size()) and ((sorted_loci[i] >> 6) == word); i++)
+			mask ^= ((uint64_t)1) << (sorted_loci[i] & 63);
+		if (mask) {
+			mask_words.push_back(word);
+			masks.push_back(mask);
+		}
+	}
+	mask_offsets.push_back(masks.size());
+}
+
+/**
+ * @brief Remove all terms
+ */
+void epistasis_terms_t::clear() {
+	offsets.assign(1, 0);
+	loci.clear();
+	values.clear();
+	mask_offsets.assign(1, 0);
+	mask_words.clear();
+	masks.clear();
+}
+
+/*
+ * Additive part of dense genotypes. Genotypes with few set loci are evaluated by iterating over the
+ * set bits; otherwise each byte of the genotype is expanded into a mask of eight lanes, which selects
+ * the coefficients of the corresponding loci from one cache line of the coefficient table.
+ */
+#define HC_SPARSE_FRACTION 16		// genotypes with fewer than dim / HC_SPARSE_FRACTION set loci are evaluated bit by bit
+
+typedef double coefficient_vector_t __attribute__((vector_size(8 * sizeof(double))));
+typedef int64_t lane_mask_t __attribute__((vector_size(8 * sizeof(int64_t))));
+
+/**
+ * @brief Sum the coefficients of the loci that are set in a packed genotype
+ *
+ * @param genotype genotype packed into 64-bit words
+ * @param words number of words
+ * @param coefficients one coefficient per locus, padded with zeros to a multiple of 64 loci
+ *
+ * @returns the sum of the coefficients of the set loci
+ */
+HP_TARGET_CLONES
+static double sum_set_coefficients(const uint64_t *genotype, size_t words, const double *coefficients) {
+	const lane_mask_t lane = {0, 1, 2, 3, 4, 5, 6, 7};
+	lane_mask_t zero;
+	coefficient_vector_t partial_sums, c;
+	memset(&zero, 0, sizeof(zero));
+	memset(&partial_sums, 0, sizeof(partial_sums));
+	for (size_t w = 0; w < words; w++, coefficients += 64) {
+		uint64_t word = genotype[w];
+		if (!word) continue;
+		for (int byte = 0; byte < 8; byte++, word >>= 8) {
+			lane_mask_t mask = -(((zero + (int64_t)(word & 0xff)) >> lane) & 1);
+			memcpy(&c, coefficients + 8 * byte, sizeof(c));
+			partial_sums += (coefficient_vector_t)((lane_mask_t)c & mask);
+		}
+	}
+	double sum = 0;
+	for (int i = 0; i < 8; i++) sum += partial_sums[i];
+	return sum;
+}
+
+/**
+ * @brief Pack a bitset into 64-bit words
+ *
+ * @param genotype bitset of length dim
+ * @param words output, resized to the number of words needed
+ */
+static void pack_genotype(const boost::dynamic_bitset<>& genotype, vector<uint64_t>& words) {
+	words.assign((genotype.size() + 63) / 64, 0);
+	for (size_t locus = genotype.find_first(); locus != boost::dynamic_bitset<>::npos; locus = genotype.find_next(locus))
+		words[locus >> 6] |= ((uint64_t)1) << (locus & 63);
+}
+
+/**
+ * @brief Add the interaction contributions of a genotype
+ *
+ * @param genotype view of the genotype
+ * @param result value to which the contributions are added
+ */
+template <class genotype_t>
+void hypercube_highd::add_epistasis(const genotype_t &genotype, double &result) {
+	for (size_t t = 0; t < epistasis.size(); t++)
+		result += (1 - 2 * (int)genotype.negative(epistasis, t)) * epistasis.values[t];
+}
+
+/**
+ * @brief Get the random fitness part of a genotype
+ *
+ * @param genotype_hash hash of the genotype
+ *
+ * @returns a gaussian random number with standard deviation epistatic_std
+ *
+ * The number is drawn by a counter-based generator keyed on the genotype hash (with rng_offset as the counter),
+ * so that it depends on the genotype only and no generator state is involved.
+ */
+double hypercube_highd::random_epistasis(uint64_t genotype_hash) {
+	uint32_t counter[4] = {(uint32_t)rng_offset, 0, 0, 0};
+	uint32_t key[2] = {(uint32_t)genotype_hash, (uint32_t)(genotype_hash >> 32)};
+	philox4x32(counter, key);
+	// Box-Muller transform of two uniform numbers, the first in (0, 1]
+	double u1 = (((((uint64_t)counter[0] << 32) | counter[1]) >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double u2 = ((((uint64_t)counter[2] << 32) | counter[3]) >> 11) * (1.0 / 9007199254740992.0);
+	return epistatic_std * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/**
+ * @brief Sum the additive coefficients by locus and over all loci
+ */
+void hypercube_highd::update_additive() {
+	additive_by_locus.assign(((dim + 63) / 64) * 64, 0);	// padded to whole words for sum_set_coefficients
+	additive_sum = 0;
+	for (coefficients_single_locus_iter = coefficients_single_locus.begin();
+	     coefficients_single_locus_iter != coefficients_single_locus.end();
+	     coefficients_single_locus_iter++) {
+		additive_by_locus[coefficients_single_locus_iter->locus] += coefficients_single_locus_iter->value;
+		additive_sum += coefficients_single_locus_iter->value;
+	}
+	additive_up_to_date = true;
+}
+
 /**
  * @brief Get single value on the hypercube
  *
@@ -107,46 +281,127 @@ int hypercube_highd::free_mem() {
  * @returns the value corresponding to that point
  */
 double hypercube_highd::get_func(boost::dynamic_bitset<>& genotype) {
+	vector<uint64_t> words;
+	pack_genotype(genotype, words);
+	return get_func(&words[0]);
+}
+
+/**
+ * @brief Get single value on the hypercube
+ *
+ * @param genotype Point of the hypercube, packed into 64-bit words (locus l is bit l % 64 of word l / 64)
+ *
+ * @returns the value corresponding to that point
+ */
+double hypercube_highd::get_func(const uint64_t *genotype) {
 	if (HCF_VERBOSE) cerr<<"fluct_hypercube::get_func()"<<endl;
-	double result=hypercube_mean;
-	int sign, locus;
-	// first order contributions
-	for (coefficients_single_locus_iter = coefficients_single_locus.begin();
-	     coefficients_single_locus_iter != coefficients_single_locus.end();
-	     coefficients_single_locus_iter++) {
-		if ((genotype)[coefficients_single_locus_iter->locus]) result+=coefficients_single_locus_iter->value;
-		else result -= coefficients_single_locus_iter->value;
-	}
-	// interaction contributions
-	for (coefficients_epistasis_iter = coefficients_epistasis.begin();
-	     coefficients_epistasis_iter != coefficients_epistasis.end();
-	     coefficients_epistasis_iter++) {
-		sign=1;
-		for (locus=0; locus < coefficients_epistasis_iter->order; locus++) {
-			if (!(genotype[coefficients_epistasis_iter->loci[locus]])) sign*= -1;
-		}
-		result += sign * coefficients_epistasis_iter->value;
+	double result;
+	get_funcs(this, 1, genotype, &result);
+	if (HCF_VERBOSE) cerr<<"...done"<<endl;
+	return result;
+}
+
+/**
+ * @brief Get single value on the hypercube
+ *
+ * @param derived_loci Point of the hypercube, as the sorted list of loci that are set
+ *
+ * @returns the value corresponding to that point
+ *
+ * The cost scales with the number of set loci rather than with dim.
+ */
+double hypercube_highd::get_func(const vector<int>& derived_loci) {
+	if (HCF_VERBOSE) cerr<<"fluct_hypercube::get_func()"<<endl;
+	double result;
+	get_funcs(this, 1, derived_loci, &result);
+	if (HCF_VERBOSE) cerr<<"...done"<<endl;
+	return result;
+}
+
+/**
+ * @brief Get the values of several hypercubes at the same point
+ *
+ * @param cubes array of hypercubes of the same dimension
+ * @param n_cubes number of hypercubes
+ * @param genotype Point of the hypercubes, packed into 64-bit words
+ * @param values output, one value per hypercube
+ *
+ * The genotype is read once for all hypercubes: the set loci are visited once, adding the coefficients
+ * of every hypercube, and the genotype hash for the random parts is shared. The additive part is evaluated
+ * as the value of the all-zero point plus twice the coefficients of the set loci, which are summed bit by bit
+ * for genotypes with few set loci and by sum_set_coefficients otherwise.
+ *
+ * *Note*: this function can be called from several threads at once after update_caches has been called on each hypercube.
+ */
+void hypercube_highd::get_funcs(hypercube_highd *cubes, int n_cubes, const uint64_t *genotype, double *values) {
+	const int dim = cubes[0].dim;
+	const size_t words = (dim + 63) / 64;
+	bool random = false;
+	for (int c = 0; c < n_cubes; c++) {
+		cubes[c].update_caches();
+		random = random or (cubes[c].epistatic_std > HP_NOTHING);
+		values[c] = 0;
 	}
-	// calculate the random fitness part
-	if (epistatic_std > HP_NOTHING) {
-		int gt_seed=0;
-		int word=0, locus, ii;
-		// calculate the seed for the random number generator
-		for (locus=0;locus<dim;) {
-			word=0;
-			ii=0;
-			while (ii<WORDLENGTH and locus<dim) {
-				if ((genotype)[locus]) word+=(1<<ii);
-				ii++; locus++;
+	int set_loci = 0;
+	for (size_t w = 0; w < words; w++) set_loci += __builtin_popcountll(genotype[w]);
+	// first order contributions: the all-zero point plus twice the coefficients of the set loci
+	if (set_loci * HC_SPARSE_FRACTION < dim) {
+		for (size_t w = 0; w < words; w++)
+			for (uint64_t word = genotype[w]; word; word &= word - 1) {
+				const size_t locus = (w << 6) + __builtin_ctzll(word);
+				for (int c = 0; c < n_cubes; c++)
+					values[c] += cubes[c].additive_by_locus[locus];
 			}
-			gt_seed+=word;
-		}
-		// add a gaussion random number to the fitness from the rng seeded with the genoytpe
-		gsl_rng_set(rng,gt_seed+rng_offset);
-		result+=gsl_ran_gaussian(rng,epistatic_std);
+	} else
+		for (int c = 0; c < n_cubes; c++)
+			values[c] = sum_set_coefficients(genotype, words, &cubes[c].additive_by_locus[0]);
+	const uint64_t hash = random ? hash_genotype(genotype, words) : 0;
+	for (int c = 0; c < n_cubes; c++) {
+		hypercube_highd &cube = cubes[c];
+		double result = cube.hypercube_mean - cube.additive_sum + 2 * values[c];
+		// interaction contributions
+		cube.add_epistasis(packed_genotype_t(genotype), result);
+		// calculate the random fitness part
+		if (cube.epistatic_std > HP_NOTHING)
+			result += cube.random_epistasis(hash);
+		values[c] = result;
+	}
+}
+
+/**
+ * @brief Get the values of several hypercubes at the same point
+ *
+ * @param cubes array of hypercubes of the same dimension
+ * @param n_cubes number of hypercubes
+ * @param derived_loci Point of the hypercubes, as the sorted list of loci that are set
+ * @param values output, one value per hypercube
+ *
+ * As for packed genotypes with few set loci, the coefficients of the set loci are summed in order.
+ *
+ * *Note*: this function can be called from several threads at once after update_caches has been called on each hypercube.
+ */
+void hypercube_highd::get_funcs(hypercube_highd *cubes, int n_cubes, const vector<int>& derived_loci, double *values) {
+	bool random = false;
+	for (int c = 0; c < n_cubes; c++) {
+		cubes[c].update_caches();
+		random = random or (cubes[c].epistatic_std > HP_NOTHING);
+		values[c] = 0;
+	}
+	// first order contributions: the all-zero point plus twice the coefficients of the set loci
+	for (vector<int>::const_iterator locus = derived_loci.begin(); locus != derived_loci.end(); locus++)
+		for (int c = 0; c < n_cubes; c++)
+			values[c] += cubes[c].additive_by_locus[*locus];
+	const uint64_t hash = random ? hash_genotype(derived_loci) : 0;
+	for (int c = 0; c < n_cubes; c++) {
+		hypercube_highd &cube = cubes[c];
+		double result = cube.hypercube_mean - cube.additive_sum + 2 * values[c];
+		// interaction contributions
+		cube.add_epistasis(sparse_genotype_t(derived_loci), result);
+		// calculate the random fitness part
+		if (cube.epistatic_std > HP_NOTHING)
+			result += cube.random_epistasis(hash);
+		values[c] = result;
 	}
-	if (HCF_VERBOSE) cerr<<"...done"<<endl;
-	return result;
 }
 
 /**
@@ -159,45 +414,106 @@ double hypercube_highd::get_func(boost::dynamic_bitset<>& genotype) {
  * @returns the difference between the values, f(gt1) - f(gt2)
  */
 double hypercube_highd::get_func_diff(boost::dynamic_bitset<>& genotype1, boost::dynamic_bitset<>& genotype2, vector<int> &diffpos) {
+	vector<uint64_t> words1, words2;
+	pack_genotype(genotype1, words1);
+	pack_genotype(genotype2, words2);
+	return get_func_diff(&words1[0], &words2[0], diffpos);
+}
+
+/**
+ * @brief Calculate difference between two hypercube points efficiently
+ *
+ * @param genotype1 first point on the hypercube, packed into 64-bit words
+ * @param genotype2 second point on the hypercube, packed into 64-bit words
+ * @param diffpos vector of positions at which they differ
+ *
+ * @returns the difference between the values, f(gt1) - f(gt2)
+ */
+double hypercube_highd::get_func_diff(const uint64_t *genotype1, const uint64_t *genotype2, vector<int> &diffpos) {
+	double result = get_func_diff_view(packed_genotype_t(genotype1), packed_genotype_t(genotype2), diffpos);
+	// the random parts of the two genotypes are unrelated
+	if (epistatic_std>HP_NOTHING) {
+		const size_t words = (dim + 63) / 64;
+		result += random_epistasis(hash_genotype(genotype1, words)) - random_epistasis(hash_genotype(genotype2, words));
+	}
+	return result;
+}
+
+/**
+ * @brief Calculate difference between two hypercube points efficiently
+ *
+ * @param derived_loci1 first point on the hypercube, as the sorted list of loci that are set
+ * @param derived_loci2 second point on the hypercube, as the sorted list of loci that are set
+ * @param diffpos vector of positions at which they differ
+ *
+ * @returns the difference between the values, f(gt1) - f(gt2)
+ */
+double hypercube_highd::get_func_diff(const vector<int>& derived_loci1, const vector<int>& derived_loci2, vector<int> &diffpos) {
+	double result = get_func_diff_view(sparse_genotype_t(derived_loci1), sparse_genotype_t(derived_loci2), diffpos);
+	// the random parts of the two genotypes are unrelated
+	if (epistatic_std>HP_NOTHING)
+		result += random_epistasis(hash_genotype(derived_loci1)) - random_epistasis(hash_genotype(derived_loci2));
+	return result;
+}
+
+/**
+ * @brief Difference between two hypercube points, except for the random part
+ *
+ * @param genotype1 view of the first point on the hypercube
+ * @param genotype2 view of the second point on the hypercube
+ * @param diffpos vector of positions at which they differ
+ *
+ * @returns the difference between the values, f(gt1) - f(gt2)
+ */
+template <class genotype_t>
+double hypercube_highd::get_func_diff_view(const genotype_t &genotype1, const genotype_t &genotype2, vector<int> &diffpos) {
 	if (HCF_VERBOSE) cerr<<"fluct_hypercube::get_func_diff()"<<endl;
 	double result = 0;
 	int locus;
 
-	//in case of random epistasis, evaluating the difference does not make a lot of sense.
-	if (epistatic_std>HP_NOTHING){
-		double val1, val2;
-		val1 = get_func(genotype1);
-		val2 = get_func(genotype2);
-		return val1-val2;
-	}else{
-		// first order contributions
-		for(size_t i=0; i != diffpos.size(); i++) {
-			locus = diffpos[i];
-			if (genotype1[locus] and !genotype2[locus]) result += 2 * get_additive_coefficient(locus);
-			else if (!genotype1[locus] and genotype2[locus]) result -= 2 * get_additive_coefficient(locus);
-			else{ cerr<<"fluct_hypercube::get_func_diff(): Difference vector is screwed up"<<endl;}
-		}
-		// TODO: calculate epistasis more efficiently!
-		// interaction contributions
-		int sign1, sign2;
-		for (coefficients_epistasis_iter = coefficients_epistasis.begin();
-			 coefficients_epistasis_iter != coefficients_epistasis.end();
-			 coefficients_epistasis_iter++) {
-			sign1 = sign2 = 1;
-			for (locus=0; locus < coefficients_epistasis_iter->order; locus++) {
-				if (!(genotype1[coefficients_epistasis_iter->loci[locus]])) sign1 *= -1;
-				if (!(genotype2[coefficients_epistasis_iter->loci[locus]])) sign2 *= -1;
-			}
-			if(sign1 != sign2)
-				result += (sign1 - sign2) * coefficients_epistasis_iter->value;
-		}
-
-		if (HCF_VERBOSE) cerr<<"...done"<<endl;
-		return result;
+	// first order contributions
+	for(size_t i=0; i != diffpos.size(); i++) {
+		locus = diffpos[i];
+		if (genotype1[locus] and !genotype2[locus]) result += 2 * get_additive_coefficient(locus);
+		else if (!genotype1[locus] and genotype2[locus]) result -= 2 * get_additive_coefficient(locus);
+		else{ cerr<<"fluct_hypercube::get_func_diff(): Difference vector is screwed up"<<endl;}
+	}
+	// interaction contributions: only the coefficients involving the loci that differ can change
+	if (diffpos.empty()) return result;
+	const vector<int> *terms = &epistasis_by_locus[diffpos[0]];
+	vector<int> merged_terms;
+	if (diffpos.size() > 1) {
+		for(size_t i=0; i != diffpos.size(); i++)
+			merged_terms.insert(merged_terms.end(), epistasis_by_locus[diffpos[i]].begin(), epistasis_by_locus[diffpos[i]].end());
+		sort(merged_terms.begin(), merged_terms.end());
+		merged_terms.erase(unique(merged_terms.begin(), merged_terms.end()), merged_terms.end());
+		terms = &merged_terms;
+	}
+	bool negative1;
+	for (vector<int>::const_iterator term = terms->begin(); term != terms->end(); term++) {
+		negative1 = genotype1.negative(epistasis, *term);
+		if (negative1 != genotype2.negative(epistasis, *term))
+			result += (negative1 ? -2 : 2) * epistasis.values[*term];
 	}
+
+	if (HCF_VERBOSE) cerr<<"...done"<<endl;
+	return result;
 }
 
 
+/**
+ * @brief Get the epistatic coefficients
+ *
+ * @returns a vector with one coefficient per term, in the order in which they were added
+ */
+vector <coeff_t> hypercube_highd::get_epistasis() {
+	vector <coeff_t> coefficients;
+	coefficients.reserve(epistasis.size());
+	for (size_t t = 0; t < epistasis.size(); t++)
+		coefficients.push_back(epistasis.get_coefficient(t));
+	return coefficients;
+}
+
 /**
  * @brief: get the trait coefficient of a locus.
  *
@@ -221,7 +537,8 @@ double hypercube_highd::get_additive_coefficient(int locus){
 void hypercube_highd::reset() {
 	reset_additive();
 	epistatic_std = 0;
-	coefficients_epistasis.clear();
+	epistasis.clear();
+	epistasis_by_locus.assign(dim, vector<int>());
 }
 
 
@@ -232,6 +549,7 @@ void hypercube_highd::reset_additive() {
 	hypercube_mean = 0;
 	coefficients_single_locus.clear();
 	fill(coefficients_single_locus_static.begin(), coefficients_single_locus_static.end(), 0);
+	additive_up_to_date = false;
 }
 
 
@@ -243,13 +561,24 @@ void hypercube_highd::reset_additive() {
  */
 int hypercube_highd::add_coefficient(double value, vector <int> loci)
 {
+	for (size_t i = 0; i < loci.size(); i++) {
+		if ((loci[i] < 0) or (loci[i] >= dim)) {
+			cerr <<"hypercube_highd::add_coefficient(): locus "<<loci[i]<<" out of range"<<endl;
+			return HCF_BADARG;
+		}
+	}
 	if (loci.size()>1) {
-		coeff_t temp_coeff(value, loci);
-		coefficients_epistasis.push_back(temp_coeff);
+		epistasis.add(value, loci);
+		int term = epistasis.size() - 1;
+		for (size_t i = 0; i < loci.size(); i++) {
+			vector<int> &terms = epistasis_by_locus[loci[i]];
+			if (terms.empty() or (terms.back() != term)) terms.push_back(term);
+		}
 	} else if (loci.size()==1) {
 		coeff_single_locus_t temp_coeff(value, loci[0]);
 		coefficients_single_locus.push_back(temp_coeff);
                 coefficients_single_locus_static[loci[0]] = value;
+		additive_up_to_date = false;
 	} else {
 		hypercube_mean=value;
 	}
@@ -271,6 +600,7 @@ int hypercube_highd::set_additive_coefficient(double value, int lindex, int expe
 	else if (coefficients_single_locus[lindex].locus==expected_locus){
 		coefficients_single_locus[lindex].value=value;
 		coefficients_single_locus_static[expected_locus]=value;
+		additive_up_to_date = false;
 		return 0;
 	}else if (expected_locus>-1){
 		cerr <<"hypercube_highd::set_additive_coefficient: coefficient[locus] does not match locus: "<<coefficients_single_locus[lindex].locus<<"  "<<expected_locus<<endl;
@@ -0,0 +1,547 @@
+/*
+ * population_view.cpp
+ *
+ * Read-only analysis of populations saved in checkpoints.
+ *
+ * Copyright (c) 2012-2013, Richard Neher, Fabio Zanini
+ * All rights reserved.
+ *
+ * This file is part of FFPopSim.
+ *
+ * FFPopSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FFPopSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FFPopSim. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ffpopsim_highd.h"
+
+/**
+ * @brief Default constructor
+ *
+ * @param rng_seed seed of the generator used for random samples (zero: the seed saved in the checkpoint)
+ */
+population_view::population_view(int rng_seed) : seed(rng_seed) {
+	rng = gsl_rng_alloc(RNG);
+	close();
+}
+
+/**
+ * @brief Destructor
+ */
+population_view::~population_view() {
+	gsl_rng_free(rng);
+}
+
+/**
+ * @brief Map a checkpoint for analysis
+ *
+ * @param filename path of a file written by haploid_highd::write_checkpoint()
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The clone sizes, fitness values, traits and genotypes are checked and then used in place. The loci of
+ * the epistatic terms and genealogies and the mutation rates are checked like in read_checkpoint(), though
+ * the view does not use them. A view that is already open is closed first, also if the new file is invalid.
+ */
+int population_view::open(const char *filename) {
+	if (HP_VERBOSE) cerr <<"population_view::open("<<filename<<")...";
+	close();
+	int err = file.open(filename);
+	if (err) return err;
+
+	const checkpoint_parameters_t *parameters = file.get_parameters();
+	size_t n_sizes, n_fitness, n_traits, n_words, n_offsets, n_loci, n_ancestral, n_epistasis, n_epistasis_loci, n_rates, n_genealogy_loci;
+	bool valid = (parameters != NULL) and (parameters->number_of_loci > 0) and (parameters->number_of_traits > 0) and
+		(parameters->number_of_slots >= 0) and (parameters->last_clone >= 0);
+	if (valid) {
+		const size_t slots = parameters->number_of_slots;
+		words = (parameters->number_of_loci + 63) / 64;
+		clone_sizes = file.section<int32_t>(CKPT_CLONE_SIZES, n_sizes);
+		fitness = file.section<double>(CKPT_FITNESS, n_fitness);
+		traits = file.section<double>(CKPT_TRAITS, n_traits);
+		genotype_words = file.section<uint64_t>(CKPT_GENOTYPE_WORDS, n_words);
+		loci_offsets = file.section<uint64_t>(CKPT_DERIVED_LOCI_OFFSETS, n_offsets);
+		derived_loci = file.section<int32_t>(CKPT_DERIVED_LOCI, n_loci);
+		ancestral_state = file.section<int32_t>(CKPT_ANCESTRAL_STATE, n_ancestral);
+		valid = (n_sizes == slots) and (n_fitness == slots) and (n_traits == slots * parameters->number_of_traits) and
+			((n_ancestral == 0) or (n_ancestral == (size_t)parameters->number_of_loci));
+		if (valid and (parameters->genotype_representation == SPARSE_GENOTYPES)) {
+			valid = (n_offsets == slots + 1) and (loci_offsets[0] == 0) and (loci_offsets[slots] == n_loci);
+			for (size_t i = 0; valid and (i < slots); i++)
+				valid = (loci_offsets[i] <= loci_offsets[i + 1]);
+			for (size_t l = 0; valid and (l < n_loci); l++)
+				valid = (derived_loci[l] >= 0) and (derived_loci[l] < parameters->number_of_loci);
+			// the derived loci of each clone are sorted and unique
+			for (size_t i = 0; valid and (i < slots); i++)
+				for (uint64_t l = loci_offsets[i]; valid and (l + 1 < loci_offsets[i + 1]); l++)
+					valid = (derived_loci[l] < derived_loci[l + 1]);
+			genotype_words = NULL;
+		} else if (valid) {
+			valid = (parameters->genotype_representation == DENSE_GENOTYPES) and (n_words == slots * words);
+			loci_offsets = NULL;
+			derived_loci = NULL;
+		}
+		if (n_ancestral == 0) ancestral_state = NULL;
+
+		// sections the view does not use, checked so that it accepts the same files as read_checkpoint()
+		const checkpoint_epistasis_t *epistasis = file.section<checkpoint_epistasis_t>(CKPT_EPISTASIS, n_epistasis);
+		const int32_t *epistasis_loci = file.section<int32_t>(CKPT_EPISTASIS_LOCI, n_epistasis_loci);
+		const double *rates = file.section<double>(CKPT_MUTATION_RATES, n_rates);
+		const int32_t *genealogy_loci = file.section<int32_t>(CKPT_GENEALOGY_LOCI, n_genealogy_loci);
+		size_t used_loci = 0;
+		for (size_t c = 0; valid and (c < n_epistasis); c++) {
+			valid = (epistasis[c].order >= 0);
+			used_loci += epistasis[c].order;
+		}
+		valid = valid and (used_loci == n_epistasis_loci);
+		for (size_t l = 0; valid and (l < n_epistasis_loci); l++)
+			valid = (epistasis_loci[l] >= 0) and (epistasis_loci[l] < parameters->number_of_loci);
+		double total_rate = 0;
+		valid = valid and ((n_rates == 0) or (n_rates == (size_t)parameters->number_of_loci));
+		for (size_t locus = 0; valid and (locus < n_rates); locus++) {
+			valid = (rates[locus] >= 0);
+			total_rate += rates[locus];
+		}
+		valid = valid and ((n_rates == 0) or ((total_rate > 0) and (!parameters->all_polymorphic)));
+		for (size_t locus = 0; valid and (locus < n_genealogy_loci); locus++)
+			valid = (genealogy_loci[locus] >= 0) and (genealogy_loci[locus] < parameters->number_of_loci);
+	}
+	if (!valid) {
+		cerr <<"population_view::open(): "<<filename<<" is incomplete or inconsistent"<<endl;
+		close();
+		return HP_BADARG;
+	}
+
+	number_of_loci = parameters->number_of_loci;
+	number_of_traits = parameters->number_of_traits;
+	representation = parameters->genotype_representation;
+	number_of_slots = min(parameters->last_clone + 1, parameters->number_of_slots);
+	generation = parameters->generation;
+	kernels = clone_store::get_kernels(words);
+	gsl_rng_set(rng, seed ? seed : parameters->seed);
+
+	// a single sweep over the clone sizes
+	double cs;
+	for (int i = 0; i < number_of_slots; i++) {
+		cs = clone_sizes[i];
+		if (cs > 0) {
+			number_of_clones++;
+			population_size += cs;
+			participation_ratio += (cs * cs);
+		}
+	}
+	if (population_size) {
+		participation_ratio /= population_size;
+		participation_ratio /= population_size;
+	}
+	trait_stat.assign(number_of_traits, stat_t());
+	if (HP_VERBOSE) cerr <<"done."<<endl;
+	return 0;
+}
+
+/**
+ * @brief Unmap the checkpoint and forget everything derived from it
+ */
+void population_view::close() {
+	file.close();
+	number_of_loci = number_of_traits = 0;
+	representation = DENSE_GENOTYPES;
+	number_of_slots = number_of_clones = population_size = generation = 0;
+	participation_ratio = 0;
+	clone_sizes = NULL;
+	fitness = traits = NULL;
+	genotype_words = loci_offsets = NULL;
+	derived_loci = ancestral_state = NULL;
+	words = 0;
+	kernels = NULL;
+	allele_frequencies.clear();
+	allele_frequencies_up_to_date = false;
+	trait_stat.clear();
+	clone_stat_up_to_date = false;
+	sampler_clones.clear();
+	clone_sampler_up_to_date = false;
+}
+
+/**
+ * @brief Get the allele of a clone at a locus
+ */
+bool population_view::get_locus(int n, int locus) const {
+	if (genotype_words)
+		return (genotype_words[n * words + (locus >> 6)] >> (locus & 63)) & 1;
+	return binary_search(derived_loci + loci_offsets[n], derived_loci + loci_offsets[n + 1], locus);
+}
+
+/**
+ * @brief Get the genotype of a clone as a bitset
+ */
+boost::dynamic_bitset<> population_view::get_genotype(int n) const {
+	boost::dynamic_bitset<> gt(number_of_loci);
+	if (genotype_words) {
+		const uint64_t *row = genotype_words + n * words;
+		for (size_t w = 0; w < words; w++)
+			for (uint64_t word = row[w]; word; word &= word - 1)
+				gt.set((w << 6) + __builtin_ctzll(word));
+	} else {
+		for (uint64_t l = loci_offsets[n]; l < loci_offsets[n + 1]; l++)
+			gt.set(derived_loci[l]);
+	}
+	return gt;
+}
+
+/**
+ * @brief Obtain a list of the good clones.
+ *
+ * @returns vector of clone indices
+ */
+vector <int> population_view::get_nonempty_clones() const {
+	vector <int> good;
+	good.reserve(number_of_clones);
+	for (int i = 0; i < number_of_slots; i++)
+		if (clone_sizes[i] > 0)
+			good.push_back(i);
+	return good;
+}
+
+/**
+ * @brief Calculate and store allele frequencies
+ *
+ * Dense genotypes are counted in place by the bit-sliced adder of the clone store, see
+ * clone_store::count_packed_alleles.
+ */
+void population_view::calc_allele_freqs() {
+	if (HP_VERBOSE) cerr<<"population_view::calc_allele_freqs()...";
+	vector <int> counts(number_of_loci, 0);
+	if (genotype_words) {
+		if (number_of_slots) clone_store::count_packed_alleles(genotype_words, words, clone_sizes, number_of_slots, &counts[0]);
+	} else {
+		for (int i = 0; i < number_of_slots; i++)
+			if (clone_sizes[i] > 0)
+				for (uint64_t l = loci_offsets[i]; l < loci_offsets[i + 1]; l++)
+					counts[derived_loci[l]] += clone_sizes[i];
+	}
+	allele_frequencies.resize(number_of_loci);
+	for (int locus = 0; locus < number_of_loci; locus++)
+		allele_frequencies[locus] = double(counts[locus]) / population_size;
+	allele_frequencies_up_to_date = true;
+	if (HP_VERBOSE) cerr<<"done.\n";
+}
+
+/**
+ * @brief Calculate and store fitness and trait statistics from the saved values
+ */
+void population_view::calc_clone_stat() {
+	double fitness_sum = 0, fitness_square_sum = 0;
+	vector <double> trait_sums(number_of_traits, 0), trait_square_sums(number_of_traits, 0);
+	for (int i = 0; i < number_of_slots; i++) {
+		int csize = clone_sizes[i];
+		if (csize > 0) {
+			double temp = fitness[i];
+			fitness_sum += temp * csize;
+			fitness_square_sum += temp * temp * csize;
+			const double *clone_traits = traits + i * number_of_traits;
+			for (int t = 0; t < number_of_traits; t++) {
+				trait_sums[t] += clone_traits[t] * csize;
+				trait_square_sums[t] += clone_traits[t] * clone_traits[t] * csize;
+			}
+		}
+	}
+	if (population_size == 0)
+		cerr <<"population_view::calc_clone_stat(): population extinct!"<<endl;
+	fitness_stat.mean = fitness_sum / population_size;
+	fitness_stat.variance = fitness_square_sum / population_size - fitness_stat.mean * fitness_stat.mean;
+	for (int t = 0; t < number_of_traits; t++) {
+		trait_stat[t].mean = trait_sums[t] / population_size;
+		trait_stat[t].variance = trait_square_sums[t] / population_size - trait_stat[t].mean * trait_stat[t].mean;
+	}
+	clone_stat_up_to_date = true;
+}
+
+/**
+ * @brief Build the alias table of the clones weighted by their sizes
+ *
+ * @returns zero if successful, error codes otherwise
+ */
+int population_view::update_clone_sampler() {
+	vector <double> sizes;
+	sizes.reserve(number_of_clones);
+	sampler_clones = get_nonempty_clones();
+	for (size_t i = 0; i < sampler_clones.size(); i++)
+		sizes.push_back(clone_sizes[sampler_clones[i]]);
+	if (clone_sampler.set_up(sizes)) {
+		cerr <<"population_view::update_clone_sampler(): population extinct!"<<endl;
+		return HP_EXTINCTERR;
+	}
+	clone_sampler_up_to_date = true;
+	return 0;
+}
+
+/**
+ * @brief Get a random clone from the population
+ *
+ * @returns the index of the random clone, or NO_GENOTYPE if the population is extinct
+ *
+ * Larger clones are proportionally more likely to be returned, see haploid_highd::random_clone.
+ */
+int population_view::random_clone() {
+	if ((!clone_sampler_up_to_date) and update_clone_sampler())
+		return NO_GENOTYPE;
+	return sampler_clones[clone_sampler.draw(rng)];
+}
+
+/**
+ * @brief Sample random individuals from the population
+ *
+ * @param n_o_individuals number of individuals to sample
+ * @param sample pointer to vector where to append the clone numbers of the sampled individuals
+ * @param replacement whether the same individual may be sampled more than once
+ *
+ * @returns zero if successful, nonzero otherwise
+ *
+ * See haploid_highd::random_clones.
+ */
+int population_view::random_clones(unsigned int n_o_individuals, vector <int> *sample, bool replacement) {
+	if (replacement) {
+		if ((!clone_sampler_up_to_date) and update_clone_sampler())
+			return HP_EXTINCTERR;
+		sample->reserve(sample->size() + n_o_individuals);
+		for (size_t i = 0; i < n_o_individuals; i++)
+			sample->push_back(sampler_clones[clone_sampler.draw(rng)]);
+		return 0;
+	}
+
+	if (n_o_individuals > (unsigned int)population_size) {
+		cerr <<"population_view::random_clones(): cannot sample "<<n_o_individuals<<" individuals without replacement from "<<population_size<<endl;
+		return HP_BADARG;
+	}
+	size_t first = sample->size();
+	sample->reserve(first + n_o_individuals);
+	unsigned int remaining = n_o_individuals, others = population_size;
+	for (int i = 0; (i < number_of_slots) and (remaining > 0); i++) {
+		unsigned int cs = clone_sizes[i] > 0 ? clone_sizes[i] : 0;
+		if (cs > 0) {
+			others -= cs;
+			unsigned int chosen = gsl_ran_hypergeometric(rng, cs, others, remaining);
+			sample->insert(sample->end(), chosen, i);
+			remaining -= chosen;
+		}
+	}
+	if (n_o_individuals > 1)
+		gsl_ran_shuffle(rng, &(*sample)[first], n_o_individuals, sizeof(int));
+	return 0;
+}
+
+/**
+ * @brief Number of derived alleles of a clone, i.e. its distance from the [00...0] genotype
+ */
+int population_view::count(int n) const {
+	if (genotype_words) return kernels->count(genotype_words + n * words, words);
+	return loci_offsets[n + 1] - loci_offsets[n];
+}
+
+/**
+ * @brief Calculate Hamming distance between the genotypes of two clones
+ *
+ * @param clone1 index of the first clone
+ * @param clone2 index of the second clone
+ *
+ * @returns Hamming distance, not normalized
+ */
+int population_view::distance_Hamming(unsigned int clone1, unsigned int clone2) const {
+	if (genotype_words) return kernels->distance(genotype_words + clone1 * words, genotype_words + clone2 * words, words);
+
+	// size of the symmetric difference of the sorted lists
+	const int32_t *a = derived_loci + loci_offsets[clone1], *a_end = derived_loci + loci_offsets[clone1 + 1];
+	const int32_t *b = derived_loci + loci_offsets[clone2], *b_end = derived_loci + loci_offsets[clone2 + 1];
+	int common = 0;
+	while ((a < a_end) and (b < b_end)) {
+		if (*a < *b) a++;
+		else if (*b < *a) b++;
+		else {common++; a++; b++;}
+	}
+	return (loci_offsets[clone1 + 1] - loci_offsets[clone1]) + (loci_offsets[clone2 + 1] - loci_offsets[clone2]) - 2 * common;
+}
+
+/**
+ * @brief Calculate mean and variance of the divergence from the [00...0] bitset
+ *
+ * @param n_sample size of the statistical sample to use
+ *
+ * @returns mean and variance of the divergence in a stat_t
+ */
+stat_t population_view::get_divergence_statistics(unsigned int n_sample) {
+	stat_t div;
+	unsigned int tmp;
+	vector <int> clones;
+	if (random_clones(n_sample, &clones)) return div;
+
+	for (size_t i = 0; i < n_sample; i++) {
+		tmp = count(clones[i]);
+		div.mean += tmp;
+		div.variance += tmp * tmp;
+	}
+	div.mean /= n_sample;
+	div.variance /= n_sample;
+	div.variance -= div.mean * div.mean;
+	return div;
+}
+
+/**
+ * @brief Calculate diversity in the population (Hamming distance between pairs of sequences)
+ *
+ * @param n_sample size of the statistical sample to use
+ *
+ * @returns mean and variance of the diversity in a stat_t
+ */
+stat_t population_view::get_diversity_statistics(unsigned int n_sample) {
+	stat_t div;
+	unsigned int tmp;
+	vector <int> clones1;
+	vector <int> clones2;
+	if (random_clones(n_sample, &clones1) or random_clones(n_sample, &clones2)) return div;
+
+	for (size_t i = 0; i < n_sample; i++) {
+		if (clones1[i] != clones2[i]) {
+			tmp = distance_Hamming(clones1[i], clones2[i]);
+			div.mean += tmp;
+			div.variance += tmp * tmp;
+		}
+	}
+	div.mean /= n_sample;
+	div.variance /= n_sample;
+	div.variance -= div.mean * div.mean;
+	return div;
+}
+
+/**
+ * @brief Calculate histogram of fitness
+ *
+ * @param hist pointer to the gsl_histogram to fill
+ * @param bins number of bins in the histogram (fewer if the sample is small)
+ * @param n_sample size of the random sample to use
+ *
+ * @returns zero if successful, error codes otherwise
+ *
+ * The bins are set as in haploid_highd::get_fitness_histogram. Memory for the histogram is
+ * allocated only if successful, and must be released by the user.
+ */
+int population_view::get_fitness_histogram(gsl_histogram **hist, unsigned int bins, unsigned int n_sample) {
+	if (HP_VERBOSE) cerr <<"population_view::get_fitness_histogram()...";
+	if (n_sample == 0) return HP_BADARG;
+
+	vector <int> clones;
+	int err = random_clones(n_sample, &clones);
+	if (err) return err;
+	vector <double> fitnesses(n_sample);
+	for (size_t i = 0; i < n_sample; i++)
+		fitnesses[i] = fitness[clones[i]];
+
+	// Set the bins according to average and variance in fitness in the population
+	stat_t fitness_statistics = get_fitness_statistics();
+	double fitmean = fitness_statistics.mean;
+	double fitstd = sqrt(fitness_statistics.variance);
+	double histtail = 2 * fitstd;
+
+	double fitmax = *max_element(fitnesses.begin(), fitnesses.end());
+	double fitmin = *min_element(fitnesses.begin(), fitnesses.end());
+	double fitmin_hist = fitmean - histtail;
+
+	// Sometimes the population is homogeneous (neutral models), or the sample too small
+	bins = min(n_sample / 30, bins);
+	if ((fitmin >= fitmax) or (bins < 2))
+		return HP_NOBINSERR;
+
+	double width = (fitmax - fitmin_hist) / (bins - 1);
+	*hist = gsl_histogram_alloc(bins);
+	gsl_histogram_set_ranges_uniform(*hist, fitmin_hist - 0.5 * width, fitmax + 0.5 * width);
+	for (size_t i = 0; i < n_sample; i++)
+		gsl_histogram_increment(*hist, fitnesses[i]);
+	gsl_histogram_scale(*hist, 1/(double)n_sample);
+
+	if (HP_VERBOSE) cerr <<"done"<<endl;
+	return 0;
+}
+
+/**
+ * @brief Fill a histogram of distances with integer bin widths
+ *
+ * @returns zero if successful, HP_WRONGBINSERR if the distances do not fit into the bins, HP_BADARG if there are none
+ *
+ * The bins are set as in haploid_highd::get_divergence_histogram.
+ */
+int population_view::distance_histogram(gsl_histogram **hist, unsigned int bins, const unsigned int *divs, unsigned int n_sample) {
+	if (n_sample == 0) return HP_BADARG;
+	unsigned long dmax = *max_element(divs, divs + n_sample);
+	unsigned long dmin = *min_element(divs, divs + n_sample);
+
+	// Antialiasing
+	unsigned int width, binsnew;
+	if (dmin == dmax)
+		width = 1;
+	else if (bins < 2)
+		return HP_WRONGBINSERR;
+	else {
+		width = (dmax - dmin) / (bins-1);
+		width += ((dmax - dmin)%(bins-1))?1:0;
+	}
+	binsnew = ((dmax - dmin) / width) + 1;
+	if (binsnew > bins) {
+		if (HP_VERBOSE) cerr<<"wrong bins!: "<<"binsnew: "<<binsnew<<", bins: "<<bins<<", delta: "<<(dmax - dmin)<<endl;
+		return HP_WRONGBINSERR;
+	}
+
+	// Fill and scale histogram
+	*hist = gsl_histogram_alloc(binsnew);
+	gsl_histogram_set_ranges_uniform(*hist, dmin - 0.5 * width, dmax + 0.5 * width);
+	for (size_t i = 0; i < n_sample; i++)
+		gsl_histogram_increment(*hist, divs[i]);
+	gsl_histogram_scale(*hist, 1/(double)n_sample);
+	return 0;
+}
+
+/**
+ * @brief Get histogram of divergence from the [00...0] bitset
+ *
+ * @param hist pointer to the gsl_histogram to fill
+ * @param bins number of bins in the histogram (fewer after antialiasing)
+ * @param n_sample size of the random sample to use
+ *
+ * @returns zero if successful, error codes otherwise
+ */
+int population_view::get_divergence_histogram(gsl_histogram **hist, unsigned int bins, unsigned int n_sample) {
+	vector <int> clones;
+	int err = random_clones(n_sample, &clones);
+	if (err) return err;
+	vector <unsigned int> divs(n_sample);
+	for (size_t i = 0; i < n_sample; i++)
+		divs[i] = count(clones[i]);
+	return distance_histogram(hist, bins, &divs[0], n_sample);
+}
+
+/**
+ * @brief Get histogram of diversity in the population (mutual Hamming distance)
+ *
+ * @param hist pointer to the gsl_histogram to fill
+ * @param bins number of bins in the histogram (fewer after antialiasing)
+ * @param n_sample size of the random sample to use
+ *
+ * @returns zero if successful, error codes otherwise
+ */
+int population_view::get_diversity_histogram(gsl_histogram **hist, unsigned int bins, unsigned int n_sample) {
+	vector <int> clones1;
+	vector <int> clones2;
+	int err = random_clones(n_sample, &clones1);
+	if (!err) err = random_clones(n_sample, &clones2);
+	if (err) return err;
+	vector <unsigned int> divs(n_sample);
+	for (size_t i = 0; i < n_sample; i++)
+		divs[i] = distance_Hamming(clones1[i], clones2[i]);
+	return distance_histogram(hist, bins, &divs[0], n_sample);
+}
@@ -32,6 +32,29 @@ import numpy as _np
 %ignore SAMPLE_ERROR;
 %ignore sample;
 
+/* random number generator backends */
+%ignore rng_backend_type;
+%ignore ffpopsim_rng_xoshiro256pp;
+%ignore ffpopsim_rng_philox4x32;
+%ignore rng_uniform_block;
+%ignore rng_poisson_block;
+%ignore rng_binomial_block;
+%feature("autodoc",
+"Select the random number generator of populations created from now on
+
+Parameters:
+   - backend: one of RNG_TAUS2 (default), RNG_XOSHIRO256PP or RNG_PHILOX4X32
+
+Note: the random numbers are drawn in a different order than in FFPopSim 2.0,
+so seeded runs do not reproduce its results, whatever the backend.
+
+Returns:
+   - zero if successful, -1 if the backend is unknown
+
+.. note:: existing populations keep the generator they were created with.
+") set_rng_backend;
+%feature("autodoc", "Get the random number generator backend of new populations") get_rng_backend;
+
 
 /*****************************************************************************/
 /* INDEX_VALUE_PAIR_T                                                        */
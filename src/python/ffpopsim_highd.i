@@ -20,10 +20,26 @@
 
 /* ignore some classes */
 %ignore coeff_t;
+%ignore epistasis_terms_t;
 %ignore coeff_single_locus_t;
 %ignore hypercube_highd;
+%ignore clone_store;
+%ignore clone_index_t;
+%ignore hash_genotype;
 %ignore step_t;
 %ignore node_t;
+%ignore checkpoint_header_t;
+%ignore checkpoint_section_t;
+%ignore checkpoint_parameters_t;
+%ignore checkpoint_trait_t;
+%ignore checkpoint_additive_t;
+%ignore checkpoint_epistasis_t;
+%ignore checkpoint_poly_t;
+%ignore checkpoint_tree_t;
+%ignore checkpoint_node_t;
+%ignore checkpoint_edge_t;
+%ignore mapped_checkpoint;
+%ignore population_view;
 
 /*****************************************************************************/
 /* CLONE_T                                                                   */
@@ -355,6 +371,7 @@ const char* __repr__() {
 %ignore add_terminal_node;
 %ignore erase_edge_node;
 %ignore bridge_edge_node;
+%ignore rename_leaf;
 %ignore update_leaf_to_root;
 %ignore update_tree;
 %ignore erase_child;
@@ -757,12 +774,14 @@ const char* __repr__() {
 
 /* ignore weird functions using pointers */
 %ignore get_pair_frequencies(vector < vector <int> > *loci);
+%ignore calc_traits_and_fitness;
 
 /* read/write attributes */
 %feature("autodoc", "is the genome circular?") circular;
 %feature("autodoc", "current carrying capacity of the environment") carrying_capacity;
 %feature("autodoc", "outcrossing rate (probability of sexual reproduction per generation)") outcrossing_rate;
 %feature("autodoc", "crossover rate (probability of crossover per site per generation)") crossover_rate;
+%feature("autodoc", "compact the clones after a generation if the fraction of occupied clone slots falls below this value (0: never)") min_occupancy;
 %feature("autodoc",
 "Model of recombination to use
 
@@ -771,6 +790,15 @@ Available values:
    - FFPopSim.CROSSOVERS: linear chromosome with crossover probability per locus
 ") recombination_model;
 %feature("autodoc",
+"Model of selection to use
+
+Available values:
+   - FFPopSim.POISSON_OFFSPRING: Poisson offspring numbers, the population size
+     relaxes to the carrying capacity (default)
+   - FFPopSim.WRIGHT_FISHER: exactly carrying_capacity offspring are drawn from
+     a multinomial distribution weighted by fitness
+") selection_model;
+%feature("autodoc",
 "Growth rate
 
 This value is used to determine how fast a population converges to the
@@ -804,6 +832,19 @@ def mutation_rate(self, m):
         self._set_mutation_rate(m)
 %}
 
+%feature("autodoc",
+"Set a mutation rate for each locus
+
+Parameters:
+   - rates: mutation rates (per site per generation), one per locus
+
+Returns:
+   - zero if successful, nonzero if the rates are invalid
+
+.. note:: mutation_rate is the mean rate afterwards. Setting mutation_rate makes all rates equal again.
+") set_mutation_rates;
+%feature("autodoc", "mutation rate of each locus (per site per generation)") get_mutation_rates;
+
 /* do not expose the population, but rather only nonempty clones */
 %ignore population;
 %rename (_get_nonempty_clones) get_nonempty_clones;
@@ -817,7 +858,7 @@ Returns:
    - clone: the n-th clone in the population
 ") get_clone;
 clone_t get_clone(unsigned long n) {
-        return $self->population.at(n);
+        return $self->population.get_clone(n);
 
 }
 %pythonprepend get_clone {
@@ -929,6 +970,48 @@ void _get_trait_weights(double* ARGOUT_ARRAY1, int DIM1) {
 trait_weights = property(_get_trait_weights, _set_trait_weights)
 %}
 
+/* checkpoints */
+%feature("autodoc",
+"Write the complete state of the population to a binary checkpoint.
+
+Parameters:
+   - filename: the path of the file, which is overwritten
+
+The checkpoint holds the genotypes, clone sizes, fitness and traits of all clones,
+the trait coefficients, all parameters, the state of the random number generator
+and the genealogies, if tracked. It is much faster and smaller than dump().
+
+.. note:: The population can be restored using read_checkpoint.
+") write_checkpoint;
+%exception write_checkpoint {
+        $action
+        if (result) {
+                PyErr_SetString(PyExc_IOError,"Cannot write the checkpoint.");
+                SWIG_fail;
+        }
+}
+
+%feature("autodoc",
+"Restore the complete state of the population from a checkpoint.
+
+Parameters:
+   - filename: the path of a file written by write_checkpoint
+
+The population must have the same number of loci and traits as the saved one.
+A restored population evolves exactly like the saved one would have.
+") read_checkpoint;
+%exception read_checkpoint {
+        $action
+        if (result) {
+                PyErr_SetString(PyExc_IOError,"Cannot read the checkpoint.");
+                SWIG_fail;
+        }
+}
+%pythonappend read_checkpoint {
+self._nonempty_clones = _np.array(self._get_nonempty_clones())
+return None
+}
+
 /* dump to file */
 %pythoncode
 %{
@@ -953,12 +1036,14 @@ def dump(self, filename, format='bz2', include_genealogy=False):
     pop_dict['N'] = self.carrying_capacity
     pop_dict['L'] = self.L
     pop_dict['mu'] = self.mutation_rate
+    pop_dict['mutation_rates'] = self.get_mutation_rates()
     pop_dict['crossover_rate'] = self.crossover_rate
     pop_dict['outcrossing_rate'] = self.outcrossing_rate
     pop_dict['circular'] = self.circular
     pop_dict['generation'] = self.generation
     pop_dict['clone_sizes'] = self.get_clone_sizes()
     pop_dict['recombination_model'] = self.recombination_model
+    pop_dict['selection_model'] = self.selection_model
     pop_dict['traits_additive'] = [self.get_trait_additive(i) for i in range(self.number_of_traits)]
     pop_dict['traits_epistasis'] = [self.get_trait_epistasis(i) for i in range(self.number_of_traits)]
     pop_dict['all_polymorphic']  = self.all_polymorphic
@@ -1016,9 +1101,14 @@ def copy(self, rng_seed=0):
 
     # Mutation and recombination
     pop.recombination_model =  self.recombination_model
+    pop.selection_model = self.selection_model
     pop.outcrossing_rate = self.outcrossing_rate
     pop.crossover_rate = self.crossover_rate
-    pop.mutation_rate = self.mutation_rate
+    rates = self.get_mutation_rates()
+    if rates.min() < rates.max():
+        pop.set_mutation_rates(rates)
+    else:
+        pop.mutation_rate = self.mutation_rate
     pop.circular = self.circular
 
     # Fitness
@@ -1523,6 +1613,7 @@ void get_trait_additive(double* ARGOUT_ARRAY1, int DIM1, int t=0) {
 /* update functions we need in hivpopulation */
 %rename (_update_traits) update_traits;
 %rename (_update_fitness) update_fitness;
+%rename (_update_traits_and_fitness) update_traits_and_fitness;
 
 /* clear trait/fitness coefficients */
 %feature("autodoc",
@@ -1741,7 +1832,7 @@ if len(args):
     args = tuple(args)
 }
 boost::dynamic_bitset<> get_genotype(int n) {
-        return $self->population[n].genotype;
+        return $self->population.get_genotype(n);
 }
 %feature("autodoc",
 "Get a genotype from the population
@@ -2162,11 +2253,18 @@ def load_haploid_highd(filename, gen_loci=[], include_genealogy=False):
     pop.carrying_capacity = pop_dict['N']
     if pop.all_polymorphic == False:
         pop.mutation_rate = pop_dict['mu']
+        # files written before per-locus rates have the mean rate only
+        if 'mutation_rates' in pop_dict:
+            rates = pop_dict['mutation_rates']
+            if min(rates) < max(rates):
+                pop.set_mutation_rates(rates)
     pop.crossover_rate = pop_dict['crossover_rate']
     pop.outcrossing_rate = pop_dict['outcrossing_rate']
     pop.circular = pop_dict['circular']
 
     pop.recombination_model = pop_dict['recombination_model']
+    if 'selection_model' in pop_dict:
+        pop.selection_model = pop_dict['selection_model']
     for i in range(pop.number_of_traits):
         pop.set_trait_additive(pop_dict['traits_additive'][i], i)
         for (value, loci) in pop_dict['traits_epistasis'][i]:
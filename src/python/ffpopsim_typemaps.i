@@ -92,7 +92,7 @@
 {
         unsigned long L = $1.size();
         npy_intp dims[1] = {(npy_intp) L};
-        PyObject *array = PyArray_ZEROS(1, dims, NPY_FLOAT, 0);
+        PyObject *array = PyArray_ZEROS(1, dims, NPY_DOUBLE, 0);
         if (!array) SWIG_fail;
 
         /* no checks on memory alignments, since we create a new array */
@@ -0,0 +1,235 @@
+/*
+ * rng.cpp
+ *
+ * Random number generator backends and blocks of random numbers.
+ *
+ * Copyright (c) 2012-2013, Richard Neher, Fabio Zanini
+ * All rights reserved.
+ *
+ * This file is part of FFPopSim.
+ *
+ * FFPopSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FFPopSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FFPopSim. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ffpopsim_generic.h"
+
+// size of the buffer of uniform numbers of the block functions
+#define RNG_BUFFER 256
+// largest mean of Poisson and binomial numbers drawn by inversion in blocks
+#define RNG_INVERSION_MEAN 10
+
+/* xoshiro256++ as a GSL generator type */
+static void xoshiro256pp_set(void *state, unsigned long seed) {((xoshiro256pp_t *)state)->seed(seed);}
+static unsigned long xoshiro256pp_get(void *state) {return ((xoshiro256pp_t *)state)->next() >> 32;}
+static double xoshiro256pp_get_double(void *state) {return ((xoshiro256pp_t *)state)->uniform();}
+static const gsl_rng_type xoshiro256pp_type = {"xoshiro256++", 0xffffffffUL, 0, sizeof(xoshiro256pp_t),
+	&xoshiro256pp_set, &xoshiro256pp_get, &xoshiro256pp_get_double};
+const gsl_rng_type *ffpopsim_rng_xoshiro256pp = &xoshiro256pp_type;
+
+/* Philox4x32-10 as a GSL generator type: the seed is the key, the counter starts at zero */
+struct philox_state_t {
+	uint32_t key[2];
+	uint32_t counter[4];
+	uint32_t output[4];
+	int used;		//number of output words already returned
+	uint32_t next() {
+		if (used == 4) {
+			for (int k = 0; k < 4; k++) output[k] = counter[k];
+			philox4x32(output, key);
+			for (int k = 0; k < 4 and ++counter[k] == 0; k++);
+			used = 0;
+		}
+		return output[used++];
+	}
+	double uniform() {
+		uint64_t word = (uint64_t)next() << 32;
+		word |= next();
+		return (word >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+static void philox4x32_set(void *state, unsigned long seed) {
+	philox_state_t *philox = (philox_state_t *)state;
+	philox->key[0] = (uint32_t)seed;
+	philox->key[1] = (uint32_t)((uint64_t)seed >> 32);
+	for (int k = 0; k < 4; k++) philox->counter[k] = 0;
+	philox->used = 4;
+}
+static unsigned long philox4x32_get(void *state) {return ((philox_state_t *)state)->next();}
+static double philox4x32_get_double(void *state) {return ((philox_state_t *)state)->uniform();}
+static const gsl_rng_type philox4x32_type = {"philox4x32", 0xffffffffUL, 0, sizeof(philox_state_t),
+	&philox4x32_set, &philox4x32_get, &philox4x32_get_double};
+const gsl_rng_type *ffpopsim_rng_philox4x32 = &philox4x32_type;
+
+static int rng_backend = RNG_TAUS2;
+
+/**
+ * @brief Select the random number generator of simulations constructed from now on
+ *
+ * @param backend RNG_TAUS2 (default), RNG_XOSHIRO256PP or RNG_PHILOX4X32
+ *
+ * @returns zero if successful, -1 if the backend is unknown
+ *
+ * Existing objects keep the generator they were constructed with. The backend is global and
+ * should not be changed while simulations are being constructed on other threads.
+ */
+int set_rng_backend(int backend) {
+	if ((backend < RNG_TAUS2) or (backend > RNG_PHILOX4X32)) {
+		cerr <<"set_rng_backend(): unknown backend "<<backend<<endl;
+		return -1;
+	}
+	rng_backend = backend;
+	return 0;
+}
+
+/**
+ * @brief Get the random number generator backend of new simulations
+ */
+int get_rng_backend() {
+	return rng_backend;
+}
+
+/**
+ * @brief Get the GSL generator type of the selected backend (this is what RNG stands for)
+ */
+const gsl_rng_type *rng_backend_type() {
+	return rng_backend_type(rng_backend);
+}
+
+/**
+ * @brief Get the GSL generator type of any backend
+ *
+ * @returns the generator type, NULL if the backend is unknown
+ */
+const gsl_rng_type *rng_backend_type(int backend) {
+	switch (backend) {
+		case RNG_TAUS2: return gsl_rng_taus2;
+		case RNG_XOSHIRO256PP: return ffpopsim_rng_xoshiro256pp;
+		case RNG_PHILOX4X32: return ffpopsim_rng_philox4x32;
+		default: return NULL;
+	}
+}
+
+/* Uniform numbers from the state of a native generator, without calls through the GSL type */
+template <class state_t>
+static void uniform_block(state_t *state, double *out, size_t n) {
+	state_t local = *state;
+	for (size_t i = 0; i < n; i++)
+		out[i] = local.uniform();
+	*state = local;
+}
+
+/* Whether the generator is one of ours, i.e. if its numbers can be drawn in blocks */
+static bool is_native(const gsl_rng *rng) {
+	return (rng->type == ffpopsim_rng_xoshiro256pp) or (rng->type == ffpopsim_rng_philox4x32);
+}
+
+/**
+ * @brief Draw a block of uniform random numbers in [0, 1)
+ *
+ * @param rng random number generator
+ * @param out array of n numbers, overwritten
+ * @param n number of random numbers
+ */
+void rng_uniform_block(gsl_rng *rng, double *out, size_t n) {
+	if (rng->type == ffpopsim_rng_xoshiro256pp)
+		uniform_block((xoshiro256pp_t *)rng->state, out, n);
+	else if (rng->type == ffpopsim_rng_philox4x32)
+		uniform_block((philox_state_t *)rng->state, out, n);
+	else
+		for (size_t i = 0; i < n; i++)
+			out[i] = gsl_rng_uniform(rng);
+}
+
+/**
+ * @brief Draw a block of Poisson random numbers
+ *
+ * @param rng random number generator
+ * @param means array of n means
+ * @param out array of n random numbers, overwritten
+ * @param n number of random numbers
+ *
+ * With the generators of this library, means up to RNG_INVERSION_MEAN are drawn by inversion
+ * from one uniform number each, which are generated in blocks; larger means by gsl_ran_poisson.
+ */
+void rng_poisson_block(gsl_rng *rng, const double *means, unsigned int *out, size_t n) {
+	if (!is_native(rng)) {
+		for (size_t i = 0; i < n; i++)
+			out[i] = gsl_ran_poisson(rng, means[i]);
+		return;
+	}
+	double uniforms[RNG_BUFFER];
+	for (size_t start = 0; start < n; start += RNG_BUFFER) {
+		size_t end = min(n, start + RNG_BUFFER);
+		rng_uniform_block(rng, uniforms, end - start);
+		for (size_t i = start; i < end; i++) {
+			double mean = means[i];
+			unsigned int k = 0;
+			if (mean > RNG_INVERSION_MEAN) {
+				k = gsl_ran_poisson(rng, mean);
+			} else if (mean > 0) {
+				double u = uniforms[i - start], p = exp(-mean);
+				while ((u >= p) and (p > 0)) {
+					u -= p;
+					k++;
+					p *= mean / k;
+				}
+			}
+			out[i] = k;
+		}
+	}
+}
+
+/**
+ * @brief Draw a block of binomial random numbers
+ *
+ * @param rng random number generator
+ * @param p probability of success of each trial
+ * @param trials array of n numbers of trials
+ * @param out array of n random numbers, overwritten
+ * @param n number of random numbers
+ *
+ * With the generators of this library, binomial numbers with a mean up to RNG_INVERSION_MEAN are
+ * drawn by inversion from one uniform number each, the others by gsl_ran_binomial.
+ */
+void rng_binomial_block(gsl_rng *rng, double p, const unsigned int *trials, unsigned int *out, size_t n) {
+	if (!is_native(rng)) {
+		for (size_t i = 0; i < n; i++)
+			out[i] = gsl_ran_binomial(rng, p, trials[i]);
+		return;
+	}
+	// invert the rarer outcome
+	bool flip = (p > 0.5);
+	double q = flip ? 1 - p : p;
+	double odds = q / (1 - q);
+	double uniforms[RNG_BUFFER];
+	for (size_t start = 0; start < n; start += RNG_BUFFER) {
+		size_t end = min(n, start + RNG_BUFFER);
+		rng_uniform_block(rng, uniforms, end - start);
+		for (size_t i = start; i < end; i++) {
+			unsigned int k = 0;
+			if ((q <= 0) or (trials[i] == 0)) {
+				k = 0;
+			} else if (trials[i] * q > RNG_INVERSION_MEAN) {
+				k = gsl_ran_binomial(rng, q, trials[i]);
+			} else {
+				double u = uniforms[i - start], f = pow(1 - q, (double)trials[i]);
+				while ((u >= f) and (f > 0) and (k < trials[i])) {
+					u -= f;
+					k++;
+					f *= odds * (trials[i] - k + 1) / k;
+				}
+			}
+			out[i] = flip ? trials[i] - k : k;
+		}
+	}
+}
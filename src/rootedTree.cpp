@@ -301,6 +301,43 @@ tree_key_t rooted_tree::bridge_edge_node(tree_key_t to_be_bridged) {
 	return parent_key;
 }
 
+/*
+ * @brief gives a leaf a new key, e.g. after the corresponding clone was moved to another slot
+ * @params tree_key_t old_key current key of the leaf
+ * @params tree_key_t new_key key to be used from now on, which must not be in the tree yet
+ */
+int rooted_tree::rename_leaf(tree_key_t old_key, tree_key_t new_key) {
+	map <tree_key_t,node_t>::iterator Lnode = nodes.find(old_key);
+	if (Lnode==nodes.end() or Lnode->second.child_edges.size()>0 or nodes.count(new_key)) {
+		cerr <<"rooted_tree::rename_leaf(): no leaf "<<old_key<<" or key "<<new_key<<" in use"<<endl;
+		return RT_NODENOTFOUND;
+	}
+
+	//reinsert node and edge under the new key
+	node_t leaf = Lnode->second;
+	leaf.own_key = new_key;
+	nodes.erase(Lnode);
+	nodes.insert(pair<tree_key_t,node_t>(new_key, leaf));
+	map <tree_key_t,edge_t>::iterator Ledge = edges.find(old_key);
+	if (Ledge!=edges.end()) {
+		edge_t edge = Ledge->second;
+		edge.own_key = new_key;
+		edges.erase(Ledge);
+		edges.insert(pair<tree_key_t,edge_t>(new_key, edge));
+	}
+
+	//update the list of children of the parent, the register of leafs and the MRCA
+	map <tree_key_t,node_t>::iterator Pnode = nodes.find(leaf.parent_node);
+	if (Pnode!=nodes.end()) {
+		for (list <tree_key_t>::iterator child = Pnode->second.child_edges.begin();child!=Pnode->second.child_edges.end(); child++)
+			if (*child == old_key) {*child = new_key; break;}
+	}
+	for (vector <tree_key_t>::iterator old_leaf=leafs.begin(); old_leaf!=leafs.end(); old_leaf++)
+		if (*old_leaf == old_key) {*old_leaf = new_key; break;}
+	if (MRCA == old_key) MRCA = new_key;
+	return 0;
+}
+
 /*
  * @brief walk over all leafs and rebuild the number of ancestors leaf to root
  */
@@ -8,6 +8,9 @@
 
 /* Include directives */
 #include "ffpopsim_highd.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #define HIGHD_BADARG -1354341
 #define NOTHING 1e-10
 
@@ -146,7 +149,332 @@ int pop_evolve() {
 }
 
 
-/* Test evolution */
+/* Test that evolution depends on the seed only (also with several threads) */
+int pop_reproducible() {
+	int L = 200;
+	int N = 5000;
+	int err = 0;
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#endif
+
+	// crossovers, and obligate sex with free recombination
+	for(int model=0; model < 2; model++) {
+		haploid_highd pop1(L, 42);
+		haploid_highd pop2(L, 42);
+		haploid_highd *pops[2] = {&pop1, &pop2};
+		vector <int> loci;
+		for(int p=0; p < 2; p++) {
+#ifdef _OPENMP
+			omp_set_num_threads(p ? 3 : 1);
+#endif
+			pops[p]->set_mutation_rate(1e-3);
+			pops[p]->outcrossing_rate = model ? 1 : 0.2;
+			pops[p]->crossover_rate = 1e-2;
+			pops[p]->recombination_model = model ? FREE_RECOMBINATION : CROSSOVERS;
+			for(int i=0; i< L; i++) {
+				loci.assign(1, i);
+				pops[p]->add_fitness_coefficient(0.001 * (i % 5), loci);
+			}
+			pops[p]->set_wildtype(N);
+			pops[p]->evolve(20);
+		}
+		if((pop1.get_population_size() != pop2.get_population_size()) or
+		   (pop1.get_number_of_clones() != pop2.get_number_of_clones()) or
+		   (pop1.get_fitness_statistics().mean != pop2.get_fitness_statistics().mean))
+			err = 1;
+		for(int i=0; i< L; i++)
+			if(pop1.get_allele_frequency(i) != pop2.get_allele_frequency(i)) err = 1;
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Reproducible evolution with the same seed: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+
+/* Test the additive part of the hypercube against the direct sum over the loci */
+int hc_additive() {
+	int L = 1500;
+	int err = 0;
+	hypercube_highd hc(L, 3);
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 5);
+	vector <double> values(L);
+	vector <int> loci(1, 0);
+	for(int i=0; i < L; i++) {
+		values[i] = gsl_ran_gaussian(rng, 0.1);
+		loci[0] = i;
+		hc.add_coefficient(values[i], loci);
+	}
+	// both the bit by bit and the vectorized evaluation
+	double densities[2] = {0.01, 0.5};
+	for(int d=0; d < 2; d++) {
+		vector <uint64_t> words((L + 63) / 64, 0);
+		double direct = 0;
+		for(int i=0; i < L; i++) {
+			if(gsl_rng_uniform(rng) < densities[d]) {
+				words[i >> 6] |= ((uint64_t)1) << (i & 63);
+				direct += values[i];
+			} else
+				direct -= values[i];
+		}
+		if(fabs(hc.get_func(&words[0]) - direct) > 1e-10) err++;
+	}
+	gsl_rng_free(rng);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Additive hypercube values agree with the direct sum: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the evaluation of epistatic terms, and the differences between hypercube points */
+int hc_epistasis_diff() {
+	int L = 200;
+	int err = 0;
+	hypercube_highd hc(L, 3);
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 9);
+	vector <int> loci;
+	for(int i=0; i < 500; i++) {
+		loci.assign(2 + (i % 2), 0);
+		for(size_t j=0; j < loci.size(); j++)
+			loci[j] = gsl_rng_uniform_int(rng, L);
+		hc.add_coefficient(gsl_ran_gaussian(rng, 0.1), loci);
+	}
+	boost::dynamic_bitset<> gt1(L), gt2(L);
+	for(int i=0; i < L; i++)
+		gt1[i] = gsl_rng_uniform(rng) < 0.5;
+	// the full evaluation against the product of the signs of the loci
+	vector <coeff_t> terms = hc.get_epistasis();
+	if(terms.size() != 500) err++;
+	double direct = 0;
+	for(size_t t=0; t < terms.size(); t++) {
+		int sign = 1;
+		for(int j=0; j < terms[t].order; j++)
+			if(!gt1[terms[t].loci[j]]) sign *= -1;
+		direct += sign * terms[t].value;
+	}
+	if(fabs(hc.get_func(gt1) - direct) > 1e-10) err++;
+	// one and several loci that differ
+	for(int n_diff=1; n_diff < 20; n_diff += 6) {
+		gt2 = gt1;
+		vector <int> diffpos;
+		while((int)diffpos.size() < n_diff) {
+			int locus = gsl_rng_uniform_int(rng, L);
+			if(find(diffpos.begin(), diffpos.end(), locus) != diffpos.end()) continue;
+			diffpos.push_back(locus);
+			gt2.flip(locus);
+		}
+		if(fabs(hc.get_func_diff(gt1, gt2, diffpos) - (hc.get_func(gt1) - hc.get_func(gt2))) > 1e-10) err++;
+	}
+	gsl_rng_free(rng);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Epistatic differences agree with the full evaluation: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the genotype kernels of the clone store, specialized (L=200) and dynamic (L=600) */
+int store_kernels() {
+	int err = 0;
+	int Ls[2] = {200, 600};
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 3);
+	for(int l=0; l < 2; l++) {
+		int L = Ls[l];
+		clone_store store;
+		store.set_up(L, 1);
+		store.resize(4);
+		boost::dynamic_bitset<> gt1(L), gt2(L), pattern(L);
+		for(int i=0; i < L; i++) {
+			gt1[i] = gsl_rng_uniform(rng) < 0.5;
+			gt2[i] = gsl_rng_uniform(rng) < 0.5;
+			pattern[i] = gsl_rng_uniform(rng) < 0.5;
+		}
+		store.set_genotype(0, gt1);
+		store.set_genotype(1, gt2);
+		vector <uint64_t> pattern_words((L + 63) / 64);
+		boost::to_block_range(pattern, pattern_words.begin());
+		store.recombine(2, 3, 0, 1, &pattern_words[0]);
+
+		if(store.count(0) != (int)gt1.count()) err++;
+		if(store.distance(0, 1) != (int)(gt1 ^ gt2).count()) err++;
+		if(store.get_genotype(2) != ((gt1 & pattern) | (gt2 & ~pattern))) err++;
+		if(store.get_genotype(3) != ((gt2 & pattern) | (gt1 & ~pattern))) err++;
+		if((store.compare_genotypes(0, 0) != 0) or (store.compare_genotypes(0, 1) != -store.compare_genotypes(1, 0))) err++;
+
+		// the bulk allele count equals the clone by clone count
+		store.clone_size[0] = 1;
+		store.clone_size[1] = 1000;
+		store.clone_size[2] = 0;
+		store.clone_size[3] = 77;
+		vector <int> counts(L), bulk_counts(L);
+		for(int i=0; i < 4; i++)
+			store.add_allele_counts(i, store.clone_size[i], &counts[0]);
+		store.count_alleles(4, &bulk_counts[0]);
+		if(counts != bulk_counts) err++;
+
+		if(HIGHD_VERBOSE)
+			cerr<<"L = "<<L<<", fixed width: "<<store.is_fixed_width()<<", errors: "<<err<<endl;
+	}
+	gsl_rng_free(rng);
+	return err;
+}
+
+
+/* Test the crossover masks against patterns built locus by locus */
+int store_crossover_mask() {
+	int err = 0;
+	int Ls[3] = {200, 192, 600};
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 5);
+	for(int l=0; l < 3; l++) {
+		int L = Ls[l];
+		clone_store store;
+		store.set_up(L, 1);
+		vector <uint64_t> mask((L + 63) / 64), expected_words((L + 63) / 64);
+		for(int rep=0; rep < 100; rep++) {
+			// sorted points, possibly repeated or at the end of the genome
+			vector <int> points(gsl_rng_uniform_int(rng, 12));
+			for(size_t c=0; c < points.size(); c++)
+				points[c] = (gsl_rng_uniform(rng) < 0.1) ? L : 1 + gsl_rng_uniform_int(rng, L);
+			sort(points.begin(), points.end());
+			boost::dynamic_bitset<> expected;
+			bool origin = true;
+			for(size_t c=0; c < points.size(); c++) {
+				expected.resize(points[c], origin);
+				origin = !origin;
+			}
+			expected.resize(L, origin);
+			boost::to_block_range(expected, expected_words.begin());
+			store.crossover_mask(points, &mask[0]);
+			if(mask != expected_words) {err++; break;}
+		}
+	}
+	gsl_rng_free(rng);
+
+	// circular chromosomes with many crossovers
+	haploid_highd pop(300, 2);
+	pop.outcrossing_rate = 1;
+	pop.crossover_rate = 0.05;
+	pop.recombination_model = CROSSOVERS;
+	pop.circular = true;
+	pop.set_mutation_rate(1e-3);
+	pop.set_wildtype(1000);
+	pop.evolve(10);
+	if(pop.check_allele_counts() or (pop.get_population_size() <= 0)) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Crossover masks agree with patterns built locus by locus: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test that the free clone slots are handed out lowest first, across several words of the bitmaps */
+int store_free_slots() {
+	int err = 0;
+	free_slots_t slots;
+	if(slots.acquire() != -1) err++;
+	for(int i=9000; i >= 0; i -= 3)
+		slots.release(i);
+	slots.release(300);
+	if(slots.size() != 3001) err++;
+	for(int i=0; i <= 9000; i += 3)
+		if(slots.acquire() != i) {err++; break;}
+	if((slots.size() != 0) or (slots.acquire() != -1)) err++;
+	// released slots are reused before higher ones
+	slots.release(8000);
+	slots.release(17);
+	slots.release(4500);
+	if((slots.acquire() != 17) or (slots.acquire() != 4500) or (slots.acquire() != 8000)) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Free clone slots are handed out lowest first: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the generator of free recombination patterns */
+int pop_free_recombination() {
+	int L = 200;
+	int err = 0;
+
+	// reference output of xoshiro256++ from the state {1, 2, 3, 4}
+	xoshiro256pp_t rng;
+	for(int k=0; k < 4; k++) rng.s[k] = k + 1;
+	if((rng.next() != 41943041ULL) or (rng.next() != 58720359ULL) or (rng.next() != 3588806011781223ULL)) err++;
+
+	// mating between the two complementary genotypes mixes the loci
+	haploid_highd pop(L, 3);
+	pop.outcrossing_rate = 1;
+	pop.recombination_model = FREE_RECOMBINATION;
+	vector <genotype_value_pair_t> gts(2, genotype_value_pair_t(boost::dynamic_bitset<>(L), 1000));
+	gts[1].genotype.set();
+	pop.set_genotypes(gts);
+	pop.evolve();
+	if(pop.check_allele_counts()) err++;
+	vector <int> clones = pop.get_nonempty_clones();
+	int recombinants = 0;
+	double derived = 0;
+	for(size_t c=0; c < clones.size(); c++) {
+		string genotype = pop.get_genotype_string(clones[c]);
+		int count = std::count(genotype.begin(), genotype.end(), '1');
+		if(genotype.size() != (size_t)L) err++;
+		if((count > 0) and (count < L)) {
+			recombinants++;
+			derived += count;
+		}
+	}
+	if((recombinants < 500) or (fabs(derived / recombinants / L - 0.5) > 0.02)) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Free recombination draws unbiased patterns: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test that sparse genotypes evolve like dense ones (exact coefficients make fitness identical) */
+int pop_sparse() {
+	int L = 3000;
+	int N = 2000;
+	int err = 0;
+
+	haploid_highd pop1(L, 7);
+	haploid_highd pop2(L, 7);
+	haploid_highd *pops[2] = {&pop1, &pop2};
+	if(pop2.set_genotype_representation(SPARSE_GENOTYPES)) err++;
+	vector <int> loci;
+	for(int p=0; p < 2; p++) {
+		pops[p]->set_mutation_rate(1e-4);
+		pops[p]->outcrossing_rate = 0.5;
+		pops[p]->crossover_rate = 1e-3;
+		pops[p]->recombination_model = CROSSOVERS;
+		for(int i=0; i< L; i += 10) {
+			loci.assign(1, i);
+			pops[p]->add_fitness_coefficient(0.0078125 * (i % 3), loci);
+		}
+		loci.assign(1, 5);
+		loci.push_back(105);
+		pops[p]->add_fitness_coefficient(0.015625, loci);
+		pops[p]->set_wildtype(N);
+		pops[p]->evolve(30);
+	}
+	if((pop1.get_population_size() != pop2.get_population_size()) or
+	   (pop1.get_number_of_clones() != pop2.get_number_of_clones()) or
+	   (pop1.get_fitness_statistics().mean != pop2.get_fitness_statistics().mean))
+		err++;
+	for(int i=0; i< L; i++)
+		if(pop1.get_allele_frequency(i) != pop2.get_allele_frequency(i)) {err++; break;}
+	// the same genotype evaluates to the same traits in both representations
+	vector <int> clones = pop1.get_nonempty_clones();
+	for(size_t c=0; c < clones.size(); c++)
+		if(pop1.get_genotype_string(clones[c]) != pop2.get_genotype_string(clones[c])) {err++; break;}
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Sparse genotypes evolve like dense ones: "<<(err?"no":"yes")<<endl;
+	return err;
+}
 
 
 /* Test random sampling */
@@ -342,6 +670,855 @@ int pop_sampling() {
 //
 //
 
+/* Test the random epistasis: a function of the genotype only, in all representations */
+int hc_random_epistasis() {
+	int L = 300;
+	int err = 0;
+	hypercube_highd hc(L, 5);
+	hc.set_random_epistasis_strength(0.5);
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 11);
+	boost::dynamic_bitset<> gt1(L), gt2(L);
+	vector <int> loci1, loci2, diffpos;
+	double sum = 0, sum2 = 0;
+	int n = 2000;
+	for(int i=0; i < n; i++) {
+		loci1.clear();
+		for(int locus=0; locus < L; locus++) {
+			gt1[locus] = gsl_rng_uniform(rng) < 0.05;
+			if(gt1[locus]) loci1.push_back(locus);
+		}
+		double f = hc.get_func(gt1);
+		if((f != hc.get_func(loci1)) or (f != hc.get_func(gt1))) err++;
+		sum += f;
+		sum2 += f * f;
+		// differences at a few loci
+		gt2 = gt1;
+		diffpos.assign(1, gsl_rng_uniform_int(rng, L));
+		gt2.flip(diffpos[0]);
+		loci2.clear();
+		for(int locus=0; locus < L; locus++)
+			if(gt2[locus]) loci2.push_back(locus);
+		if(fabs(hc.get_func_diff(gt1, gt2, diffpos) - (f - hc.get_func(gt2))) > 1e-12) err++;
+		if(fabs(hc.get_func_diff(loci1, loci2, diffpos) - (f - hc.get_func(loci2))) > 1e-12) err++;
+	}
+	// standard normal values scaled by the epistatic strength
+	double mean = sum / n, var = sum2 / n - mean * mean;
+	if((fabs(mean) > 0.05) or (fabs(var - 0.25) > 0.03)) err++;
+	gsl_rng_free(rng);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Random epistasis is consistent across representations: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Set up a population for the tests of the clone bookkeeping: mutations, crossovers and an additive first trait at every third locus */
+static void setup_test_pop(haploid_highd &pop, bool sparse) {
+	if(sparse) pop.set_genotype_representation(SPARSE_GENOTYPES);
+	pop.set_mutation_rate(1e-3);
+	pop.outcrossing_rate = 0.2;
+	pop.crossover_rate = 1e-2;
+	pop.recombination_model = CROSSOVERS;
+	vector <int> loci(1, 0);
+	for(loci[0]=0; loci[0] < pop.L(); loci[0] += 3)
+		pop.add_trait_coefficient(0.01, loci, 0);
+}
+
+/* Test the batch evaluation of traits and fitness against single hypercubes and external genotypes */
+int pop_batch_traits() {
+	int L = 400;
+	int err = 0;
+
+	for(int rep=0; rep < 2; rep++) {
+		haploid_highd pop(L, 7, 2);
+		setup_test_pop(pop, rep);
+		double weights[2] = {1, 0.5};
+		pop.set_trait_weights(weights);
+		// the first trait is also built as a standalone hypercube
+		hypercube_highd hc(L);
+		vector <int> loci(1, 0);
+		for(int i=0; i < L; i += 3) {
+			loci[0] = i;
+			hc.add_coefficient(0.01, loci);
+			pop.add_trait_coefficient(-0.002 * (i % 5), loci, 1);
+		}
+		loci.assign(2, 0);
+		for(int i=0; i + 7 < L; i += 11) {
+			loci[0] = i;
+			loci[1] = i + 7;
+			pop.add_trait_coefficient(0.003, loci, 0);
+			hc.add_coefficient(0.003, loci);
+		}
+		pop.set_random_trait_epistasis(0.05, 1);
+		pop.set_wildtype(1000);
+		for(int g=0; g < 20; g++)
+			pop.evolve();
+		pop.update_traits_and_fitness();
+
+		vector <int> clones = pop.get_nonempty_clones();
+		vector <boost::dynamic_bitset<> > genotypes;
+		for(size_t c=0; c < clones.size(); c++)
+			genotypes.push_back(boost::dynamic_bitset<>(pop.get_genotype_string(clones[c])));
+		vector <double> traits, fitness;
+		if(pop.calc_traits_and_fitness(genotypes, traits, fitness)) err++;
+		double fitness_max = HP_VERY_NEGATIVE;
+		for(size_t c=0; c < clones.size(); c++) {
+			double t0 = pop.get_trait(clones[c], 0), t1 = pop.get_trait(clones[c], 1), f = pop.get_fitness(clones[c]);
+			if(fabs(t0 - hc.get_func(genotypes[c])) > 1e-10) err++;
+			if((traits[2 * c] != t0) or (traits[2 * c + 1] != t1) or (fitness[c] != f)) err++;
+			if(f != t0 + 0.5 * t1) err++;
+			fitness_max = fmax(fitness_max, f);
+		}
+		if(pop.get_max_fitness() != fitness_max) err++;
+		// genotypes of the wrong length are rejected
+		genotypes.assign(1, boost::dynamic_bitset<>(L + 1));
+		if(pop.calc_traits_and_fitness(genotypes, traits, fitness) != HP_BADARG) err++;
+	}
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Batch evaluation of traits and fitness agrees with single evaluations: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test that identical clones are merged as they arise, keeping the population consistent */
+int pop_deduplication() {
+	int L = 40;
+	int err = 0;
+
+	for(int rep=0; rep < 2; rep++) {
+		haploid_highd pop(L, 5);
+		setup_test_pop(pop, rep);
+		pop.set_wildtype(2000);
+		if(pop.set_clone_deduplication(true)) err++;
+		for(int g=0; g < 30; g++) {
+			pop.evolve();
+			if(g == 10) pop.add_genotype(boost::dynamic_bitset<>(L), 10);
+			vector <int> clones = pop.get_nonempty_clones();
+			set <string> genotypes;
+			int population_size = 0;
+			for(size_t c=0; c < clones.size(); c++) {
+				genotypes.insert(pop.get_genotype_string(clones[c]));
+				population_size += pop.get_clone_size(clones[c]);
+			}
+			if((genotypes.size() != clones.size()) or (pop.get_number_of_clones() != (int)clones.size())) {err++; break;}
+			if(pop.get_population_size() != population_size) {err++; break;}
+		}
+	}
+
+	// clones cannot be merged when the genealogy is tracked
+	haploid_highd pop(L);
+	vector <int> loci(1, L / 2);
+	pop.track_locus_genealogy(loci);
+	if(pop.set_clone_deduplication(true) != HP_BADARG) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Identical clones are merged as they arise: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the compaction of the clones into a dense prefix of the slots */
+int pop_compaction() {
+	int L = 60;
+	int err = 0;
+
+	for(int rep=0; rep < 2; rep++) {
+		haploid_highd pop(L, 7);
+		setup_test_pop(pop, rep);
+		pop.set_wildtype(5000);
+		pop.evolve(20);
+
+		// bottleneck, which leaves most slots empty
+		pop.carrying_capacity = 100;
+		pop.evolve(3);
+		vector <int> clones = pop.get_nonempty_clones();
+		multiset <pair <string, int> > genotypes;
+		for(size_t c=0; c < clones.size(); c++)
+			genotypes.insert(make_pair(pop.get_genotype_string(clones[c]), pop.get_clone_size(clones[c])));
+		stat_t fitness = pop.get_fitness_statistics();
+		int population_size = pop.get_population_size();
+		if(clones.back() + 1 == (int)clones.size()) err++;
+
+		pop.compact_clones();
+		clones = pop.get_nonempty_clones();
+		multiset <pair <string, int> > compacted;
+		for(size_t c=0; c < clones.size(); c++)
+			compacted.insert(make_pair(pop.get_genotype_string(clones[c]), pop.get_clone_size(clones[c])));
+		if((compacted != genotypes) or (clones.back() + 1 != (int)clones.size())) err++;
+		stat_t fitness_compacted = pop.get_fitness_statistics();
+		if((fabs(fitness.mean - fitness_compacted.mean) > 1e-10) or (pop.get_population_size() != population_size)) err++;
+
+		// automatic compaction during evolution
+		pop.min_occupancy = 0.5;
+		pop.carrying_capacity = 3000;
+		for(int g=0; g < 20; g++) {
+			pop.evolve();
+			clones = pop.get_nonempty_clones();
+			if(2 * (int)clones.size() < clones.back() + 1) {err++; break;}
+		}
+	}
+
+	// the leafs of the genealogy keep the indices of their clones
+	haploid_highd pop(L, 11);
+	pop.set_mutation_rate(1e-2);
+	vector <int> loci(2, L / 3);
+	loci[1] = 2 * L / 3;
+	pop.track_locus_genealogy(loci);
+	pop.set_wildtype(3000);
+	pop.min_occupancy = 0.9;
+	for(int g=0; g < 40; g++) {
+		pop.carrying_capacity = (g % 10 < 5) ? 3000 : 200;
+		pop.evolve();
+		vector <int> clones = pop.get_nonempty_clones();
+		for(size_t locus=0; locus < loci.size(); locus++) {
+			rooted_tree &tree = pop.genealogy.trees[locus];
+			if(tree.leafs.size() != clones.size()) err++;
+			for(size_t i=0; i < tree.leafs.size(); i++) {
+				if(pop.get_clone_size(tree.leafs[i].index) <= 0) err++;
+				map <tree_key_t, node_t>::iterator node = tree.nodes.find(tree.leafs[i]);
+				if(node == tree.nodes.end()) {err++; continue;}
+				list <tree_key_t> &siblings = tree.nodes[node->second.parent_node].child_edges;
+				if(find(siblings.begin(), siblings.end(), tree.leafs[i]) == siblings.end()) err++;
+				if(!tree.edges.count(tree.leafs[i])) err++;
+			}
+		}
+		if(err) break;
+	}
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Compaction preserves the population and its genealogy: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test that redundant matings return their offspring to the parental clones */
+int pop_redundant_matings() {
+	int L = 100;
+	int err = 0;
+
+	for(int rep=0; rep < 2; rep++) {
+		// a monomorphic population and two genotypes that differ at a single locus never create clones
+		haploid_highd pop(L, 13);
+		setup_test_pop(pop, rep);
+		pop.set_mutation_rate(0);
+		pop.outcrossing_rate = 1;
+		pop.recombination_model = FREE_RECOMBINATION;
+		pop.set_wildtype(1000);
+		pop.evolve(5);
+		if(pop.get_number_of_clones() != 1) err++;
+
+		vector <genotype_value_pair_t> gts(2, genotype_value_pair_t(boost::dynamic_bitset<>(L), 500));
+		gts[1].genotype[L / 2] = 1;
+		pop.recombination_model = CROSSOVERS;
+		pop.set_genotypes(gts);
+		for(int g=0; g < 10; g++) {
+			pop.evolve();
+			if(pop.get_number_of_clones() > 2) {err++; break;}
+		}
+		if(abs(pop.get_population_size() - 1000) > 200) err++;
+	}
+
+	// the check on the parents agrees with building the offspring, for patterns and crossover points
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 3);
+	for(int rep=0; rep < 2; rep++) {
+		clone_store store;
+		store.set_up(L, 1, rep ? SPARSE_GENOTYPES : DENSE_GENOTYPES);
+		store.resize(4);
+		vector <uint64_t> pattern(store.get_words());
+		for(int r=0; (r < 500) and !err; r++) {
+			boost::dynamic_bitset<> parent1(L), parent2(L);
+			for(int k=gsl_rng_uniform_int(rng, 4); k > 0; k--) parent1[gsl_rng_uniform_int(rng, L)] = 1;
+			for(int k=gsl_rng_uniform_int(rng, 4); k > 0; k--) parent2[gsl_rng_uniform_int(rng, L)] = 1;
+			store.set_genotype(0, parent1);
+			store.set_genotype(1, parent2);
+			vector <int> points(gsl_rng_uniform_int(rng, 4));
+			for(size_t c=0; c < points.size(); c++) points[c] = gsl_rng_uniform_int(rng, L);
+			sort(points.begin(), points.end());
+			store.crossover_mask(points, &pattern[0]);
+			store.recombine(2, 3, 0, 1, &pattern[0]);
+			bool copies = (store.compare_genotypes(2, 0) == 0) or (store.compare_genotypes(2, 1) == 0);
+			if((store.reproduces_parents(0, 1, &pattern[0]) != copies) or (store.reproduces_parents_crossovers(0, 1, points) != copies))
+				err++;
+		}
+	}
+	gsl_rng_free(rng);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Redundant matings create no clones: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the mutation rates per locus and the number of mutations */
+int pop_mutation_rates() {
+	int L = 100;
+	int N = 10000;
+	int err = 0;
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 9);
+
+	// alias table and zero-truncated Poisson numbers
+	alias_table_t table;
+	vector <double> weights(4, 0);
+	weights[0] = 1; weights[2] = 3; weights[3] = 6;
+	if(table.set_up(weights)) err++;
+	vector <int> draws(4, 0);
+	for(int i=0; i < 100000; i++) draws[table.draw(rng)]++;
+	if((draws[1] != 0) or (fabs(draws[0] / 1e4 - 1) > 0.1) or (fabs(draws[2] / 3e4 - 1) > 0.05) or (fabs(draws[3] / 6e4 - 1) > 0.05)) err++;
+	weights[1] = -1;
+	if(!table.set_up(weights)) err++;
+	double means[2] = {0.1, 3};
+	for(int m=0; m < 2; m++) {
+		double sum = 0;
+		for(int i=0; i < 100000; i++) sum += zero_truncated_poisson(rng, means[m]);
+		if(fabs(sum / 100000 - means[m] / (1 - exp(-means[m]))) > 0.02) err++;
+	}
+	gsl_rng_free(rng);
+
+	// only loci with a nonzero rate mutate
+	haploid_highd pop(L, 21);
+	vector <double> rates(L, 0);
+	rates[10] = 0.01;
+	rates[20] = 0.03;
+	if(pop.set_mutation_rates(vector <double>(L - 1, 0.01)) != HP_BADARG) err++;
+	if(pop.set_mutation_rates(rates)) err++;
+	if(fabs(pop.get_mutation_rate() - 4e-4) > 1e-12) err++;
+	pop.set_wildtype(N);
+	pop.evolve();
+	for(int locus=0; locus < L; locus++)
+		if((locus != 10) and (locus != 20) and (pop.get_allele_frequency(locus) > 0)) err++;
+	int n10 = pop.get_allele_frequency(10) * pop.get_population_size();
+	int n20 = pop.get_allele_frequency(20) * pop.get_population_size();
+	if((n10 < 60) or (n10 > 140) or (n20 < 220) or (n20 > 380)) err++;
+
+	// the number of mutations is Poisson with the total rate per individual
+	pop.set_mutation_rate(1e-3);
+	if(pop.get_mutation_rates() != vector <double>(L, 1e-3)) err++;
+	pop.set_wildtype(N);
+	pop.evolve();
+	double mutations = 0;
+	for(int locus=0; locus < L; locus++)
+		mutations += pop.get_allele_frequency(locus) * pop.get_population_size();
+	if(fabs(mutations / (1e-3 * L * pop.get_population_size()) - 1) > 0.1) err++;
+	if(pop.check_allele_counts()) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Mutations follow the rates of the loci: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the Wright-Fisher selection model with exactly carrying_capacity offspring */
+int pop_wright_fisher() {
+	int L = 100;
+	int N = 1001;
+	int err = 0;
+	gsl_rng *rng = gsl_rng_alloc(RNG);
+	gsl_rng_set(rng, 5);
+
+	// conditional binomials draw all of a multinomial sample
+	double weights[5] = {0.5, 0, 2, 1.5, 1};
+	vector <double> shares(5, 0);
+	for(int i=0; i < 10000; i++) {
+		unsigned int remaining = 100;
+		double remaining_weight = 5;
+		for(int k=0; k < 5; k++)
+			shares[k] += conditional_binomial(rng, weights[k], remaining_weight, remaining, k == 4);
+		if(remaining) err++;
+	}
+	for(int k=0; k < 5; k++)
+		if(fabs(shares[k] / 1e4 - 20 * weights[k]) > 0.5) err++;
+	gsl_rng_free(rng);
+
+	// the population size is exact, also with an odd number of sex gametes
+	haploid_highd pop(L, 17);
+	pop.selection_model = WRIGHT_FISHER;
+	pop.outcrossing_rate = 0.5;
+	pop.crossover_rate = 0.01;
+	pop.set_mutation_rate(1e-3);
+	vector <int> loci(1, 0);
+	for(loci[0]=0; loci[0] < L; loci[0]++)
+		pop.add_trait_coefficient(0.1, loci, 0);
+	pop.carrying_capacity = N;
+	pop.set_wildtype(N / 2);
+	for(int g=0; g < 20; g++) {
+		if(pop.evolve()) {err++; break;}
+		if((pop.get_population_size() != N) or pop.check_allele_counts()) {err++; break;}
+	}
+	// beneficial mutations are selected
+	double frequency = 0;
+	for(int locus=0; locus < L; locus++)
+		frequency += pop.get_allele_frequency(locus) / L;
+	if(frequency < 1.5 * 20 * 1e-3) err++;
+
+	pop.carrying_capacity = 0;
+	if(pop.evolve() != HP_BADARG) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Wright-Fisher selection keeps the population size: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Population whose fitness is the first trait plus an adjustable offset */
+class offset_fitness_pop : public haploid_highd {
+public:
+	double offset;
+	offset_fitness_pop(int L, int seed) : haploid_highd(L, seed, 2), offset(0) {}
+	double calc_fitness_from_traits(const double *traits) {return offset + traits[0];}
+};
+
+/* Test the single-sweep statistics and the cached selection weights against direct sums */
+int pop_clone_stat() {
+	int L = 60;
+	int err = 0;
+
+	offset_fitness_pop pop(L, 31);
+	vector <int> loci(1, 0);
+	for(loci[0]=0; loci[0] < L; loci[0]++) {
+		pop.add_trait_coefficient(0.01 * (loci[0] % 7), loci, 0);
+		pop.add_trait_coefficient(-0.02 * (loci[0] % 3), loci, 1);
+	}
+	pop.set_mutation_rate(5e-3);
+	pop.outcrossing_rate = 0.2;
+	pop.set_wildtype(2000);
+	for(int rep=0; rep < 2; rep++) {
+		// the second round moves fitness far away from the reference of the weights
+		pop.offset = 1000 * rep;
+		pop.update_fitness();
+		pop.evolve(10);
+		if(abs(pop.get_population_size() - 2000) > 300) err++;
+
+		double n = 0, f = 0, f2 = 0, t[2] = {0, 0}, tt[2][2] = {{0, 0}, {0, 0}};
+		int first = -1;
+		for(size_t i=0; i < pop.population.size(); i++) {
+			int csize = pop.get_clone_size(i);
+			if(csize == 0) continue;
+			double fitness = pop.population.fitness[i];
+			const double *traits = pop.population.trait(i);
+			n += csize;
+			f += fitness * csize;
+			f2 += fitness * fitness * csize;
+			for(int k=0; k < 2; k++) {
+				t[k] += traits[k] * csize;
+				for(int k1=0; k1 < 2; k1++) tt[k][k1] += traits[k] * traits[k1] * csize;
+			}
+			// the weights are proportional to exp(fitness)
+			if(first < 0) first = i;
+			double ratio = pop.population.fitness_weight[i] / pop.population.fitness_weight[first];
+			if(fabs(ratio / exp(fitness - pop.population.fitness[first]) - 1) > 1e-9) {err++; break;}
+		}
+		stat_t fitstat = pop.get_fitness_statistics();
+		if(fabs(fitstat.mean - f / n) > 1e-9 * fabs(f / n)) err++;
+		if(fabs(fitstat.variance - (f2 / n - f * f / n / n)) > 1e-6) err++;
+		for(int k=0; k < 2; k++) {
+			stat_t traitstat = pop.get_trait_statistics(k);
+			if(fabs(traitstat.mean - t[k] / n) > 1e-9) err++;
+			if(fabs(traitstat.variance - (tt[k][k] / n - t[k] * t[k] / n / n)) > 1e-9) err++;
+		}
+		if(fabs(pop.get_trait_covariance(0, 1) - (tt[0][1] / n - t[0] * t[1] / n / n)) > 1e-9) err++;
+	}
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Single-sweep statistics agree with direct sums: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the sampling of random individuals with and without replacement */
+int pop_clone_sampler() {
+	int L = 50;
+	int err = 0;
+
+	haploid_highd pop(L, 41);
+	vector <genotype_value_pair_t> gts(3, genotype_value_pair_t(boost::dynamic_bitset<>(L), 0));
+	gts[0].val = 300;
+	gts[1].genotype[1] = 1;
+	gts[1].val = 700;
+	gts[2].genotype[2] = 1;
+	gts[2].val = 1;
+	pop.set_genotypes(gts);
+	map <int, int> sizes;
+	for(size_t i=0; i < pop.population.size(); i++)
+		if(pop.get_clone_size(i)) sizes[i] = pop.get_clone_size(i);
+
+	// with replacement, clones are drawn proportionally to their sizes
+	vector <int> sample;
+	if(pop.random_clones(100000, &sample)) err++;
+	map <int, int> counts;
+	for(size_t i=0; i < sample.size(); i++) counts[sample[i]]++;
+	for(map<int, int>::iterator c = counts.begin(); c != counts.end(); c++)
+		if((sizes.count(c->first) == 0) or (fabs(c->second / 1e5 - sizes[c->first] / 1001.0) > 0.01)) err++;
+
+	// without replacement, the whole population can be sampled exactly once
+	sample.clear();
+	if(pop.random_clones(1001, &sample, false)) err++;
+	counts.clear();
+	for(size_t i=0; i < sample.size(); i++) counts[sample[i]]++;
+	if(counts != sizes) err++;
+	if(pop.random_clones(1002, &sample, false) != HP_BADARG) err++;
+
+	// the sampler follows the population after each generation
+	pop.set_mutation_rate(0.01);
+	pop.evolve(3);
+	for(int i=0; i < 1000; i++)
+		if(pop.get_clone_size(pop.random_clone()) == 0) {err++; break;}
+
+	// statistics and histograms of an extinct population fail instead of reading an empty sample
+	haploid_highd extinct(L, 41);
+	gsl_histogram *hist = NULL;
+	if(extinct.get_divergence_statistics(100).mean != 0) err++;
+	if(extinct.get_diversity_statistics(100).mean != 0) err++;
+	if(extinct.get_fitness_histogram(&hist, 10, 100) != HP_EXTINCTERR) err++;
+	if(extinct.get_divergence_histogram(&hist, 10, NULL, 1, 100) != HP_EXTINCTERR) err++;
+	if(extinct.get_diversity_histogram(&hist, 10, NULL, 1, 100) != HP_EXTINCTERR) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Random individuals are sampled by clone size: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the random number generator backends and the blocks of random numbers */
+int rng_backends() {
+	int err = 0;
+	if((get_rng_backend() != RNG_TAUS2) or (set_rng_backend(7) != -1)) err++;
+
+	// Philox4x32-10 known answer (Random123), as the first words of the generator with seed zero
+	gsl_rng *philox = gsl_rng_alloc(ffpopsim_rng_philox4x32);
+	gsl_rng_set(philox, 0);
+	if((gsl_rng_get(philox) != 0x6627e8d5UL) or (gsl_rng_get(philox) != 0xe169c58dUL)) err++;
+	gsl_rng_free(philox);
+
+	const gsl_rng_type *types[3] = {gsl_rng_taus2, ffpopsim_rng_xoshiro256pp, ffpopsim_rng_philox4x32};
+	for(int k=0; k < 3; k++) {
+		gsl_rng *rng = gsl_rng_alloc(types[k]);
+		gsl_rng *copy = gsl_rng_alloc(types[k]);
+		gsl_rng_set(rng, 3);
+		gsl_rng_set(copy, 3);
+
+		// blocks of uniform numbers continue the stream of single draws
+		vector <double> uniforms(1000);
+		rng_uniform_block(rng, &uniforms[0], 1000);
+		double mean = 0;
+		for(int i=0; i < 1000; i++) {
+			if(uniforms[i] != gsl_rng_uniform(copy)) {err++; break;}
+			mean += uniforms[i] / 1000;
+		}
+		if(fabs(mean - 0.5) > 0.05) err++;
+
+		// Poisson and binomial blocks have the right means and variances
+		int n = 20000;
+		double poisson_means[3] = {0.3, 4, 25};
+		for(int m=0; m < 3; m++) {
+			vector <double> means(n, poisson_means[m]);
+			vector <unsigned int> draws(n);
+			rng_poisson_block(rng, &means[0], &draws[0], n);
+			double sum = 0, sum2 = 0;
+			for(int i=0; i < n; i++) {sum += draws[i]; sum2 += double(draws[i]) * draws[i];}
+			double variance = sum2 / n - (sum / n) * (sum / n);
+			if((fabs(sum / n / poisson_means[m] - 1) > 0.05) or (fabs(variance / poisson_means[m] - 1) > 0.1)) err++;
+		}
+		double probabilities[3] = {0.2, 0.9, 0.5};
+		unsigned int trials[3] = {10, 7, 400};
+		for(int m=0; m < 3; m++) {
+			vector <unsigned int> ns(n, trials[m]), draws(n);
+			rng_binomial_block(rng, probabilities[m], &ns[0], &draws[0], n);
+			double sum = 0, sum2 = 0;
+			for(int i=0; i < n; i++) {
+				if(draws[i] > trials[m]) err++;
+				sum += draws[i];
+				sum2 += double(draws[i]) * draws[i];
+			}
+			double expected = trials[m] * probabilities[m];
+			double variance = sum2 / n - (sum / n) * (sum / n);
+			if((fabs(sum / n / expected - 1) > 0.05) or (fabs(variance / (expected * (1 - probabilities[m])) - 1) > 0.1)) err++;
+		}
+		gsl_rng_free(rng);
+		gsl_rng_free(copy);
+	}
+
+	// populations take the backend selected at construction, and are reproducible with it
+	if(set_rng_backend(RNG_XOSHIRO256PP)) err++;
+	haploid_highd pop1(100, 5), pop2(100, 5);
+	set_rng_backend(RNG_TAUS2);
+	haploid_highd pop3(100, 5);
+	haploid_highd *pops[3] = {&pop1, &pop2, &pop3};
+	for(int k=0; k < 3; k++) {
+		pops[k]->set_mutation_rate(1e-3);
+		pops[k]->outcrossing_rate = 0.5;
+		pops[k]->set_wildtype(2000);
+		pops[k]->evolve(20);
+	}
+	if(pop1.get_population_size() != pop2.get_population_size()) err++;
+	for(int locus=0; locus < 100; locus++)
+		if(pop1.get_allele_frequency(locus) != pop2.get_allele_frequency(locus)) {err++; break;}
+	bool same = (pop1.get_population_size() == pop3.get_population_size());
+	for(int locus=0; locus < 100; locus++)
+		same = same and (pop1.get_allele_frequency(locus) == pop3.get_allele_frequency(locus));
+	if(same) err++;
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Random number backends draw correct blocks: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Overwrite the values of an integer section of a checkpoint */
+int patch_checkpoint(const char *filename, uint32_t id, const vector <int32_t> &values) {
+	fstream file(filename, ios::in | ios::out | ios::binary);
+	checkpoint_header_t header;
+	file.read((char *)&header, sizeof(header));
+	vector <checkpoint_section_t> sections(header.number_of_sections);
+	file.read((char *)&sections[0], sections.size() * sizeof(checkpoint_section_t));
+	int found = 0;
+	for(size_t s=0; s < sections.size(); s++)
+		if(sections[s].id == id) {
+			if(sections[s].count != values.size()) return 1;
+			file.seekp(sections[s].offset);
+			file.write((const char *)&values[0], values.size() * sizeof(int32_t));
+			found = 1;
+		}
+	file.close();
+	return (file.fail() or !found) ? 1 : 0;
+}
+
+/* Write a sparse checkpoint of a single clone with derived loci 3 and 7, stored in the wrong order */
+int write_unsorted_checkpoint(const char *filename, int L) {
+	haploid_highd pop(L, 5);
+	pop.set_genotype_representation(SPARSE_GENOTYPES);
+	vector <genotype_value_pair_t> gts(1, genotype_value_pair_t(boost::dynamic_bitset<>(L), 10));
+	gts[0].genotype[3] = 1;
+	gts[0].genotype[7] = 1;
+	pop.set_genotypes(gts);
+	if(pop.write_checkpoint(filename)) return 1;
+
+	vector <int32_t> loci(2, 7);
+	loci[1] = 3;
+	return patch_checkpoint(filename, CKPT_DERIVED_LOCI, loci);
+}
+
+/* Write a checkpoint with an epistatic term between loci 3 and 7, with the second locus moved beyond the genome */
+int write_bad_epistasis_checkpoint(const char *filename, int L) {
+	haploid_highd pop(L, 5);
+	vector <int> loci(2, 3);
+	loci[1] = 7;
+	pop.add_fitness_coefficient(0.1, loci);
+	pop.set_wildtype(10);
+	if(pop.write_checkpoint(filename)) return 1;
+
+	loci[1] = L;
+	return patch_checkpoint(filename, CKPT_EPISTASIS_LOCI, vector <int32_t>(loci.begin(), loci.end()));
+}
+
+/* Test that a population restored from a checkpoint evolves exactly like the original */
+int pop_checkpoint() {
+	int L = 200;
+	int err = 0;
+	const char *filename = "highd_checkpoint.tmp";
+
+	// dense genotypes with crossovers, sparse genotypes with free recombination and Wright-Fisher
+	// selection on another generator, and tracked genealogies
+	for(int rep=0; rep < 3; rep++) {
+		if(rep == 1) set_rng_backend(RNG_XOSHIRO256PP);
+		haploid_highd pop(L, 17, 2);
+		set_rng_backend(RNG_TAUS2);
+		vector <int> loci(2, 10);
+		loci[1] = 150;
+		if(rep == 1) pop.set_genotype_representation(SPARSE_GENOTYPES);
+		if(rep == 2) pop.track_locus_genealogy(loci);
+		pop.set_mutation_rate(1e-3);
+		pop.outcrossing_rate = 0.5;
+		pop.crossover_rate = 1e-2;
+		if(rep == 1) {
+			pop.recombination_model = FREE_RECOMBINATION;
+			pop.selection_model = WRIGHT_FISHER;
+		}
+		pop.add_trait_coefficient(-0.02, loci, 0);
+		pop.set_random_trait_epistasis(0.01, 0);
+		loci.resize(1);
+		for(loci[0]=0; loci[0] < L; loci[0] += 3) {
+			pop.add_trait_coefficient(0.01, loci, 0);
+			pop.add_trait_coefficient(-0.01, loci, 1);
+		}
+		double weights[2] = {1, 0.5};
+		pop.set_trait_weights(weights);
+		pop.carrying_capacity = 2000;
+		pop.set_wildtype(2000);
+		pop.evolve(20);
+		if(pop.write_checkpoint(filename)) err++;
+		pop.evolve(10);
+
+		haploid_highd restored(L, 99, 2);
+		if(restored.read_checkpoint(filename)) err++;
+		if(restored.get_trait_weight(1) != 0.5) err++;
+		restored.evolve(10);
+		if((restored.get_generation() != pop.get_generation()) or (restored.N() != pop.N()) or
+		   (restored.get_number_of_clones() != pop.get_number_of_clones()) or
+		   (restored.get_trait_statistics(1).mean != pop.get_trait_statistics(1).mean))
+			err++;
+		for(int locus=0; locus < L; locus++)
+			if(restored.get_allele_frequency(locus) != pop.get_allele_frequency(locus)) {err++; break;}
+		if(rep == 2)
+			for(int i=0; i < 2; i++)
+				if(restored.genealogy.trees[i].print_newick() != pop.genealogy.trees[i].print_newick()) err++;
+	}
+
+	// populations of another shape and other files are rejected
+	haploid_highd other(L + 1, 1);
+	if(other.read_checkpoint(filename) != HP_BADARG) err++;
+	ofstream garbage(filename);
+	garbage<<"not a checkpoint"<<endl;
+	garbage.close();
+	haploid_highd same(L, 1, 2);
+	if(same.read_checkpoint(filename) != HP_BADARG) err++;
+	if(write_unsorted_checkpoint(filename, L)) err++;
+	haploid_highd unsorted(L, 1);
+	if(unsorted.read_checkpoint(filename) != HP_BADARG) err++;
+
+	// a rejected checkpoint leaves the population unchanged
+	if(write_bad_epistasis_checkpoint(filename, L)) err++;
+	haploid_highd kept(L, 1);
+	vector <int> loci(1, 4);
+	kept.add_fitness_coefficient(0.05, loci);
+	kept.set_mutation_rate(1e-3);
+	kept.set_wildtype(500);
+	kept.evolve(5);
+	int kept_N = kept.get_population_size(), kept_clones = kept.get_number_of_clones(), kept_generation = kept.get_generation();
+	double kept_fitness = kept.get_fitness_statistics().mean;
+	if(kept.read_checkpoint(filename) != HP_BADARG) err++;
+	if((kept.get_population_size() != kept_N) or (kept.get_number_of_clones() != kept_clones) or
+	   (kept.get_generation() != kept_generation) or (kept.get_fitness_statistics().mean != kept_fitness) or
+	   (kept.trait[0].get_additive_coefficient(4) != 0.05))
+		err++;
+	remove(filename);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Populations restored from checkpoints evolve like the original: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test statistics of a population mapped read-only from a checkpoint against the population itself */
+int pop_view() {
+	int L = 300;
+	int err = 0;
+	const char *filename = "highd_view.tmp";
+
+	for(int rep=0; rep < 2; rep++) {
+		haploid_highd pop(L, 23, 2);
+		if(rep) pop.set_genotype_representation(SPARSE_GENOTYPES);
+		pop.set_mutation_rate(1e-3);
+		pop.outcrossing_rate = 0.2;
+		pop.crossover_rate = 1e-2;
+		vector <int> loci(1, 0);
+		for(loci[0]=0; loci[0] < L; loci[0] += 5) {
+			pop.add_trait_coefficient(0.01, loci, 0);
+			pop.add_trait_coefficient(-0.02, loci, 1);
+		}
+		pop.carrying_capacity = 3000;
+		pop.set_wildtype(3000);
+		pop.evolve(30);
+		if(pop.write_checkpoint(filename)) err++;
+
+		population_view view;
+		if(view.open(filename)) {err++; continue;}
+		for(int locus=0; locus < L; locus++)
+			if(view.get_allele_frequency(locus) != pop.get_allele_frequency(locus)) {err++; break;}
+		if((view.L() != L) or (view.N() != pop.N()) or (view.get_generation() != pop.get_generation()) or
+		   (view.get_number_of_clones() != pop.get_number_of_clones()) or (view.get_genotype_representation() != rep) or
+		   (fabs(view.get_participation_ratio() - pop.get_participation_ratio()) > 1e-12))
+			err++;
+		if((fabs(view.get_fitness_statistics().mean - pop.get_fitness_statistics().mean) > 1e-10) or
+		   (fabs(view.get_fitness_statistics().variance - pop.get_fitness_statistics().variance) > 1e-10) or
+		   (fabs(view.get_trait_statistics(1).mean - pop.get_trait_statistics(1).mean) > 1e-10))
+			err++;
+
+		// the clones are used in place, with the slots and the cached fitness and traits of the population
+		vector <int> clones = view.get_nonempty_clones();
+		if(clones != pop.get_nonempty_clones()) err++;
+		for(size_t i=0; i < clones.size(); i++) {
+			int c = clones[i], d = clones[(i * 7) % clones.size()];
+			if((view.get_clone_size(c) != pop.get_clone_size(c)) or (view.get_fitness(c) != pop.population.fitness[c]) or
+			   (view.get_trait(c, 1) != pop.population.trait(c)[1]) or (view.get_genotype(c) != pop.population.get_genotype(c)) or
+			   (view.distance_Hamming(c, d) != pop.distance_Hamming(c, d)) or (view.get_locus(c, 100) != view.get_genotype(c)[100]))
+				{err++; break;}
+		}
+		if((view.get_genotype_words(clones[0]) == NULL) != (rep == 1)) err++;
+
+		// samples, statistics and histograms
+		vector <int> sample;
+		if(view.random_clones(500, &sample, false) or (sample.size() != 500)) err++;
+		for(size_t i=0; i < sample.size(); i++)
+			if(view.get_clone_size(sample[i]) <= 0) {err++; break;}
+		stat_t div = view.get_divergence_statistics(2000);
+		if(fabs(div.mean - pop.get_divergence_statistics(2000).mean) > 0.1 * div.mean + 0.5) err++;
+		if(view.get_diversity_statistics(500).mean < 0) err++;
+		gsl_histogram *hist = NULL;
+		if(view.get_divergence_histogram(&hist, 10, 1000)) err++;
+		else {
+			double total = 0;
+			for(size_t b=0; b < gsl_histogram_bins(hist); b++)
+				total += gsl_histogram_get(hist, b);
+			if((gsl_histogram_bins(hist) > 10) or (fabs(total - 1) > 1e-10)) err++;
+			gsl_histogram_free(hist);
+		}
+		if(view.get_diversity_histogram(&hist, 10, 1000)) err++;
+		else gsl_histogram_free(hist);
+		int hist_err = view.get_fitness_histogram(&hist, 10, 1000);
+		if(hist_err == 0) gsl_histogram_free(hist);
+		else if(hist_err != HP_NOBINSERR) err++;
+		view.close();
+		if(view.is_open() or view.N()) err++;
+	}
+
+	// other files are rejected
+	ofstream garbage(filename);
+	garbage<<"not a checkpoint"<<endl;
+	garbage.close();
+	population_view view;
+	if(view.open(filename) != HP_BADARG) err++;
+	if(write_unsorted_checkpoint(filename, L)) err++;
+	if(view.open(filename) != HP_BADARG) err++;
+	if(write_bad_epistasis_checkpoint(filename, L)) err++;
+	if(view.open(filename) != HP_BADARG) err++;
+	remove(filename);
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Views of checkpoints agree with the population: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
+/* Test the incremental allele counts against a full recount */
+int pop_allele_counts() {
+	int L = 500;
+	int err = 0;
+
+	// also with clones merged as they arise and compacted as slots empty
+	for(int rep=0; rep < 4; rep++) {
+		haploid_highd pop(L, 3);
+		if(rep % 2) pop.set_genotype_representation(SPARSE_GENOTYPES);
+		if(rep >= 2) {
+			if(pop.set_clone_deduplication(true)) err++;
+			pop.min_occupancy = 0.5;
+		}
+		pop.set_mutation_rate(1e-3);
+		pop.outcrossing_rate = 0.3;
+		pop.crossover_rate = 1e-2;
+		pop.recombination_model = CROSSOVERS;
+		vector <int> loci(1, 0);
+		for(int i=0; i< L; i += 7) {
+			loci[0] = i;
+			pop.add_fitness_coefficient(0.01, loci);
+		}
+		pop.set_wildtype(1000);
+		pop.get_allele_frequency(0);
+		for(int g=0; g < 50; g++) {
+			pop.evolve();
+			if(g == 25) pop.bottleneck(100);
+			if(g % 10 == 0) pop.unique_clones();
+			if(pop.check_allele_counts()) {err++; break;}
+			pop.get_allele_frequency(0);
+		}
+	}
+
+	if(HIGHD_VERBOSE)
+		cerr<<"Incremental allele counts agree with a recount: "<<(err?"no":"yes")<<endl;
+	return err;
+}
+
 /* MAIN */
 int main(int argc, char **argv){
 
@@ -356,6 +1533,27 @@ int main(int argc, char **argv){
 //		status += hc_setting();
 //		status += pop_initialize();
 		status += pop_evolve();
+		status += pop_reproducible();
+		status += hc_additive();
+		status += hc_epistasis_diff();
+		status += hc_random_epistasis();
+		status += store_kernels();
+		status += store_crossover_mask();
+		status += store_free_slots();
+		status += pop_free_recombination();
+		status += pop_sparse();
+		status += pop_allele_counts();
+		status += pop_batch_traits();
+		status += pop_deduplication();
+		status += pop_compaction();
+		status += pop_redundant_matings();
+		status += pop_mutation_rates();
+		status += pop_wright_fisher();
+		status += pop_clone_stat();
+		status += pop_clone_sampler();
+		status += rng_backends();
+		status += pop_checkpoint();
+		status += pop_view();
 //		status += pop_sampling();
 //		status += pop_Hamming();
 //		status += pop_divdiv();
@@ -124,6 +124,64 @@ int hiv_genes() {
 }
 
 
+/* Test that treatment weighs resistance into fitness */
+int hiv_treatment() {
+	int N = 1000;
+	hivpopulation pop(N, 1);
+
+	vector <int> loci(1, 100);
+	pop.add_trait_coefficient(0.05, loci, 1);
+	pop.update_traits();
+	int clone = pop.get_nonempty_clones()[0];
+
+	double fitness_untreated = pop.get_fitness(clone);
+	pop.set_treatment(1.0);
+	double fitness_treated = pop.get_fitness(clone);
+	double resistance = pop.get_trait(clone, 1);
+
+	if(HIV_VERBOSE) cerr<<"fitness untreated: "<<fitness_untreated<<", treated: "<<fitness_treated<<", resistance: "<<resistance<<endl;
+
+	return (fabs(fitness_treated - fitness_untreated - resistance) > NOTHING) or (fabs(resistance) < NOTHING);
+}
+
+
+
+/* Test that checkpoints keep the treatment */
+int hiv_checkpoint() {
+	int N = 1000, err = 0;
+	const char *filename = "hiv_checkpoint.tmp";
+	hivpopulation pop(N, 3, 2e-5, 1e-2, 1e-3);
+
+	vector <int> loci(1, 100);
+	pop.add_trait_coefficient(0.05, loci, 1);
+	pop.set_treatment(0.5);
+	pop.evolve(5);
+	err += bool(pop.write_checkpoint(filename));
+	pop.evolve(5);
+
+	hivpopulation restored;
+	err += bool(restored.read_checkpoint(filename));
+	remove(filename);
+	if(restored.get_treatment() != 0.5) err++;
+	restored.evolve(5);
+	if((restored.N() != pop.N()) or (restored.get_allele_frequency(100) != pop.get_allele_frequency(100))) err++;
+
+	// a checkpoint without the treatment is rejected and leaves the population as it was
+	haploid_highd plain(restored.L(), 5, restored.get_number_of_traits());
+	plain.set_wildtype(10);
+	err += bool(plain.write_checkpoint(filename));
+	int generation = restored.get_generation();
+	if(restored.read_checkpoint(filename) == 0) err++;
+	remove(filename);
+	if((restored.N() != pop.N()) or (restored.get_generation() != generation) or (restored.get_treatment() != 0.5) or
+	   (restored.get_allele_frequency(100) != pop.get_allele_frequency(100)))
+		err++;
+
+	if(HIV_VERBOSE) cerr<<"treatment after restoring: "<<restored.get_treatment()<<endl;
+	return err;
+}
+
+
 
 /* MAIN */
 int main(int argc, char **argv){
@@ -137,6 +195,8 @@ int main(int argc, char **argv){
 		status += hiv_evolve();
 		status += hiv_multiple_evolution();
 		status += hiv_genes();
+		status += hiv_treatment();
+		status += hiv_checkpoint();
 	}
 	cout<<"Number of errors: "<<status<<endl;
 	return status;